@@ -7,5 +7,6 @@
 #define CONFIG_H
 
 #cmakedefine DUMMY_RFM_DRIVER  @DUMMY_RFM_DRIVER@
+#cmakedefine ALLOC_COUNTER
 
 #endif // CONFIG_H
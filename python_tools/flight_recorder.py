@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+"""Read the files of the mBox flight recorder.
+
+The ring file (--recorder, default /dev/shm/mbox-flightrecorder.rec) holds the
+last cycles; a snapshot (<ring file>.<date>.snapshot) is written each time an
+error is posted. Both have the layout of src/modules/flightrecorder.h.
+
+Use: flight_recorder.py FILE [FILE...]
+"""
+from __future__ import division, print_function, unicode_literals
+
+import struct
+import sys
+
+import matplotlib.pyplot as plt
+import numpy as np
+
+HEADER = struct.Struct('<8sHHIIIQIIQ16x')
+HEADER_FIELDS = ['magic', 'version', 'header_size', 'slot_size',
+                 'slot_count', 'value_size', 'written', 'frozen',
+                 'error_code', 'frozen_at']
+SLOT_HEADER_SIZE = 48
+INVALID = 2**64 - 1
+
+
+def slot_dtype(slot_size, value_size):
+    """Numpy type of a slot (RecorderSlot_t and its arrays)."""
+    array = 8*value_size
+    return np.dtype({
+        'names': ['sequence', 'timestamp', 'loopPos', 'errorCode', 'times',
+                  'nbBPMx', 'nbBPMy', 'nbCMx', 'nbCMy', 'nbADC',
+                  'diffX', 'diffY', 'CMx', 'CMy', 'ADC'],
+        'formats': ['<u8', '<u8', '<i4', '<u4', ('<u4', 3),
+                    '<u2', '<u2', '<u2', '<u2', '<u2',
+                    ('<f8', value_size), ('<f8', value_size),
+                    ('<f8', value_size), ('<f8', value_size),
+                    ('<i2', value_size)],
+        'offsets': [0, 8, 16, 20, 24, 36, 38, 40, 42, 44,
+                    SLOT_HEADER_SIZE, SLOT_HEADER_SIZE + array,
+                    SLOT_HEADER_SIZE + 2*array, SLOT_HEADER_SIZE + 3*array,
+                    SLOT_HEADER_SIZE + 4*array],
+        'itemsize': slot_size,
+    })
+
+
+def load(filename):
+    """Load a ring file or a snapshot, in chronological order.
+
+    Return a dict with the header fields, and:
+     * sequence, timestamp (s), loopPos, errorCode: one value per cycle
+     * times: (cycles, 3) durations of acquisition/computation/output (s)
+     * diffX, diffY, CMx, CMy, ADC: (values, cycles), as the OrbitData
+    """
+    with open(filename, 'rb') as f:
+        data = f.read()
+
+    header = dict(zip(HEADER_FIELDS, HEADER.unpack_from(data)))
+    if header['magic'].rstrip(b'\0') != b'FOFBREC':
+        raise ValueError("{} is not a flight recorder file".format(filename))
+    if header['version'] != 1:
+        raise ValueError("Unknown version {}".format(header['version']))
+
+    dtype = slot_dtype(header['slot_size'], header['value_size'])
+    slots = np.frombuffer(data, dtype=dtype, count=header['slot_count'],
+                          offset=header['header_size'])
+
+    # In the ring, the oldest slot follows the newest one
+    valid = slots[(slots['sequence'] != INVALID)
+                  & (slots['sequence'] < header['written'])]
+    slots = valid[np.argsort(valid['sequence'])]
+
+    record = dict(header)
+    record['sequence'] = slots['sequence']
+    record['timestamp'] = slots['timestamp']*1e-9
+    record['loopPos'] = slots['loopPos']
+    record['errorCode'] = slots['errorCode']
+    record['times'] = slots['times']*1e-9
+    if len(slots) == 0:
+        return record
+
+    for name, size in [('diffX', 'nbBPMx'), ('diffY', 'nbBPMy'),
+                       ('CMx', 'nbCMx'), ('CMy', 'nbCMy'), ('ADC', 'nbADC')]:
+        record[name] = slots[name][:, :slots[size].max()].T
+    return record
+
+
+if __name__ == '__main__':
+    if len(sys.argv) < 2:
+        print(__doc__)
+        sys.exit(1)
+
+    for filename in sys.argv[1:]:
+        r = load(filename)
+        cycles = len(r['sequence'])
+        print("{}: {} cycles".format(filename, cycles))
+        if r['frozen'] or r['error_code']:
+            print("    frozen on error {} after {} cycles"
+                  .format(r['error_code'], r['frozen_at']))
+        if not cycles:
+            continue
+        errors = np.nonzero(r['errorCode'])[0]
+        for idx in errors:
+            print("    cycle {} (loopPos {}): error {}"
+                  .format(r['sequence'][idx], r['loopPos'][idx],
+                          r['errorCode'][idx]))
+
+        t = r['timestamp'] - r['timestamp'][-1]
+        plt.figure(filename)
+        plt.subplot(3, 1, 1)
+        plt.plot(t, r['diffX'].T, '-g', t, r['diffY'].T, '-b')
+        plt.ylabel('BPM')
+        plt.subplot(3, 1, 2)
+        plt.plot(t, r['CMx'].T, '-g', t, r['CMy'].T, '-b')
+        plt.ylabel('CM')
+        plt.subplot(3, 1, 3)
+        plt.plot(t, r['times']*1e6)
+        plt.legend(['acquisition', 'computation', 'output'])
+        plt.ylabel('Duration [us]')
+        plt.xlabel('Time before the last cycle [s]')
+
+    plt.show()
@@ -5,7 +5,7 @@ from __future__ import division, print_function, unicode_literals
 
 import numpy as np
 import matplotlib.pyplot as plt
-from zmq_client import ValuesSubscriber
+from zmq_client import TelemetrySubscriber
 from PyML import PyML
 
 SAMPLE_NB = 100
@@ -21,12 +21,10 @@ def show():
     posCMx = pml.getfamilydata('HCM', 'Pos')[pml.getActiveIdx('HCM')]
     posCMy = pml.getfamilydata('VCM', 'Pos')[pml.getActiveIdx('VCM')]
 
-    s = ValuesSubscriber()
+    s = TelemetrySubscriber()
     s.connect("tcp://localhost:5563")
     s.connect("tcp://localhost:3333")
-    s.subscribe(['FOFB-BPM-DATA',
-                 'FOFB-CM-DATA'
-                 ])
+    s.subscribe()
     fig = plt.figure(figsize=(10,5))
     f1 = fig.add_subplot(2,1,1)
     f2 = fig.add_subplot(2,1,2)
@@ -36,26 +34,22 @@ def show():
 
     while True:
         # Only to be sure not to lose anything
-        (valuesX, valuesY), loopPos = s.receive(1)
+        frame = s.receive(1)
 
-        print(len(posBPMx))
-        print(valuesX.size)
         if t < EVERYX:
             t += 1
             continue
-        if valuesX.size > 64: # it's a bpm value
-            f1.clear()
-            f1.plot(posBPMx, valuesX[:,0], '-g')
-            f1.plot(posBPMy, valuesY[:,0], '-b')
-            f1.autoscale()
-        else:
-            t = 0
-            f2.clear()
-            f2.plot(posCMx, valuesX[:,0], '-g')
-            f2.plot(posCMy, valuesY[:,0], '-b')
-            f2.autoscale()
+        t = 0
+        f1.clear()
+        f1.plot(posBPMx, frame['BPMx'][:,0], '-g')
+        f1.plot(posBPMy, frame['BPMy'][:,0], '-b')
+        f1.autoscale()
+        f2.clear()
+        f2.plot(posCMx, frame['CMx'][:,0], '-g')
+        f2.plot(posCMy, frame['CMy'][:,0], '-b')
+        f2.autoscale()
         plt.draw()
-        print(loopPos[0])
+        print(frame['loopPos'][0])
 
 if __name__ == "__main__":
     show()
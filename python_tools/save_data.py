@@ -9,7 +9,7 @@ import datetime
 import numpy as np
 import matplotlib.pyplot as plt
 
-from zmq_client import ValuesSubscriber
+from zmq_client import TelemetrySubscriber
 from PyML import PyML
 import search_kicks.tools as sktools
 
@@ -33,13 +33,9 @@ if __name__=='__main__':
     posCMx = pml.getfamilydata('HCM', 'Pos')[pml.getActiveIdx('HCM')]
     posCMy = pml.getfamilydata('VCM', 'Pos')[pml.getActiveIdx('VCM')]
 
-    sCM = ValuesSubscriber()
-    sCM.connect("tcp://localhost:3333")
-    sCM.subscribe(['FOFB-CM-DATA'])
-
-    sBPM = ValuesSubscriber()
-    sBPM.connect("tcp://localhost:3333")
-    sBPM.subscribe(['FOFB-BPM-DATA'])
+    s = TelemetrySubscriber()
+    s.connect("tcp://localhost:3333")
+    s.subscribe()
 
     bx = []
     by = []
@@ -51,12 +47,12 @@ if __name__=='__main__':
             i += 1
             if i % (150*5) == 0:  # Every 5s
                 print("Elapsed time = {}s".format(i/150))
-            [valuesX, valuesY], loopPos = sBPM.receive(1)
-            bx.append(valuesX[:, 0].tolist())
-            by.append(valuesY[:, 0].tolist())
-            [valuesX, valuesY], loopPos = sCM.receive(1)
-            cx.append(valuesX[:, 0].tolist())
-            cy.append(valuesY[:, 0].tolist())
+            # BPM and CM values of the same cycle
+            frame = s.receive(1)
+            bx.append(frame['BPMx'][:, 0].tolist())
+            by.append(frame['BPMy'][:, 0].tolist())
+            cx.append(frame['CMx'][:, 0].tolist())
+            cy.append(frame['CMy'][:, 0].tolist())
         except KeyboardInterrupt:
             orbit = sktools.io.OrbitData(BPMx=np.array(bx).T,
                                          BPMy=np.array(by).T,
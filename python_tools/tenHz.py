@@ -37,44 +37,27 @@ def init():
     HOST = 'tcp://localhost:3333'
     HOST_REQ = 'tcp://localhost:3334'
 
-    s_adc = zc.ValuesSubscriber()
-    s_adc.connect(HOST)
-    s_adc.subscribe(['FOFB-ADC-DATA'])
-
-    s_cm = zc.ValuesSubscriber()
-    s_cm.connect(HOST)
-    s_cm.subscribe(['FOFB-CM-DATA'])
-
-    s_bpm = zc.ValuesSubscriber()
-    s_bpm.connect(HOST)
-    s_bpm.subscribe(['FOFB-BPM-DATA'])
-
-    # Verify that all values are in the same loopPos
-    synchronized = False
-    while not synchronized:
-        _, loop_adc = s_adc.receive()
-        _, loop_bpm = s_bpm.receive()
-        _, loop_cm = s_cm.receive()
-
-        if loop_adc == loop_bpm and loop_adc == loop_cm:
-            synchronized = True
-        else:
-            print("{} {} {}".format(loop_adc, loop_bpm, loop_cm))
+    # ADC, BPM and CM values of each cycle come in the same frame
+    s_frame = zc.TelemetrySubscriber()
+    s_frame.connect(HOST)
+    s_frame.subscribe()
 
     sreq = zc.ZmqReq()
     sreq.connect(HOST_REQ)
 
-    return s_bpm, s_cm, s_adc, sreq
+    return s_frame, sreq
 
 if __name__=="__main__":
     SAMPLE_NB = 510
 
-    s_bpm, s_cm, s_adc, sreq = init()
+    s_frame, sreq = init()
     # Get values
-    (buff_adc), _ = s_adc.receive(SAMPLE_NB)
-    sin10 = buff_adc[62,:]
-    (BPMx, BPMy), _ = s_bpm.receive(SAMPLE_NB)
-    (CMx, CMy), _ = s_cm.receive(SAMPLE_NB)
+    frames = s_frame.receive(SAMPLE_NB)
+    if frames['dropped']:
+        print("{} frames dropped".format(frames['dropped']))
+    sin10 = frames['ADC'][62,:].astype(np.double)
+    BPMx, BPMy = frames['BPMx'], frames['BPMy']
+    CMx, CMy = frames['CMx'], frames['CMy']
 
     amp10, ph10 = sktools.maths.extract_sin_cos(sin10.reshape(1, SAMPLE_NB), 150., 10., 'polar')
  #   ampc, amps = fit_coefs(sin10.reshape(1, SAMPLE_NB), acos, asin, fs=150, f=10)
@@ -117,6 +100,11 @@ if __name__=="__main__":
 #    plt.plot(t, acos*np.cos(2*np.pi*10*t)+asin*np.sin(2*np.pi*10*t))
 #    plt.show()
 
+    # All values are applied at the same cycle, on COMMIT
+    ans = pack.unpack_string(sreq.ask('BEGIN'))
+    if ans != "ACK":
+        print("error on BEGIN: {}".format(ans))
+
     ans = pack.unpack_string(sreq.tell('SET AMPLITUDE-REF-10',
                                        pack.pack_double(amp10)))
     if ans != "ACK":
@@ -142,6 +130,12 @@ if __name__=="__main__":
     if ans != "ACK":
         print("error on PHASES-Y-10: {}".format(ans))
 
+    ans = pack.unpack_string(sreq.ask('COMMIT'))
+    if not ans.startswith("ACK"):
+        print("error on COMMIT: {}".format(ans))
+    else:
+        print("applied at loopPos {}".format(ans[4:]))
+
    # print('ampX')
    # print(ampX)
     print('ampY')
@@ -75,6 +75,160 @@ class ValuesSubscriber(ZmqSubscriber):
             return (valuesX), loopPos
 
 
+# Layout of FrameHeader_t (src/modules/zmq/telemetry.h), version 1
+FRAME_TOPIC = 'FOFB-FRAME'
+FRAME_HEADER = struct.Struct('<16sHHIQQiHHHHHHIIII')
+FRAME_FIELDS = ['topic', 'version', 'header_size', 'frame_size', 'sequence',
+                'timestamp', 'loopPos', 'nbBPMx', 'nbBPMy', 'nbCMx', 'nbCMy',
+                'nbADC', 'typeCorr', 'acquisition_time', 'computation_time',
+                'output_time', 'reserved']
+# Appended in version 2 (StageCounters_t): mask, then 3 stages x 5 counters
+STAGE_COUNTERS = struct.Struct('<II15Q')
+STAGES = ['acquisition', 'computation', 'output']
+COUNTERS = ['CYCLES', 'INSTRUCTIONS', 'LLC-MISSES', 'PAGE-FAULTS',
+            'CONTEXT-SWITCHES']
+
+
+def decode_frame(data):
+    """Decode a FOFB-FRAME message into a dict.
+
+    Times are in ns; BPMx, BPMy, CMx, CMy and ADC are numpy arrays.
+    counters is a (stage, counter) array, as in STAGES and COUNTERS, and
+    counters_available the mask of the counters that were counted (bit i
+    for COUNTERS[i]).
+    """
+    header = dict(zip(FRAME_FIELDS, FRAME_HEADER.unpack_from(data)))
+    if header['version'] < 1:
+        raise ValueError("Unknown frame version {}".format(header['version']))
+
+    header['counters_available'] = 0
+    header['counters'] = np.zeros((len(STAGES), len(COUNTERS)), dtype=np.uint64)
+    if header['version'] >= 2:
+        counters = STAGE_COUNTERS.unpack_from(data, FRAME_HEADER.size)
+        header['counters_available'] = counters[0]
+        header['counters'] = np.array(counters[2:], dtype=np.uint64).reshape(
+            len(STAGES), len(COUNTERS))
+
+    # Newer versions only append fields to the header
+    offset = header['header_size']
+    for name, dtype in [('BPMx', '<f8'), ('BPMy', '<f8'),
+                        ('CMx', '<f8'), ('CMy', '<f8'), ('ADC', '<i2')]:
+        count = header['nb' + name]
+        header[name] = np.frombuffer(data, dtype=dtype, count=count,
+                                     offset=offset)
+        offset += count*np.dtype(dtype).itemsize
+    return header
+
+
+class TelemetrySubscriber(ZmqSubscriber):
+    """Subscriber to the FOFB-FRAME telemetry frames.
+
+    receive(n) returns a dict with one column per frame for BPMx, BPMy, CMx,
+    CMy and ADC, and one value per frame for the other fields.  It replaces
+    the ValuesSubscribers on FOFB-BPM-DATA, FOFB-CM-DATA and FOFB-ADC-DATA,
+    and all values of a column come from the same cycle.  counters is a
+    (frame, stage, counter) array.
+    """
+    def __init__(self, thread_nb=1):
+        ZmqSubscriber.__init__(self, thread_nb)
+
+    def subscribe(self, subscriptions=[FRAME_TOPIC]):
+        ZmqSubscriber.subscribe(self, subscriptions)
+
+    def receive(self, message_nb=1):
+        frames = [decode_frame(message[0])
+                  for message in ZmqSubscriber.receive(self, message_nb)]
+
+        values = {}
+        for name in ['BPMx', 'BPMy', 'CMx', 'CMy', 'ADC']:
+            values[name] = np.array([f[name] for f in frames]).T
+        for name in FRAME_FIELDS[1:] + ['counters_available']:
+            values[name] = [f[name] for f in frames]
+        values['counters'] = np.array([f['counters'] for f in frames])
+
+        dropped = np.diff(values['sequence']) - 1
+        values['dropped'] = int(np.sum(dropped))
+        return values
+
+
+# Layout of AggregateHeader_t (src/modules/zmq/telemetry.h), version 1
+AGGREGATE_HEADER = struct.Struct('<16sHHIQQQQIHHHHIII')
+AGGREGATE_FIELDS = ['topic', 'version', 'header_size', 'frame_size',
+                    'first_sequence', 'last_sequence', 'first_timestamp',
+                    'last_timestamp', 'cycles', 'nbBPMx', 'nbBPMy', 'nbCMx',
+                    'nbCMy', 'max_acquisition_time', 'max_computation_time',
+                    'max_output_time']
+
+
+def decode_aggregate(data):
+    """Decode a FOFB-AGG-<N> message into a dict.
+
+    For each of BPMx, BPMy, CMx and CMy, the dict holds a sub-dict with the
+    'mean', 'min', 'max' and 'rms' numpy arrays.
+    """
+    header = dict(zip(AGGREGATE_FIELDS, AGGREGATE_HEADER.unpack_from(data)))
+    if header['version'] < 1:
+        raise ValueError("Unknown aggregate version {}".format(header['version']))
+
+    offset = header['header_size']
+    for name in ['BPMx', 'BPMy', 'CMx', 'CMy']:
+        count = header['nb' + name]
+        header[name] = {}
+        for stat in ['mean', 'min', 'max', 'rms']:
+            header[name][stat] = np.frombuffer(data, dtype='<f8', count=count,
+                                               offset=offset)
+            offset += count*8
+    return header
+
+
+class AggregateSubscriber(ZmqSubscriber):
+    """Subscriber to the FOFB-AGG-<cycles> stream.
+
+    receive(n) returns the list of the n decoded aggregates.
+    """
+    def __init__(self, cycles, thread_nb=1):
+        ZmqSubscriber.__init__(self, thread_nb)
+        self.cycles = cycles
+
+    def subscribe(self, subscriptions=None):
+        if subscriptions is None:
+            # The '\0' of the padding: FOFB-AGG-15 must not match FOFB-AGG-150
+            subscriptions = ['FOFB-AGG-{}\0'.format(self.cycles)]
+        ZmqSubscriber.subscribe(self, subscriptions)
+
+    def receive(self, message_nb=1):
+        return [decode_aggregate(message[0])
+                for message in ZmqSubscriber.receive(self, message_nb)]
+
+
+# Layout of Latency::LatencyHeader_t (src/modules/latency.h), version 1
+LATENCY_HEADER = struct.Struct('<16sHHIQHHHH')
+LATENCY_STAGES = ['ADC-WAIT', 'ADC-TRANSFER', 'GATHER', 'COMPUTE',
+                  'DYNAMIC-CORRECTION', 'DAC-WRITE', 'DAC-ACK']
+LATENCY_WINDOWS = ['1s', '1min', 'start']
+LATENCY_STATS = ['count', 'p50', 'p99', 'p99.9', 'max']
+
+
+def decode_latency(data):
+    """Decode a FOFB-LATENCY message.
+
+    Return {stage: {window: {stat: value}}}, durations in ns.  The same
+    values are given by the Messenger: 'GET LATENCY-<STAGE>' is a vector of
+    the 3 windows x 5 statistics.
+    """
+    (_, version, header_size, _, _, stage_nb, window_nb,
+     stat_nb, _) = LATENCY_HEADER.unpack_from(data)
+    if version < 1:
+        raise ValueError("Unknown latency version {}".format(version))
+
+    values = np.frombuffer(data, dtype='<u8', count=stage_nb*window_nb*stat_nb,
+                           offset=header_size)
+    values = values.reshape((stage_nb, window_nb, stat_nb))
+    return {stage: {window: dict(zip(LATENCY_STATS, values[i, j, :]))
+                    for j, window in enumerate(LATENCY_WINDOWS)}
+            for i, stage in enumerate(LATENCY_STAGES[:stage_nb])}
+
+
 class ZmqReq:
     def __init__(self, thread_nb=1):
         c = zmq.Context.instance(thread_nb)
@@ -19,20 +19,59 @@
 
 #include "adc.h"
 
+#include <algorithm>
 #include <chrono>
 #include <thread>
 
 #include "dma.h"
+#include "modules/latency.h"
+#include "modules/timers.h"
 #include "modules/zmq/logger.h"
 #include "rfmdriver.h"
 
 
+static_assert(ADC_BUFFER_SIZE*sizeof(RFM2G_INT16) <= DMA_ADC_SLOT_SIZE, "The ADC buffer does not fit in a DMA slot");
+static_assert(DAC_BUFFER_SIZE*sizeof(RFM2G_UINT32) <= DMA_ADC_OFFSET, "The DAC buffer overlaps the ADC slots");
+
 ADC::ADC(RFMDriver *driver, DMA *dma)
     : m_driver(driver)
     , m_dma(dma)
     , m_node(ADC_NODE)
-    , m_buffer(ADC_BUFFER_SIZE)
-{}
+    , m_transfer(Transfer::PIO)
+    , m_nextSlot(0)
+{
+    // The threshold is set once by DMA::init(): no need to ask at each cycle
+    RFM2G_UINT32 threshold = 0;
+    m_driver->getDMAThreshold(&threshold);
+
+    int data_size = ADC_BUFFER_SIZE*sizeof(RFM2G_INT16);
+    bool dmaSlots = (m_dma->adcSlot(0) != NULL) && (m_dma->adcSlot(DMA::ADC_SLOT_NB - 1) != NULL);
+    if (m_driver->window().covers(ADC_MEMPOS, data_size)) {
+        // The driver reads it from the window
+        m_transfer = Transfer::Mapped;
+        for (int i = 0 ; i < 2 ; i++) {
+            m_slots[i] = m_pioSlots[i];
+        }
+    } else if ((data_size >= threshold) && dmaSlots) {
+        m_transfer = Transfer::DMA;
+        for (int i = 0 ; i < 2 ; i++) {
+            m_slots[i] = (RFM2G_INT16*) m_dma->adcSlot(i);
+        }
+    } else {
+        m_transfer = Transfer::PIO;
+        for (int i = 0 ; i < 2 ; i++) {
+            m_slots[i] = m_pioSlots[i];
+        }
+    }
+    for (int i = 0 ; i < 2 ; i++) {
+        std::fill(m_slots[i], m_slots[i] + ADC_BUFFER_SIZE, 0);
+    }
+    m_buffer = m_slots[1];
+    const char* transferNames[] = { "PIO", "DMA", "mapped PIO" };
+    Logger::Logger() << "ADC transfer: " << transferNames[static_cast<int>(m_transfer)]
+                     << " (threshold " << threshold << " bytes, DMA slots "
+                     << (dmaSlots ? "available" : "unavailable") << ")";
+}
 
 ADC::~ADC()
 {
@@ -57,14 +96,10 @@ int ADC::init()
     // Write ADC CTRL
     Logger::Logger() << "\tADC write sampling config";
 
-    RFM2G_UINT32 threshold = 0;
-    // see if DMA threshold and buffer are intialized
-    m_driver->getDMAThreshold(&threshold);
-
     int data_size = 512;
     RFM2G_STATUS writeError;
-    if (data_size < threshold) {
-       // use PIO transfer
+    if (m_transfer != Transfer::DMA) {
+       // use PIO transfer (or the window)
        writeError = m_driver->write(0, &ctrlBuffer, 512);
     } else {
        RFM2G_INT32 *dst = (RFM2G_INT32*)m_dma->memory();
@@ -124,7 +159,10 @@ int ADC::read()
     eventInfo.Timeout = ADC_TIMEOUT;       // We'll wait this many milliseconds
 
     // Wait on an interrupt from the other Reflective Memory board
+    uint64_t waitStart = TimingModule::now();
     RFM2G_STATUS waitError = this->waitForEvent(eventInfo);
+    uint64_t transferStart = TimingModule::now();
+    Latency::record(Latency::Stage::ADCWait, transferStart - waitStart);
     if (waitError) {
         Logger::error(_ME_) << "waitForEvent:" << m_driver->errorMsg(waitError);
         return 1;
@@ -138,37 +176,21 @@ int ADC::read()
     m_dma->status()->loopPos = eventInfo.ExtendedInfo;
     RFM2G_NODE otherNodeId = eventInfo.NodeId;
 
-    /* Now read data from the other board from BPM_MEMPOS */
-    RFM2G_UINT32 threshold = 0;
-    /* see if DMA threshold and buffer are intialized */
-    m_driver->getDMAThreshold( &threshold );
-
+    /* Now read data from the other board from BPM_MEMPOS, in the next slot
+     * (with DMA, the driver makes the card write there directly) */
     int data_size = ADC_BUFFER_SIZE  *sizeof( RFM2G_INT16 );
-
-    if (data_size  < threshold) {
-        // use PIO transfer
-        RFM2G_STATUS readError = m_driver->read(ADC_MEMPOS + ( m_dma->status()->loopPos * data_size),
-                                                (void*)m_buffer.data(), data_size);
-        if (readError) {
-            Logger::error(_ME_) << "Read error: " << m_driver->errorMsg(readError);
-
-            return 1;
-        }
-
-    } else {
-        RFM2G_STATUS readError = m_driver->read(ADC_MEMPOS + ( m_dma->status()->loopPos * data_size),
-                                                (void*) m_dma->memory(), data_size);
-        if (readError) {
-            Logger::error(_ME_) << "Read error DMA: " << m_driver->errorMsg(readError);
-
-            return 1;
-        }
-
-        RFM2G_INT16 *src = (RFM2G_INT16*) m_dma->memory();
-        for (int i = 0 ; i < ADC_BUFFER_SIZE ; ++i) {
-            m_buffer.at(i) = src[i];
-        }
+    RFM2G_INT16* slot = m_slots[m_nextSlot];
+    RFM2G_STATUS readError = m_driver->read(ADC_MEMPOS + ( m_dma->status()->loopPos * data_size),
+                                            (void*) slot, data_size);
+    if (readError) {
+        Logger::error(_ME_) << ((m_transfer == Transfer::DMA) ? "Read error DMA: " : "Read error: ")
+                            << m_driver->errorMsg(readError);
+        return 1;
     }
+    m_buffer = slot;
+    m_nextSlot = 1 - m_nextSlot;
+
+    Latency::record(Latency::Stage::ADCTransfer, TimingModule::now() - transferStart);
 
     // Send an interrupt to the IOC Reflective Memory board
     if (!READONLY) {
@@ -27,8 +27,13 @@ class DMA;
 /**
  * @brief Read the data (= BPM values) from the RFM.
  *
- * It must first be asked to read, which copies the data to a local buffer,
- * then use the buffer.
+ * It must first be asked to read, then use the buffer.
+ *
+ * The values are not copied: read() transfers them into one of two slots
+ * (of the DMA buffer, or of the ADC for PIO transfers) and buffer() points
+ * to this slot. The next read() fills the other slot, so that the values of
+ * a cycle stay valid until the end of the next one. Whether PIO or DMA is
+ * used is decided once, in the constructor.
  *
  * \code{.cpp}
  * // Initialize
@@ -38,14 +43,27 @@ class DMA;
  * // Then each time needed
  * adc.read();
  * RFM2G_INT16 value = adc.bufferAt(12); // To get the 12th element
- * std::vector<RFM2G_INT16> buffer = adc.buffer() // To get the full buffer
+ * const RFM2G_INT16* buffer = adc.buffer() // To get the full buffer
  * \endcode
  */
 class ADC
 {
 public:
+    /**
+     * @brief How the buffer is read from the RFM.
+     */
+    enum class Transfer : int {
+        PIO = 0, /**< @brief The CPU copies the data (small buffers) */
+        DMA,     /**< @brief The card writes the data in the DMA buffer */
+        Mapped,  /**< @brief The CPU loads the data from the mapped window (see RFMWindow) */
+    };
+
     /**
      * @brief Constructor
+     *
+     * Choose the transfer: Mapped if the buffer is small enough for the
+     * window of the driver, DMA if it reaches the DMA threshold and the DMA
+     * buffer has room for the ADC slots, else PIO.
      */
     explicit ADC(RFMDriver *driver, DMA *dma);
 
@@ -71,24 +89,33 @@ public:
     /**
      * @brief Read the RFM
      *
-     * First wait for an interruption from the RFM, then read the RFM into `m_buffer`.
+     * First wait for an interruption from the RFM, then read the RFM into
+     * the next slot, which becomes `m_buffer`.
      */
     int read();
 
     /**
      * @brief Access to an element of the buffer.
      *
-     * @param id Index of the buffer element to return
+     * @param id Index of the buffer element to return (< ADC_BUFFER_SIZE,
+     * not checked)
      * @return Buffer element
      */
-    const RFM2G_INT16 bufferAt(int id) const { if (id < m_buffer.size()) return m_buffer.at(id); };
+    RFM2G_INT16 bufferAt(int id) const { return m_buffer[id]; };
 
     /**
-     * @brief Return the full buffer vector.
+     * @brief Return the buffer of the last read() (ADC_BUFFER_SIZE values).
+     *
+     * It is valid until the read() after the next one.
      *
-     * @return The buffer vector
+     * @return The buffer, read-only
      */
-    const std::vector<RFM2G_INT16>& buffer() const { return m_buffer; };
+    const RFM2G_INT16* buffer() const { return m_buffer; };
+
+    /**
+     * @brief Transfer chosen by the constructor.
+     */
+    Transfer transfer() const { return m_transfer; };
 
         /**
      * @brief Getter for m_waveIndexX element.
@@ -143,9 +170,29 @@ private:
     RFMDriver *m_driver;
 
     /**
-     * @brief Vector representing the data buffer
+     * @brief How the buffer is read.
+     */
+    Transfer m_transfer;
+
+    /**
+     * @brief Slots in which the buffer is read in turn.
+     */
+    RFM2G_INT16* m_slots[2];
+
+    /**
+     * @brief Slots for the PIO and mapped transfers.
+     */
+    RFM2G_INT16 m_pioSlots[2][ADC_BUFFER_SIZE];
+
+    /**
+     * @brief Slot to be filled by the next read().
+     */
+    int m_nextSlot;
+
+    /**
+     * @brief Slot filled by the last read().
      */
-    std::vector<RFM2G_INT16> m_buffer;
+    const RFM2G_INT16* m_buffer;
 
     /**
      * @brief Look-Up Table for indexes: m_waveIndexX[CMx_index] = position of in RFM.
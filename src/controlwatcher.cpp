@@ -0,0 +1,96 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "controlwatcher.h"
+
+#include "define.h"
+#include "rfmdriver.h"
+#include "modules/trace.h"
+#include "modules/zmq/logger.h"
+
+ControlWatcher::ControlWatcher(RFMDriver *driver, std::chrono::microseconds period)
+    : m_driver(driver)
+    , m_period(period)
+    , m_status(static_cast<int>(Status::Idle))
+    , m_running(false)
+{
+}
+
+ControlWatcher::~ControlWatcher()
+{
+    this->stop();
+}
+
+void ControlWatcher::start()
+{
+    if (m_running) {
+        return;
+    }
+    this->poll();
+    m_running = true;
+    m_thread = std::thread(&ControlWatcher::watchLoop, this);
+    Logger::Logger() << "Control word watcher started";
+}
+
+void ControlWatcher::stop()
+{
+    if (!m_running) {
+        return;
+    }
+    m_running = false;
+    m_thread.join();
+    // Release whoever still waits on us
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_changed.notify_all();
+}
+
+Status ControlWatcher::waitForChange(Status current, std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_changed.wait_for(lock, timeout, [&]{ return (this->status() != current) || !m_running; });
+    return this->status();
+}
+
+void ControlWatcher::waitFor(Status expected)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_changed.wait(lock, [&]{ return (this->status() == expected) || !m_running; });
+}
+
+void ControlWatcher::poll()
+{
+    // Only the first byte of the control word is meaningful
+    unsigned char value = 0;
+    if (m_driver->read(CTRL_MEMPOS, &value, 1)) {
+        return;
+    }
+
+    int previous = m_status.exchange(value, std::memory_order_acq_rel);
+    if (previous != value) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_changed.notify_all();
+    }
+}
+
+void ControlWatcher::watchLoop()
+{
+    Trace::nameThread("Control watcher");
+    while (m_running) {
+        this->poll();
+        std::this_thread::sleep_for(m_period);
+    }
+}
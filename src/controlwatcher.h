@@ -0,0 +1,147 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CONTROLWATCHER_H
+#define CONTROLWATCHER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "mbox.h"
+
+class RFMDriver;
+
+/**
+ * @brief Watch the control word written by the cBox at CTRL_MEMPOS.
+ *
+ * The control word is read in a background thread, so that the correction
+ * thread never has to access the RFM nor to sleep to know whether it should
+ * run. It only reads the last known Status (an atomic load) and, when it has
+ * nothing to do, blocks until the Status changes.
+ *
+ * \code{.cpp}
+ * ControlWatcher watcher(driver);
+ * watcher.start();
+ *
+ * Status status = watcher.status(); // No RFM access
+ * status = watcher.waitForChange(status, std::chrono::milliseconds(100));
+ * \endcode
+ */
+class ControlWatcher
+{
+public:
+    /**
+     * @brief Constructor
+     *
+     * @param driver Pointer to a RFMDriver object
+     * @param period Time between two reads of the control word
+     */
+    explicit ControlWatcher(RFMDriver *driver,
+                            std::chrono::microseconds period = std::chrono::milliseconds(1));
+
+    /**
+     * @brief Destructor. Stops the thread if needed.
+     */
+    ~ControlWatcher();
+
+    /**
+     * @brief Read the control word once and start the watching thread.
+     */
+    void start();
+
+    /**
+     * @brief Stop and join the watching thread.
+     */
+    void stop();
+
+    /**
+     * @brief Last Status read on the RFM.
+     */
+    Status status() const { return static_cast<Status>(m_status.load(std::memory_order_acquire)); }
+
+    /**
+     * @brief Block until the Status differs from `current` or until the timeout.
+     *
+     * @param current Status known by the caller
+     * @param timeout Maximum time to wait
+     * @return The Status at return time
+     */
+    Status waitForChange(Status current, std::chrono::milliseconds timeout);
+
+    /**
+     * @brief Block until the Status is `expected`.
+     *
+     * @param expected Status to wait for
+     */
+    void waitFor(Status expected);
+
+    /**
+     * @brief Access to the thread (e.g. to set its affinity).
+     */
+    std::thread& thread() { return m_thread; }
+
+private:
+    /**
+     * @brief Read the control word and wake up the waiters if it changed.
+     */
+    void poll();
+
+    /**
+     * @brief Loop of the watching thread.
+     */
+    void watchLoop();
+
+    /**
+     * @brief Pointer to a RFMDriver object.
+     */
+    RFMDriver *m_driver;
+
+    /**
+     * @brief Time between two reads.
+     */
+    std::chrono::microseconds m_period;
+
+    /**
+     * @brief Last control word read (see Status).
+     */
+    std::atomic<int> m_status;
+
+    /**
+     * @brief Whether the thread should keep watching.
+     */
+    std::atomic<bool> m_running;
+
+    /**
+     * @brief Watching thread.
+     */
+    std::thread m_thread;
+
+    /**
+     * @brief Mutex protecting m_changed.
+     */
+    std::mutex m_mutex;
+
+    /**
+     * @brief Notified at each Status change.
+     */
+    std::condition_variable m_changed;
+};
+
+#endif // CONTROLWATCHER_H
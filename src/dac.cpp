@@ -22,8 +22,12 @@
 #include "dma.h"
 #include "rfmdriver.h"
 #include "define.h"
+#include "modules/latency.h"
+#include "modules/realtime.h"
+#include "modules/timers.h"
 #include "modules/zmq/logger.h"
 
+#include <chrono>
 #include <iomanip>
 #include <string>
 #include <vector>
@@ -31,6 +35,12 @@
 DAC::DAC(RFMDriver *driver, DMA *dma)
     : m_driver(driver)
     , m_dma(dma)
+    , m_transfer(Transfer::PIO)
+    , m_pipelined(false)
+    , m_ackPending(false)
+    , m_ackLoopPos(0)
+    , m_ackFailedLoopPos(-1)
+    , m_ackError(RFM2G_SUCCESS)
 {
     std::vector<std::string> IOCsnames = {"IOCS15G", "IOCS2G", "IOCS4G", "IOCS6G", "IOCS8G", "IOCS10G", "IOCS12G", "IOCS14G", "IOCS16G", "IOC3S16G"};
     std::vector<int>  nodeIds =          { 0x02    ,  0x12   ,  0x14   ,  0x16   ,  0x18   ,  0x1A    ,  0x1C    ,  0x1E    ,  0x20    ,  0x21     };
@@ -39,12 +49,73 @@ DAC::DAC(RFMDriver *driver, DMA *dma)
         IOC ioc(nodeIds[i], IOCsnames[i], activeNodes[i]);
         m_IOCs.push_back(ioc);
     }
+
+    // The threshold is set once at startup (see RFMBenchmark): no need to
+    // ask at each cycle
+    RFM2G_UINT32 threshold = 0;
+    m_driver->getDMAThreshold(&threshold);
+
+    int data_size = DAC_BUFFER_SIZE*sizeof(RFM2G_UINT32);
+    if (m_driver->window().covers(DAC_MEMPOS, data_size)) {
+        // The driver writes it in the window
+        m_transfer = Transfer::Mapped;
+    } else if ((data_size >= threshold) && (m_dma->memory() != NULL)) {
+        m_transfer = Transfer::DMA;
+    } else {
+        m_transfer = Transfer::PIO;
+    }
+    const char* transferNames[] = { "PIO", "DMA", "mapped PIO" };
+    Logger::Logger() << "DAC transfer: " << transferNames[static_cast<int>(m_transfer)]
+                     << " (threshold " << threshold << " bytes)";
+}
+
+DAC::~DAC()
+{
+    this->setPipelined(false);
+}
+
+void DAC::setPipelined(bool pipelined)
+{
+    if (pipelined == m_pipelined) {
+        return;
+    }
+    if (pipelined) {
+        Logger::Logger() << "DAC acknowledgements are collected asynchronously";
+        m_pipelined = true;
+        m_ackFailedLoopPos = -1;
+        m_ackThread = std::thread(&DAC::ackLoop, this);
+        RealTime::moveToHousekeeping(m_ackThread, "DAC acknowledgement");
+    } else {
+        {
+            std::lock_guard<std::mutex> lock(m_ackMutex);
+            m_pipelined = false;
+        }
+        m_ackCond.notify_all();
+        this->cancelPendingAck();
+        m_ackThread.join();
+    }
+}
+
+void DAC::cancelPendingAck()
+{
+    std::unique_lock<std::mutex> lock(m_ackMutex);
+    while (m_ackPending) {
+        m_driver->cancelWaitForEvent(DAC_EVENT);
+        m_ackCond.wait_for(lock, std::chrono::milliseconds(10));
+    }
 }
 
 void DAC::changeStatus(int status)
 {
     if (READONLY) return;
 
+    if (m_pipelined && (status == DAC_DISABLE)) {
+        // Don't leave the acknowledgement thread waiting for IOCs that stop
+        this->cancelPendingAck();
+        std::lock_guard<std::mutex> lock(m_ackMutex);
+        m_ackFailedLoopPos = -1;
+    }
+
     if (status == DAC_ENABLE) {
         Logger::Logger() << "Starting DACs ... ";;
     } else if (status == DAC_DISABLE) {
@@ -70,6 +141,18 @@ int DAC::write(double plane, double loopDir, RFM2G_UINT32* data)
     if (READONLY)
         return 0;
 
+    // The previous acknowledgement must be collected before the event is
+    // cleared again. Only the time it makes this loop wait is recorded.
+    if (m_pipelined) {
+        uint64_t ackStart = TimingModule::now();
+        int ackError = this->waitPreviousAck();
+        Latency::record(Latency::Stage::DACAck, TimingModule::now() - ackStart);
+        if (ackError) {
+            return 1;
+        }
+    }
+    uint64_t writeStart = TimingModule::now();
+
     int writeflag = 0;
     //plane = 4;
     switch((int) plane) {
@@ -110,17 +193,13 @@ int DAC::write(double plane, double loopDir, RFM2G_UINT32* data)
     //t_dac_clear.clock();
 
     // fill DAC to RFM
-    RFM2G_UINT32 threshold = 0;
-    // see if DMA threshold and buffer are intialized
-    m_driver->getDMAThreshold( &threshold );
-
     int data_size = DAC_BUFFER_SIZE*sizeof(RFM2G_UINT32);
     RFM2G_STATUS writeError(RFM2G_SUCCESS);
 
-    if (data_size < threshold) {
-         // use PIO transfer
+    if (m_transfer != Transfer::DMA) {
+         // use PIO transfer (or the window)
         writeError = m_driver->write(DAC_MEMPOS + (rfm2gMemNumber*data_size),
-                                                  &data, data_size);
+                                                  data, data_size);
     } else {
         RFM2G_INT32 *dst = (RFM2G_INT32*) m_dma->memory();
         for (int i = 0 ; i < DAC_BUFFER_SIZE ; ++i) {
@@ -148,6 +227,18 @@ int DAC::write(double plane, double loopDir, RFM2G_UINT32* data)
         return 1;
     }
     //t_dac_send.clock();
+    uint64_t ackStart = TimingModule::now();
+    Latency::record(Latency::Stage::DACWrite, ackStart - writeStart);
+
+    if (m_pipelined) {
+        {
+            std::lock_guard<std::mutex> lock(m_ackMutex);
+            m_ackLoopPos = m_dma->status()->loopPos;
+            m_ackPending = true;
+        }
+        m_ackCond.notify_all();
+        return 0;
+    }
 
     // wait for at least one ack.
     RFM2GEVENTINFO EventInfo;
@@ -155,6 +246,7 @@ int DAC::write(double plane, double loopDir, RFM2G_UINT32* data)
     EventInfo.Timeout = DAC_TIMEOUT;  /* We'll wait this many milliseconds */
 
     RFM2G_STATUS waitError = m_driver->waitForEvent(&EventInfo);
+    Latency::record(Latency::Stage::DACAck, TimingModule::now() - ackStart);
     if (waitError) {
         Logger::error(_ME_) << "waitForEvent: " << m_driver->errorMsg(waitError) ;;
         return 1;
@@ -165,3 +257,50 @@ int DAC::write(double plane, double loopDir, RFM2G_UINT32* data)
 
     return 0;
 }
+
+int DAC::waitPreviousAck()
+{
+    std::unique_lock<std::mutex> lock(m_ackMutex);
+    m_ackCond.wait(lock, [&]{ return !m_ackPending; });
+
+    if (m_ackFailedLoopPos >= 0) {
+        Logger::error(_ME_) << "No acknowledgement for loopPos " << m_ackFailedLoopPos
+                            << ", waitForEvent: " << m_driver->errorMsg(m_ackError);
+        m_ackFailedLoopPos = -1;
+        return 1;
+    }
+    return 0;
+}
+
+void DAC::ackLoop()
+{
+    for (;;) {
+        int loopPos;
+        {
+            std::unique_lock<std::mutex> lock(m_ackMutex);
+            m_ackCond.wait(lock, [&]{ return m_ackPending || !m_pipelined; });
+            if (!m_pipelined) {
+                m_ackPending = false;
+                break;
+            }
+            loopPos = m_ackLoopPos;
+        }
+
+        // wait for at least one ack.
+        RFM2GEVENTINFO EventInfo;
+        EventInfo.Event   = DAC_EVENT;    /* We'll wait on this interrupt */
+        EventInfo.Timeout = DAC_TIMEOUT;  /* We'll wait this many milliseconds */
+        RFM2G_STATUS waitError = m_driver->waitForEvent(&EventInfo);
+
+        {
+            std::lock_guard<std::mutex> lock(m_ackMutex);
+            if (waitError) {
+                m_ackFailedLoopPos = loopPos;
+                m_ackError = waitError;
+            }
+            m_ackPending = false;
+        }
+        m_ackCond.notify_all();
+    }
+    m_ackCond.notify_all();
+}
@@ -18,7 +18,10 @@
 #ifndef DAC_H
 #define DAC_H
 
+#include <condition_variable>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "define.h"
@@ -86,11 +89,29 @@ private:
 class DAC
 {
 public:
+    /**
+     * @brief How the buffer is written to the RFM.
+     */
+    enum class Transfer : int {
+        PIO = 0, /**< @brief The CPU copies the data (small buffers) */
+        DMA,     /**< @brief The card reads the data from the DMA buffer */
+        Mapped,  /**< @brief The CPU stores the data in the mapped window (see RFMWindow) */
+    };
+
     /**
      * @brief Constructor
+     *
+     * Choose the transfer, as the ADC does: Mapped if the buffer is small
+     * enough for the window of the driver, DMA if it reaches the DMA
+     * threshold and the DMA buffer is mapped, else PIO.
      */
     explicit DAC(RFMDriver *driver, DMA *dma);
 
+    /**
+     * @brief Destructor. Stops the acknowledgement thread if needed.
+     */
+    ~DAC();
+
     /**
      * @brief Enable or disable the DAC and the underlying IOCs.
      *
@@ -139,11 +160,47 @@ public:
      * @param[in] loopDir
      * @param[in] data Pointer to the data to write.
      *
+     * In pipelined mode, the function returns as soon as the IOCs are told to
+     * work: the acknowledgement is collected by a second thread while the next
+     * ADC event is awaited. A missing acknowledgement is then reported (with
+     * its loop position) by the next call.
+     *
      * @return Value of the error (0 = Success)
      */
     int write(double plane, double loopDir, RFM2G_UINT32* data);
 
+    /**
+     * @brief Enable or disable the pipelined mode (see write()).
+     *
+     * @param pipelined True to collect the acknowledgements asynchronously.
+     */
+    void setPipelined(bool pipelined);
+
+    /**
+     * @brief Transfer chosen by the constructor.
+     */
+    Transfer transfer() const { return m_transfer; };
+
 private:
+    /**
+     * @brief Wait until the acknowledgement of the last write is collected.
+     *
+     * @return 1 if it was missing, 0 else
+     */
+    int waitPreviousAck();
+
+    /**
+     * @brief Make m_ackThread give up the acknowledgement it waits for.
+     *
+     * The cancel is repeated until it is effective: the thread may not have
+     * reached waitForEvent() yet, then a single cancel would be lost.
+     */
+    void cancelPendingAck();
+
+    /**
+     * @brief Loop of m_ackThread: wait for the DAC_EVENT of each write.
+     */
+    void ackLoop();
 
     /**
      * @brief Pointer to a DMA object.
@@ -155,6 +212,11 @@ private:
      */
     RFMDriver *m_driver;
 
+    /**
+     * @brief How the buffer is written.
+     */
+    Transfer m_transfer;
+
     /**
      * @brief Look-Up Table for indexes: m_waveIndexX[CMx_index] = position of in RFM.
      */
@@ -169,6 +231,46 @@ private:
      * @brief Vector of IOCs to connect and write to.
      */
     std::vector<IOC> m_IOCs;
+
+    /**
+     * @brief Are the acknowledgements collected asynchronously?
+     */
+    bool m_pipelined;
+
+    /**
+     * @brief Thread collecting the acknowledgements in pipelined mode.
+     */
+    std::thread m_ackThread;
+
+    /**
+     * @brief Mutex protecting the acknowledgement attributes below.
+     */
+    std::mutex m_ackMutex;
+
+    /**
+     * @brief Notified when an acknowledgement is requested or collected.
+     */
+    std::condition_variable m_ackCond;
+
+    /**
+     * @brief Is an acknowledgement expected?
+     */
+    bool m_ackPending;
+
+    /**
+     * @brief Loop position of the expected acknowledgement.
+     */
+    int m_ackLoopPos;
+
+    /**
+     * @brief Loop position of a missing acknowledgement (-1 if none).
+     */
+    int m_ackFailedLoopPos;
+
+    /**
+     * @brief Error returned by waitForEvent for the missing acknowledgement.
+     */
+    RFM2G_STATUS m_ackError;
 };
 
 #endif // DAC_H
@@ -62,6 +62,8 @@ const int DMAOFF_A = 0x00100000;                        /**< @brief DMA ?????. *
 const int LINUX_DMA_FLAG = 0x01;                        /**< @brief DMA flag ??. */
 const int LINUX_DMA_FLAG2 = 0;                          /**< @brief DMA flag2 ??. */
 const int DMA_THRESHOLD = 128;                          /**< @brief Threshold after which DMA is used. */
+const int DMA_ADC_OFFSET = 0x00010000;                  /**< @brief Offset of the ADC slots in the DMA buffer (after the DAC one). */
+const int DMA_ADC_SLOT_SIZE = 0x00001000;               /**< @brief Size of an ADC slot in the DMA buffer (page aligned). */
 
 const RFM2GEVENTTYPE ADC_EVENT = RFM2GEVENT_INTR1;      /**< @brief Interruption for ADC. */
 const RFM2GEVENTTYPE ADC_DAC_EVENT = RFM2GEVENT_INTR2;  /**< @brief Interruption for ADC and DAC. */
@@ -19,6 +19,8 @@
 
 #include "dma.h"
 
+#include <cstring>
+
 #include <unistd.h>  // needed for getpagesize()
 
 #include "rfmdriver.h"
@@ -26,6 +28,9 @@
 
 DMA::DMA()
     : m_memory(NULL)
+    , m_size(0)
+    , m_pioWindow(NULL)
+    , m_pioSize(0)
 {
     m_status = new t_status;
 }
@@ -49,6 +54,7 @@ int DMA::init(RFMDriver *driver)
     driver->setDMAThreshold(DMA_THRESHOLD);
 
     RFM2GCONFIG rfm2gConfig;
+    memset(&rfm2gConfig, 0, sizeof(rfm2gConfig));
     RFM2G_STATUS getConfigError = driver->getConfig(&rfm2gConfig);
     if (getConfigError == RFM2G_SUCCESS) {
         pPioCard = (char*)rfm2gConfig.PciConfig.rfm2gBase;
@@ -80,6 +86,7 @@ int DMA::init(RFMDriver *driver)
         return -1;
     }
 
+    m_size = static_cast<size_t>(numPagesDMA)*pageSize;
     Logger::Logger() << "doDMA: SUCCESS: mapped numPagesDMA=" << numPagesDMA
                        << " at pDmaCard=" << std::hex << m_memory;
 
@@ -96,5 +103,9 @@ int DMA::init(RFMDriver *driver)
     Logger::Logger() << "doDMA: Card: PIO memory pointer = 0x" << std::hex << pPioCard
                        << ", Size = 0x" << std::hex << rfm2gSize;
 
+    // Kept for the mapped accesses (see RFMWindow)
+    m_pioWindow = static_cast<volatile char*>(pPioCard);
+    m_pioSize = (pPioCard == NULL) ? 0 : rfm2gSize;
+
     return 0;
 }
@@ -18,12 +18,19 @@
 #ifndef DMA_H
 #define DMA_H
 
+#include <cstddef>
+
 #include "define.h"
 
 class RFMDriver;
 
 /**
  * @brief Represent the Direct Memory Access.
+ *
+ * The beginning of the DMA buffer is used by the DAC (and by the transfers
+ * done at initialization). The ADC has its own ADC_SLOT_NB slots, from
+ * DMA_ADC_OFFSET, so that the values of a cycle stay in place while the
+ * next cycle is read (see ADC::read()).
  */
 class DMA
 {
@@ -49,6 +56,34 @@ public:
      */
     volatile char* memory() { return m_memory; };
 
+    /**
+     * @brief Number of ADC slots.
+     */
+    static const int ADC_SLOT_NB = 2;
+
+    /**
+     * @brief ADC slot of the DMA buffer.
+     *
+     * @param slot Index of the slot (< ADC_SLOT_NB)
+     * @return Beginning of the slot, NULL if the buffer is too small (or
+     * not mapped)
+     */
+    volatile char* adcSlot(int slot) {
+        size_t end = DMA_ADC_OFFSET + (slot + 1)*DMA_ADC_SLOT_SIZE;
+        return (m_memory == NULL || end > m_size) ? NULL : m_memory + DMA_ADC_OFFSET + slot*DMA_ADC_SLOT_SIZE;
+    };
+
+    /**
+     * @brief PIO window of the card (the whole RFM), mapped by init().
+     * @return NULL if it could not be mapped
+     */
+    volatile char* pioWindow() { return m_pioWindow; };
+
+    /**
+     * @brief Size of the PIO window (bytes).
+     */
+    RFM2G_UINT32 pioSize() const { return m_pioSize; };
+
     /**
      * @brief Direct access to `m_status`.
      * @return m_status
@@ -63,6 +98,21 @@ private:
      */
     volatile char *m_memory;
 
+    /**
+     * @brief Size of the DMA buffer mapped by init().
+     */
+    size_t m_size;
+
+    /**
+     * @brief PIO window of the card.
+     */
+    volatile char *m_pioWindow;
+
+    /**
+     * @brief Size of the PIO window.
+     */
+    RFM2G_UINT32 m_pioSize;
+
     /**
      * @brief Status
      */
@@ -44,6 +44,10 @@ Error::Error::Error(const unsigned int type) {
         m_type = "FOFB error";
         m_message = "Bad RMS";
         break;
+    case Smat:
+        m_type = "FOFB error";
+        m_message = "No valid inverse of the S matrix";
+        break;
     case NoBeam:
         m_type = "Error";
         m_message = "No Current";
@@ -35,6 +35,7 @@ namespace Error {
         NoBeam      = 5, /**< @brief No beam (BPM input to low). */
         RMS         = 6, /**< @brief RMS error (Correction doesn't improve). */
         ADCReset    = 8, /**< @brief ADC was reset */
+        Smat        = 9, /**< @brief No valid inverse of the S matrix. */
         Unkonwn     = 7  /**< @brief Unknown Error. */
     };
 
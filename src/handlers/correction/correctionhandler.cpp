@@ -21,6 +21,8 @@
 #include "adc.h"
 #include "dac.h"
 #include "dma.h"
+#include "modules/latency.h"
+#include "modules/timers.h"
 #include "modules/zmq/logger.h"
 
 CorrectionHandler::CorrectionHandler(RFMDriver *driver, DMA *dma, bool weightedCorr)
@@ -43,19 +45,23 @@ int CorrectionHandler::typeCorrection()
 int CorrectionHandler::callProcessorRoutine(const CorrectionInput_t& input,
                                             arma::vec& CMx, arma::vec& CMy)
 {
+    uint64_t computeStart = TimingModule::now();
     int correctionError = m_correctionProcessor.process(input, CMx, CMy);
+    uint64_t dynamicStart = TimingModule::now();
+    Latency::record(Latency::Stage::Compute, dynamicStart - computeStart);
     if (correctionError) {
         return correctionError;
     }
 
     // If this has an error, we don't care: it's not deadly and we have no way
     // to  handle it.
-    m_dyn10HzCorrectionProcessor.process(input, CMx, CMy);
+    m_harmonicCorrectionProcessor.process(input, CMx, CMy);
+    Latency::record(Latency::Stage::DynamicCorrection, TimingModule::now() - dynamicStart);
 
     return 0;
 }
 
-void CorrectionHandler::setProcessor(arma::mat SmatX, arma::mat SmatY,
+int CorrectionHandler::setProcessor(arma::mat SmatX, arma::mat SmatY,
                                      double IvecX, double IvecY,
                                      double Frequency,
                                      double P, double I, double D,
@@ -63,12 +69,15 @@ void CorrectionHandler::setProcessor(arma::mat SmatX, arma::mat SmatY,
                                      bool weightedCorr)
 {
     m_correctionProcessor.initCMs(CMx, CMy);
-    m_correctionProcessor.initSmat(SmatX, SmatY, IvecX, IvecY, weightedCorr);
+    if (m_correctionProcessor.initSmat(SmatX, SmatY, IvecX, IvecY, weightedCorr)) {
+        return Error::Smat;
+    }
     m_correctionProcessor.initInjectionCnt(Frequency);
     m_correctionProcessor.initPID(P,I,D);
     m_correctionProcessor.finishInitialization();
 
-    m_dyn10HzCorrectionProcessor.initialize();
+    m_harmonicCorrectionProcessor.initialize(Frequency);
+    return 0;
 }
 
 
@@ -20,7 +20,7 @@
 
 #include "handlers/handler.h"
 #include "handlers/correction/correctionprocessor.h"
-#include "handlers/correction/dynamic10hzcorrectionprocessor.h"
+#include "handlers/correction/harmoniccorrectionprocessor.h"
 
 /**
  * @class CorrectionHandler
@@ -55,8 +55,10 @@ private:
     /**
      * @brief Set the processor: the S matrix, the PID values and other
      * parameters are initialized here.
+     *
+     * @return Error::Smat if the S matrices cannot be inverted, else 0.
      */
-    virtual void setProcessor(arma::mat SmatX, arma::mat SmatY,
+    virtual int setProcessor(arma::mat SmatX, arma::mat SmatY,
                               double IvecX, double IvecY,
                               double Frequency,
                               double P, double I, double D,
@@ -68,9 +70,9 @@ private:
      */
     CorrectionProcessor m_correctionProcessor;
     /**
-     * @brief Additional processor for the 10Hz harmonic perturbation
+     * @brief Additional processor for the harmonic perturbations
      */
-    Dynamic10HzCorrectionProcessor m_dyn10HzCorrectionProcessor;
+    HarmonicCorrectionProcessor m_harmonicCorrectionProcessor;
 
 };
 
@@ -26,38 +26,55 @@
 
 #include <iostream>
 #include <cmath>
+#include <limits>
 
-// -------- PID implementation --------- //
-PID::PID(const double P, const double I, const double D, const int sizeBuffer)
-    : m_P(P), m_I(I), m_D(D), m_currentP(0)
-    , m_lastCorrection(arma::zeros<arma::vec>(sizeBuffer))
-    , m_correctionSum(arma::zeros<arma::vec>(sizeBuffer))
+CorrectionProcessor::CorrectionProcessor()
+    : m_weightedCorr(false)
 {
+    m_SmatInv.x = nullptr;
+    m_SmatInv.y = nullptr;
+
+    this->listen("SMAT-X", [this]() { this->requestInversion(InverseWorker::X); });
+    this->listen("IVEC-X", [this]() { this->requestInversion(InverseWorker::X); });
+    this->listen("SMAT-Y", [this]() { this->requestInversion(InverseWorker::Y); });
+    this->listen("IVEC-Y", [this]() { this->requestInversion(InverseWorker::Y); });
+
+    this->listen("PID-P-X", [this]() { this->stagePID("PID-P-X", PIDBank::P, PIDBank::X); });
+    this->listen("PID-I-X", [this]() { this->stagePID("PID-I-X", PIDBank::I, PIDBank::X); });
+    this->listen("PID-D-X", [this]() { this->stagePID("PID-D-X", PIDBank::D, PIDBank::X); });
+    this->listen("PID-WINDUP-X", [this]() { this->stagePID("PID-WINDUP-X", PIDBank::Windup, PIDBank::X); });
+    this->listen("PID-P-Y", [this]() { this->stagePID("PID-P-Y", PIDBank::P, PIDBank::Y); });
+    this->listen("PID-I-Y", [this]() { this->stagePID("PID-I-Y", PIDBank::I, PIDBank::Y); });
+    this->listen("PID-D-Y", [this]() { this->stagePID("PID-D-Y", PIDBank::D, PIDBank::Y); });
+    this->listen("PID-WINDUP-Y", [this]() { this->stagePID("PID-WINDUP-Y", PIDBank::Windup, PIDBank::Y); });
+    this->listen("PID-RAMP", [this]() {
+        double ramp;
+        Messenger::get("PID-RAMP", ramp);
+        m_PID.stageRamp(ramp/100);
+    });
 }
 
-arma::vec PID::apply(const arma::vec& dCM)
+CorrectionProcessor::~CorrectionProcessor()
 {
-    if (m_currentP < m_P) {
-        m_currentP += 0.01;
+    // The listeners use this object
+    for (int listener : m_listeners) {
+        Messenger::removeListener(listener);
     }
-
-    m_correctionSum += dCM;
-    arma::vec pidCorrection = (dCM * m_currentP) + (m_I*m_correctionSum) + (m_D*(dCM - m_lastCorrection));
-    m_lastCorrection = dCM;
-
-    return pidCorrection;
+    m_inverseWorker.stop();
+    delete m_SmatInv.x;
+    delete m_SmatInv.y;
 }
 
-
-// -------- CorrectionProcessor implementation --------- //
-CorrectionProcessor::CorrectionProcessor()
+void CorrectionProcessor::listen(const std::string& key, const std::function<void()>& listener)
 {
+    m_listeners.push_back(Messenger::addListener(key, listener));
 }
 
 void CorrectionProcessor::initCMs(arma::vec CMx, arma::vec CMy)
 {
-    m_CM.x = CMx;
-    m_CM.y = CMy;
+    m_nbCM.x = CMx.n_elem;
+    m_nbCM.y = CMy.n_elem;
+    m_CM = arma::join_cols(CMx, CMy);
 }
 void CorrectionProcessor::finishInitialization()
 {
@@ -66,17 +83,73 @@ void CorrectionProcessor::finishInitialization()
     m_lastRMS.y = 999;
 }
 
-void CorrectionProcessor::initSmat(arma::mat &SmatX, arma::mat &SmatY, double IvecX, double IvecY, bool weightedCorr)
+int CorrectionProcessor::initSmat(arma::mat &SmatX, arma::mat &SmatY, double IvecX, double IvecY, bool weightedCorr)
+{
+    m_inverseWorker.cancel();
+    m_weightedCorr = weightedCorr;
+
+    delete m_SmatInv.x;
+    delete m_SmatInv.y;
+    m_SmatInv.x = new SmatInverse();
+    m_SmatInv.y = new SmatInverse();
+    if (m_SmatInv.x->compute(SmatX, IvecX, weightedCorr)
+            || m_SmatInv.y->compute(SmatY, IvecY, weightedCorr)) {
+        Logger::error(_ME_) << "Cannot inverse the S matrices";
+        return 1;
+    }
+    m_SmatInv.x->benchmark();
+    m_SmatInv.y->benchmark();
+
+    m_inverseWorker.start();
+    return 0;
+}
+
+void CorrectionProcessor::requestInversion(InverseWorker::Axis axis)
 {
-    m_useCMWeight = weightedCorr;
-    this->calcSmat(SmatX, IvecX, m_CMWeight.x, m_SmatInv.x);
-    this->calcSmat(SmatY, IvecY, m_CMWeight.y, m_SmatInv.y);
+    const std::string name = (axis == InverseWorker::X) ? "X" : "Y";
+    int nbBPM, nbCM;
+    double Ivec;
+    Messenger::get("NB-BPM-" + name, nbBPM);
+    Messenger::get("NB-CM-" + name, nbCM);
+    Messenger::get("IVEC-" + name, Ivec);
+
+    // The size cannot change without restarting the correction
+    arma::mat Smat;
+    Messenger::messenger.get("SMAT-" + name, Smat, nbBPM, nbCM);
+    if (Smat.empty()) {
+        Logger::error(_ME_) << "SMAT-" << name << " must be a " << nbBPM << 'x' << nbCM << " matrix";
+        return;
+    }
+    m_inverseWorker.request(axis, Smat, Ivec, m_weightedCorr);
 }
 
 void CorrectionProcessor::initPID(double P, double I, double D)
 {
-    m_PID.x = PID(P, I, D, m_CM.x.n_elem);
-    m_PID.y = PID(P, I, D, m_CM.y.n_elem);
+    m_PID.init(m_nbCM.x, m_nbCM.y, P, I, D);
+    m_dCM.zeros(m_nbCM.x + m_nbCM.y);
+
+    // Same unit as the P, I, D keys (%)
+    Messenger::updateMap("PID-P-X", arma::vec(m_nbCM.x).fill(P*100));
+    Messenger::updateMap("PID-I-X", arma::vec(m_nbCM.x).fill(I*100));
+    Messenger::updateMap("PID-D-X", arma::vec(m_nbCM.x).fill(D*100));
+    Messenger::updateMap("PID-WINDUP-X", arma::vec(m_nbCM.x).fill(std::numeric_limits<double>::infinity()));
+    Messenger::updateMap("PID-P-Y", arma::vec(m_nbCM.y).fill(P*100));
+    Messenger::updateMap("PID-I-Y", arma::vec(m_nbCM.y).fill(I*100));
+    Messenger::updateMap("PID-D-Y", arma::vec(m_nbCM.y).fill(D*100));
+    Messenger::updateMap("PID-WINDUP-Y", arma::vec(m_nbCM.y).fill(std::numeric_limits<double>::infinity()));
+    Messenger::updateMap("PID-RAMP", static_cast<double>(1));
+}
+
+void CorrectionProcessor::stagePID(const std::string& key, PIDBank::Parameter parameter, PIDBank::Axis axis)
+{
+    arma::vec values;
+    Messenger::get(key, values);
+    if (parameter != PIDBank::Windup) {
+        values /= 100;
+    }
+    if (m_PID.stage(parameter, axis, values)) {
+        Logger::error(_ME_) << key << " not applied";
+    }
 }
 
 void CorrectionProcessor::initInjectionCnt(double frequency)
@@ -91,6 +164,17 @@ void CorrectionProcessor::initInjectionCnt(double frequency)
 int CorrectionProcessor::process(const CorrectionInput_t& input,
                                  arma::vec &Data_CMx, arma::vec &Data_CMy)
 {
+    // Cycle boundary: use the inverses computed in the background, if any
+    m_inverseWorker.adopt(InverseWorker::X, m_SmatInv.x);
+    m_inverseWorker.adopt(InverseWorker::Y, m_SmatInv.y);
+    m_PID.commit();
+
+    // Views on the contiguous x+y arrays
+    arma::vec CMx(m_CM.memptr(), m_nbCM.x, false, true);
+    arma::vec CMy(m_CM.memptr() + m_nbCM.x, m_nbCM.y, false, true);
+    arma::vec dCMx(m_dCM.memptr(), m_nbCM.x, false, true);
+    arma::vec dCMy(m_dCM.memptr() + m_nbCM.x, m_nbCM.y, false, true);
+
     if (sum(input.diff.x) < -10.5) {
 #ifndef DUMMY_RFM_DRIVER
         Logger::error(_ME_) << " ERROR: No Beam";
@@ -102,8 +186,8 @@ int CorrectionProcessor::process(const CorrectionInput_t& input,
 
     if (this->isInjectionTime(input.newInjection)) {
         // We want to write the old value if it is not changed
-        Data_CMx = m_CM.x;
-        Data_CMy = m_CM.y;
+        Data_CMx = CMx;
+        Data_CMy = CMy;
         return 0;
     }
 
@@ -113,11 +197,10 @@ int CorrectionProcessor::process(const CorrectionInput_t& input,
     }
 
     //cout << "  calc dCOR" << endl;
-    arma::vec dCMx = m_SmatInv.x * input.diff.x;
-    arma::vec dCMy = m_SmatInv.y * input.diff.y;
-    if (m_useCMWeight) {
-        dCMx = dCMx % m_CMWeight.x;
-        dCMy = dCMy % m_CMWeight.y;
+    // Written into the workspace: same size at each cycle, so no allocation
+    if (m_SmatInv.x->apply(input.diff.x, dCMx) || m_SmatInv.y->apply(input.diff.y, dCMy)) {
+        Logger::error(_ME_) << "No valid inverse of the S matrix";
+        return Error::Smat;
     }
 
     if ((arma::max(arma::abs(dCMx)) > 0.100) || (arma::max(arma::abs(dCMy)) > 0.100)) {
@@ -130,16 +213,16 @@ int CorrectionProcessor::process(const CorrectionInput_t& input,
 #endif
     }
 
-    if ((input.typeCorr & Correction::Horizontal) == Correction::Horizontal) {
-        m_CM.x -= m_PID.x.apply(dCMx);
-    }
+    // x channels come first: the corrected plane(s) are one range
+    bool horizontal = ((input.typeCorr & Correction::Horizontal) == Correction::Horizontal);
+    bool vertical = ((input.typeCorr & Correction::Vertical) == Correction::Vertical);
+    int begin = horizontal ? m_PID.begin(PIDBank::X) : m_PID.begin(PIDBank::Y);
+    int end = vertical ? m_PID.end(PIDBank::Y) : m_PID.end(PIDBank::X);
+    m_PID.apply(m_dCM.memptr(), m_CM.memptr(), begin, end);
 
-    if ((input.typeCorr & Correction::Vertical) == Correction::Vertical) {
-        m_CM.y -= m_PID.y.apply(dCMy);
-    }
     // We want to write the old value if it is not changed
-    Data_CMx = m_CM.x;
-    Data_CMy = m_CM.y;
+    Data_CMx = CMx;
+    Data_CMy = CMy;
 
     return 0;
 }
@@ -166,48 +249,6 @@ int CorrectionProcessor::checkRMS(const arma::vec& diffX, const arma::vec& diffY
     return 0;
 }
 
-void CorrectionProcessor::calcSmat(const arma::mat &Smat,
-                                   double Ivec,
-                                   arma::vec &CMWeight,
-                                   arma::mat &SmatInv)
-{
-    Logger::Logger() << "Calculate Smat";
-    arma::mat U, S, V;
-    arma::vec s;
-
-    Logger::Logger() << "\tGiven : " << " Smat cols: " << Smat.n_cols << " smat rows " << Smat.n_rows << "  Ivec : " << Ivec;
-    arma::mat Smat_w = arma::zeros(Smat.n_rows, Smat.n_cols);
-    Logger::Logger() << "\tmake Ivec";
-    if (Ivec > Smat.n_rows) {
-        Logger::Logger() << "\tIVec > Smat.n_rows: Setting Ivec = Smat.n_rows";
-        double Ivec = Smat.n_rows;
-    }
-    if (m_useCMWeight) {
-        Logger::Logger() << "\tcalc CMWeights";
-        CMWeight = 1/(arma::trans(arma::stddev(Smat)));
-        Logger::Logger() << "\tInclude CMWeightX in SMat";
-        for (int i = 0; i < Smat.n_cols; i++) {
-            Smat_w.col(i) = Smat.col(i) * CMWeight(i);
-        }
-    } else {
-        Smat_w = Smat;
-    }
-    Logger::Logger() << "\tcalc SVD";
-    arma::svd(U,s,V,Smat_w);
-    Logger::Logger() << "\treduce U to Ivec";
-    U = U.cols(0,Ivec-1);
-    Logger::Logger() << "\tTranspose U";
-    U = trans(U);
-    Logger::Logger() << "\tGet Diag Matrix of  S";
-    S = diagmat(s.subvec(0,Ivec-1));
-    Logger::Logger() << "\treduce V to Ivec";
-    V = V.cols(0,Ivec-1);
-    Logger::Logger() << "\tCalc new Matrix";
-    SmatInv = V * arma::inv(S) * U;
-
-    Logger::Logger() << "SVD complete ...";
-}
-
 bool CorrectionProcessor::isInjectionTime(const bool newInjection)
 {
     if ( newInjection ) {
@@ -19,48 +19,21 @@
 #define CORRECTIONPROCESSOR_H
 
 #include "handlers/structures.h"
+#include "handlers/correction/inverseworker.h"
+#include "handlers/correction/pidbank.h"
+#include "handlers/correction/smatinverse.h"
 
 #include <armadillo>
 
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
 class ADC;
 class RFM;
 
 
-/**
- * @brief Class containing every values to process a PID
- */
-class PID {
-public:
-    /**
-     * @brief Empty constructor
-     */
-    explicit PID() { PID(0., 0., 0., 0); }
-
-    /**
-     * @brief Real constructor
-     * @param P Gain
-     * @param I Integrator coefficient
-     * @param D Derivator coefficient
-     * @param bufferSize Size of the buffers (= size of input/output vectors)
-     */
-    PID(const double P, const double I, const double D, const int bufferSize);
-
-    /**
-     * @brief Apply the PID to a data vector
-     * @param dCM Data on which the PID should be applied
-     * @return Computed vector
-     */
-    arma::vec apply(const arma::vec& dCM);
-
-private:
-    double m_P; /**< Gain */
-    double m_I; /**< Coefficient of the integrator */
-    double m_D; /**< Coefficient of the derivator */
-    double m_currentP; /**< Current gain (to modify the P without losing it) */
-    arma::vec m_correctionSum; /**< Sum of the previous corrections */
-    arma::vec m_lastCorrection; /**< Last correction */
-};
-
 /**
  * @brief Structure containing values concerning the injection
  */
@@ -82,9 +55,19 @@ class CorrectionProcessor
 public:
     /**
      * @brief Constructor
+     *
+     * Setting SMAT-X/Y or IVEC-X/Y through the Messenger triggers a new
+     * inversion in the background (see InverseWorker). Setting PID-P/I/D-X/Y
+     * (%), PID-WINDUP-X/Y or PID-RAMP (% per cycle) changes the PID of each
+     * corrector from the next cycle (see PIDBank).
      */
     explicit CorrectionProcessor();
 
+    /**
+     * @brief Destructor
+     */
+    ~CorrectionProcessor();
+
     /**
      * @brief Calculate the correction to apply.
      *
@@ -96,7 +79,7 @@ public:
                 arma::vec& Data_CMx, arma::vec& Data_CMy);
 
     /**
-     * @brief Set the PID parameters.
+     * @brief Set the PID parameters (same gains for all correctors).
      */
     void initPID(double P, double I, double D);
 
@@ -119,25 +102,44 @@ public:
     void finishInitialization();
 
     /**
-     * @brief Function that call calcSmat() for both x and y axes.
+     * @brief Calculate the inverse of the S matrices of both axes and choose
+     * how to apply each of them (see SmatInverse::benchmark()).
+     *
+     * This is done on the calling thread. Background inversions still pending
+     * are dropped.
      *
      * @param SmatX, SmatY Matrices to inverse (both axes)
-     * @param IvecX, IvecY ????
+     * @param IvecX, IvecY Number of singular values to keep
      * @param weightedCorr True if the correction should be weighted or not.
+     * @return Error code: 1 if an inverse cannot be computed, else 0.
      */
-    void initSmat(arma::mat &SmatX, arma::mat &SmatY, double IvecX, double IvecY, bool weightedCorr);
+    int initSmat(arma::mat &SmatX, arma::mat &SmatY, double IvecX, double IvecY, bool weightedCorr);
 
 private:
+    /**
+     * @brief Read the matrix and Ivec of an axis in the Messenger and ask the
+     * worker for a new inverse.
+     *
+     * @param axis Axis to inverse
+     */
+    void requestInversion(InverseWorker::Axis axis);
+
+    /**
+     * @brief Add a Messenger listener, removed by the destructor.
+     *
+     * @param key Key to listen to
+     * @param listener Function to call when the key is set
+     */
+    void listen(const std::string& key, const std::function<void()>& listener);
 
     /**
-     * @brief Calculate the inverse of the S matrix.
+     * @brief Read per-corrector PID values in the Messenger and stage them.
      *
-     * @param[in] Smat Matrix to inverse
-     * @param[in] Ivec ????
-     * @param[out] CMWeight Vector of weight to apply for each corrector
-     * @param[out] SmatInv Inversed matrix
+     * @param key Messenger key
+     * @param parameter Parameter to change
+     * @param axis Axis to change
      */
-    void calcSmat(const arma::mat &Smat, double Ivec, arma::vec &CMWeight, arma::mat &SmatInv);
+    void stagePID(const std::string& key, PIDBank::Parameter parameter, PIDBank::Axis axis);
 
     bool isInjectionTime(const bool newInjection);
     int checkRMS(const arma::vec& diffX, const arma::vec& diffY);
@@ -146,11 +148,14 @@ private:
     int m_rmsErrorCnt; /**< @brief Number of RMS error counted */
     Pair_t<double> m_lastRMS;  /**< @brief Last of RMS */
 
-    bool m_useCMWeight; /**< @brief Should we use weights in the corrections? */
-    Pair_t<arma::vec> m_CMWeight; /**< @brief  Weights */
-    Pair_t<arma::mat> m_SmatInv; /**< @brief Inverse of the Smatrix */
-    Pair_t<PID> m_PID; /**< @brief PID classes */
-    Pair_t<arma::vec> m_CM; /** < @brief Current corrector values */
+    std::atomic<bool> m_weightedCorr; /**< @brief Should the correctors be weighted? Read by the listeners */
+    std::vector<int> m_listeners; /**< @brief Messenger listeners, see listen() */
+    Pair_t<SmatInverse*> m_SmatInv; /**< @brief Inverse of the Smatrix (weights included) */
+    InverseWorker m_inverseWorker; /**< @brief Computes new inverses in the background */
+    PIDBank m_PID; /**< @brief PID of every corrector */
+    Pair_t<int> m_nbCM; /**< @brief Number of correctors */
+    arma::vec m_CM; /**< @brief Current corrector values (x then y) */
+    arma::vec m_dCM; /**< @brief Workspace for the corrector deltas (x then y) */
 };
 
 #endif // CORRECTIONPROCESSOR_H
@@ -0,0 +1,291 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "handlers/correction/harmoniccorrectionprocessor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+#include "define.h"
+#include "modules/zmq/logger.h"
+#include "modules/zmq/messenger.h"
+
+/**
+ * @brief Maximum correction (sum of all harmonics) on one corrector.
+ */
+const double MAX_CORRECTION = 0.1;
+
+HarmonicCorrectionProcessor::HarmonicCorrectionProcessor()
+    : m_frequency(0)
+    , m_taps(0)
+    , m_historyPos(0)
+    , m_started(false)
+    , m_unresolved(false)
+{
+    m_axes.x.name = "X";
+    m_axes.x.active = false;
+    m_axes.y.name = "Y";
+    m_axes.y.active = false;
+
+    arma::vec harmonics = { 10 };
+    Messenger::addEditableKey("HARMONICS", harmonics);
+    Messenger::addEditableKey("REF-CHANNEL-" + keySuffix(10), TEN_HZ);
+    addKeys(keySuffix(10));
+
+    m_harmonicsListener = Messenger::addListener("HARMONICS", []() {
+        arma::vec harmonics;
+        Messenger::get("HARMONICS", harmonics);
+        for (int h = 0 ; h < harmonics.n_elem ; h++) {
+            addKeys(keySuffix(harmonics(h)));
+        }
+    });
+}
+
+HarmonicCorrectionProcessor::~HarmonicCorrectionProcessor()
+{
+    Messenger::removeListener(m_harmonicsListener);
+}
+
+void HarmonicCorrectionProcessor::addKeys(const std::string& suffix)
+{
+    // The channel is created last: once it exists, all the keys exist
+    Messenger::addEditableKey("AMPLITUDE-REF-" + suffix, static_cast<double>(1));
+    Messenger::addEditableKey("PHASE-REF-" + suffix, static_cast<double>(0));
+    for (const char* key : { "AMPLITUDES-X-", "PHASES-X-", "AMPLITUDES-Y-", "PHASES-Y-" }) {
+        Messenger::addEditableKey(key + suffix, arma::vec());
+    }
+    Messenger::addEditableKey("REF-CHANNEL-" + suffix, -1);
+}
+
+std::string HarmonicCorrectionProcessor::keySuffix(double freq)
+{
+    std::ostringstream suffix;
+    suffix << freq;
+    return suffix.str();
+}
+
+void HarmonicCorrectionProcessor::initialize(double frequency)
+{
+    m_frequency = frequency;
+    m_started = false;
+    m_channels.clear();
+    m_taps = 0;
+    m_history.reset();
+    m_historyPos = 0;
+    m_axes.x.active = false;
+    m_axes.y.active = false;
+
+    // Handles that were never read: everything is rebuilt at the first cycle
+    m_harmonicsParam = Messenger::parameter<arma::vec>("HARMONICS");
+    m_harmonics.clear();
+    m_unresolved = false;
+}
+
+int HarmonicCorrectionProcessor::process(const CorrectionInput_t& input,
+                                         arma::vec& Data_CMx, arma::vec& Data_CMy)
+{
+    bool changed = false;
+    if (m_harmonicsParam.changed() || m_unresolved) {
+        this->resolve();
+        changed = true;
+    }
+    for (const Harmonic_t& harmonic : m_harmonics) {
+        changed |= this->changed(harmonic);
+    }
+    if (changed) {
+        this->rebuild(Data_CMx.n_elem, Data_CMy.n_elem);
+    }
+
+    if (m_channels.empty()) {
+        return 0;
+    }
+    this->updateHistory(input.adcBuffer);
+
+    int errorX = this->processAxis(m_axes.x, Data_CMx);
+    int errorY = this->processAxis(m_axes.y, Data_CMy);
+
+    return (errorX | errorY);
+}
+
+void HarmonicCorrectionProcessor::updateHistory(const RFM2G_INT16* adcBuffer)
+{
+    // Written twice, so that the last m_taps columns never wrap around
+    for (int c = 0 ; c < m_channels.size() ; c++) {
+        double value = adcBuffer[m_channels[c]];
+        m_history(c, m_historyPos) = value;
+        m_history(c, m_historyPos + m_taps) = value;
+    }
+    m_historyPos = (m_historyPos + 1) % m_taps;
+}
+
+void HarmonicCorrectionProcessor::resolve()
+{
+    const arma::vec& harmonics = m_harmonicsParam.get();
+
+    m_harmonics.clear();
+    m_unresolved = false;
+    for (int h = 0 ; h < harmonics.n_elem ; h++) {
+        Harmonic_t harmonic;
+        harmonic.freq = harmonics(h);
+        harmonic.suffix = keySuffix(harmonic.freq);
+        if ((harmonic.freq <= 0) || (2*harmonic.freq >= m_frequency)) {
+            Logger::error(_ME_) << "Harmonic " << harmonic.suffix << "Hz ignored: not in ]0, "
+                                << m_frequency/2 << "[Hz";
+            continue;
+        }
+        harmonic.taps = std::lround(m_frequency/harmonic.freq);
+
+        // Created by the HARMONICS listener, maybe not yet
+        const std::string& suffix = harmonic.suffix;
+        harmonic.channel = Messenger::parameter<int>("REF-CHANNEL-" + suffix);
+        if (!harmonic.channel.valid()) {
+            m_unresolved = true;
+            continue;
+        }
+        harmonic.ampRef = Messenger::parameter<double>("AMPLITUDE-REF-" + suffix);
+        harmonic.phaseRef = Messenger::parameter<double>("PHASE-REF-" + suffix);
+        harmonic.amplitudes.x = Messenger::parameter<arma::vec>("AMPLITUDES-X-" + suffix);
+        harmonic.amplitudes.y = Messenger::parameter<arma::vec>("AMPLITUDES-Y-" + suffix);
+        harmonic.phases.x = Messenger::parameter<arma::vec>("PHASES-X-" + suffix);
+        harmonic.phases.y = Messenger::parameter<arma::vec>("PHASES-Y-" + suffix);
+        m_harmonics.push_back(harmonic);
+    }
+}
+
+bool HarmonicCorrectionProcessor::changed(const Harmonic_t& harmonic)
+{
+    return harmonic.channel.changed() || harmonic.ampRef.changed() || harmonic.phaseRef.changed()
+            || harmonic.amplitudes.x.changed() || harmonic.amplitudes.y.changed()
+            || harmonic.phases.x.changed() || harmonic.phases.y.changed();
+}
+
+void HarmonicCorrectionProcessor::rebuild(int sizeX, int sizeY)
+{
+    // First pass: layout of the history
+    std::vector<int> channels;
+    std::vector<int> rows(m_harmonics.size(), -1);
+    int taps = 0;
+    for (int h = 0 ; h < m_harmonics.size() ; h++) {
+        Harmonic_t& harmonic = m_harmonics[h];
+        int channel = harmonic.channel.get();
+        if (channel < 0) {
+            continue; // Not configured yet: it's not an error.
+        }
+        if (channel >= ADC_BUFFER_SIZE) {
+            Logger::error(_ME_) << "Harmonic " << harmonic.suffix << "Hz ignored: invalid reference channel "
+                                << channel;
+            continue;
+        }
+        auto it = std::find(channels.begin(), channels.end(), channel);
+        rows[h] = it - channels.begin();
+        if (it == channels.end()) {
+            channels.push_back(channel);
+        }
+        taps = std::max(taps, harmonic.taps);
+    }
+
+    // The history is only lost if its layout changes
+    if ((channels != m_channels) || (taps != m_taps)) {
+        m_channels = channels;
+        m_taps = taps;
+        m_history.zeros(m_channels.size(), 2*m_taps);
+        m_historyPos = 0;
+    }
+
+    // Second pass: coefficients
+    m_axes.x.coefficients.zeros(sizeX, m_channels.size()*m_taps);
+    m_axes.x.correction.zeros(sizeX);
+    m_axes.x.active = false;
+    m_axes.y.coefficients.zeros(sizeY, m_channels.size()*m_taps);
+    m_axes.y.correction.zeros(sizeY);
+    m_axes.y.active = false;
+    for (int h = 0 ; h < m_harmonics.size() ; h++) {
+        Harmonic_t& harmonic = m_harmonics[h];
+        // Read all the handles, so that they are not seen as changed anymore
+        const arma::vec& ampX = harmonic.amplitudes.x.get();
+        const arma::vec& phaseX = harmonic.phases.x.get();
+        const arma::vec& ampY = harmonic.amplitudes.y.get();
+        const arma::vec& phaseY = harmonic.phases.y.get();
+        harmonic.ampRef.get();
+        harmonic.phaseRef.get();
+        if (rows[h] < 0) {
+            continue;
+        }
+        this->addHarmonic(m_axes.x, harmonic, ampX, phaseX, rows[h]);
+        this->addHarmonic(m_axes.y, harmonic, ampY, phaseY, rows[h]);
+    }
+
+    if (!m_started && (m_axes.x.active || m_axes.y.active)) {
+        m_started = true;
+        Logger::Logger() << "Harmonic correction started.";
+    }
+}
+
+void HarmonicCorrectionProcessor::addHarmonic(Axis_t& axis, Harmonic_t& harmonic,
+                                              const arma::vec& amp, const arma::vec& phase,
+                                              int channel)
+{
+    double ampref = harmonic.ampRef.get();
+    double phref = harmonic.phaseRef.get();
+    int vectorSize = axis.correction.n_elem;
+
+    // Dynamic correction values are set.
+    if (amp.empty() || phase.empty()) {
+        return;  // It's not an error.
+    }
+
+    // Size is ok
+    if ((amp.n_elem != vectorSize) || (phase.n_elem != vectorSize)) {
+        Logger::error(_ME_) << "Harmonic correction " << harmonic.suffix << "Hz: size not correct.";
+        return;
+    }
+
+    // The history holds the channels of one cycle in a column, oldest cycle
+    // first: tap k (0 = last value) is in the column m_taps-1-k.
+    int ntaps = harmonic.taps;
+    int nchannels = m_channels.size();
+    for (int k = 0 ; k < ntaps ; k++) {
+        double t = k/m_frequency;
+        int column = (m_taps-1-k)*nchannels + channel;
+        for (int i = 0 ; i < vectorSize ; i++) {
+            // - or + the phase ???
+            axis.coefficients(i, column) += std::cos(2*M_PI*harmonic.freq*t - (phase(i) - phref))
+                                            * 2/ntaps * amp(i)/ampref;
+        }
+    }
+    axis.active = true;
+}
+
+int HarmonicCorrectionProcessor::processAxis(Axis_t& axis, arma::vec& outputData)
+{
+    if (!axis.active) {
+        return 0;
+    }
+
+    const arma::vec lastValues(m_history.colptr(m_historyPos), m_channels.size()*m_taps, false, true);
+    axis.correction = axis.coefficients * lastValues;
+
+    // Check amplitude before applying
+    if ((arma::max(arma::abs(axis.correction)) > MAX_CORRECTION)) {
+        Logger::error(_ME_) << "Harmonic amplitude to high, don't use";
+        return 1;
+    }
+    outputData += axis.correction;
+
+    return 0;
+}
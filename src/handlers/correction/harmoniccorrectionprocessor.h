@@ -0,0 +1,199 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HARMONICCORRECTIONPROCESSOR_H
+#define HARMONICCORRECTIONPROCESSOR_H
+
+#include <armadillo>
+
+#include <string>
+#include <vector>
+
+#include "handlers/structures.h"
+#include "modules/zmq/parameter.h"
+
+/**
+ * @brief Feed-forward correction of harmonic perturbations (10Hz magnet,
+ * mains, booster...).
+ *
+ * Each harmonic \f$f\f$ is measured on its own ADC channel (the reference)
+ * and corrected with a FIR filter covering one period
+ *      \f[
+ *          h_i = \frac{2}{N} \frac{A_i}{A_{ref}} \cos(2 \pi f t - (\phi_i - \phi_{ref}))
+ *      \f]
+ * where \f$t\f$ are the \f$N = F_s/f\f$ last sampling times at the loop
+ * frequency \f$F_s\f$. For 10Hz at 150Hz, this gives 15 taps.
+ *
+ * The parameters are set through the Messenger:
+ *  - `HARMONICS`: frequencies to correct (vector, Hz), 10Hz by default
+ *  - `REF-CHANNEL-<f>`: ADC channel of the reference (int, 62 for 10Hz)
+ *  - `AMPLITUDE-REF-<f>`, `PHASE-REF-<f>`: amplitude and phase of the reference
+ *  - `AMPLITUDES-<AX>-<f>`, `PHASES-<AX>-<f>`: one value per corrector
+ *
+ * The keys of 10Hz are created by the constructor, the keys of another
+ * harmonic when it is added to `HARMONICS` (on the serving thread, see
+ * addKeys()). They can therefore be set while the loop is idle.
+ *
+ * The keys are resolved into Parameter handles when `HARMONICS` changes. All
+ * harmonics share one history of the reference channels and their FIRs are
+ * summed into one coefficient matrix per axis, only rebuilt when the version
+ * of a key changed: each cycle costs one matrix-vector product per axis.
+ */
+class HarmonicCorrectionProcessor
+{
+public:
+    /**
+     * @brief Constructor. Register the Messenger keys.
+     */
+    HarmonicCorrectionProcessor();
+
+    /**
+     * @brief Destructor. Remove the `HARMONICS` listener.
+     */
+    ~HarmonicCorrectionProcessor();
+
+    /**
+     * @brief Initialize attributes.
+     *
+     * @param frequency Frequency of the correction loop (Hz)
+     */
+    void initialize(double frequency);
+
+    /**
+     * @brief Do the full correction.
+     *
+     * This calls processAxis() for each axis ('x' and 'y').
+     *
+     * @param input Input values to correct
+     * @param Data_CMx Correction output (horizontal axis)
+     * @param Data_CMy Correction output (vertical axis)
+     *
+     * @return 1 if an error occurs, 0 else
+     */
+    int process(const CorrectionInput_t& input,
+                arma::vec& Data_CMx, arma::vec& Data_CMy);
+
+private:
+    /**
+     * @brief Correction of one axis.
+     */
+    struct Axis_t {
+        std::string name; /**< @brief Name of the axis in the keys ('X' or 'Y') */
+        bool active; /**< @brief Is at least one harmonic set for this axis? */
+        arma::mat coefficients; /**< @brief n_CM x (m_taps * nb of channels), see m_history */
+        arma::vec correction; /**< @brief Workspace for the correction */
+    };
+
+    /**
+     * @brief Parameters of one harmonic.
+     */
+    struct Harmonic_t {
+        std::string suffix; /**< @brief Suffix of its keys */
+        double freq; /**< @brief Frequency (Hz) */
+        int taps; /**< @brief Number of taps of its FIR (one period) */
+        Messenger::Parameter<int> channel; /**< @brief REF-CHANNEL-<f> */
+        Messenger::Parameter<double> ampRef; /**< @brief AMPLITUDE-REF-<f> */
+        Messenger::Parameter<double> phaseRef; /**< @brief PHASE-REF-<f> */
+        Pair_t<Messenger::Parameter<arma::vec> > amplitudes; /**< @brief AMPLITUDES-<AX>-<f> */
+        Pair_t<Messenger::Parameter<arma::vec> > phases; /**< @brief PHASES-<AX>-<f> */
+    };
+
+    /**
+     * @brief Store the reference values of this cycle in the history.
+     */
+    void updateHistory(const RFM2G_INT16* adcBuffer);
+
+    /**
+     * @brief Create the keys of a harmonic, if they do not exist yet.
+     *
+     * Not called by the loop: creating a key takes the locks of the map.
+     *
+     * @param suffix Suffix of its keys, see keySuffix()
+     */
+    static void addKeys(const std::string& suffix);
+
+    /**
+     * @brief Resolve the handles of the harmonics listed in `HARMONICS`.
+     *
+     * A harmonic whose keys are not created yet is skipped, and m_unresolved
+     * is set so that it is tried again at the next cycle.
+     */
+    void resolve();
+
+    /**
+     * @brief Was one of the keys of a harmonic set since the last rebuild?
+     */
+    static bool changed(const Harmonic_t& harmonic);
+
+    /**
+     * @brief Rebuild the history layout and the coefficients from the
+     * Messenger values.
+     *
+     * @param sizeX Number of correctors on the x axis
+     * @param sizeY Number of correctors on the y axis
+     */
+    void rebuild(int sizeX, int sizeY);
+
+    /**
+     * @brief Add the FIR of one harmonic to the coefficients of an axis.
+     *
+     * @param axis Axis to complete
+     * @param harmonic Harmonic to add
+     * @param amp Amplitudes of the harmonic on this axis
+     * @param phase Phases of the harmonic on this axis
+     * @param channel Row of the reference in the history
+     */
+    void addHarmonic(Axis_t& axis, Harmonic_t& harmonic,
+                     const arma::vec& amp, const arma::vec& phase, int channel);
+
+    /**
+     * @brief Actually do the correction on a given axis.
+     *
+     * @param axis Axis to correct
+     * @param outputData Corresponding data to process. The result is added to
+     *                   the input value.
+     * @return 1 if an error occured, 0 else.
+     */
+    int processAxis(Axis_t& axis, arma::vec& outputData);
+
+    /**
+     * @brief Suffix of the keys of a harmonic (e.g. "10", "12.5").
+     */
+    static std::string keySuffix(double freq);
+
+    double m_frequency; /**< @brief Frequency of the loop */
+    Messenger::Parameter<arma::vec> m_harmonicsParam; /**< @brief HARMONICS */
+    std::vector<Harmonic_t> m_harmonics; /**< @brief Harmonics listed in HARMONICS */
+    bool m_unresolved; /**< @brief Are the keys of a listed harmonic still missing? */
+    int m_harmonicsListener; /**< @brief Listener creating the keys of new harmonics */
+
+    std::vector<int> m_channels; /**< @brief ADC channels of the references */
+    int m_taps; /**< @brief Number of values kept per reference (longest FIR) */
+
+    /**
+     * @brief Last values of the references, one column per cycle, written
+     * twice (at i and i+m_taps): the m_taps columns starting at m_historyPos
+     * are contiguous, oldest first.
+     */
+    arma::mat m_history;
+    int m_historyPos; /**< @brief Where the next column is written */
+
+    Pair_t<Axis_t> m_axes; /**< @brief Correction of each axis */
+    bool m_started;  /**< @brief Flag to know whether the correction has started or not */
+};
+
+#endif // HARMONICCORRECTIONPROCESSOR_H
@@ -0,0 +1,159 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "handlers/correction/inverseworker.h"
+
+#include "handlers/correction/smatinverse.h"
+#include "modules/realtime.h"
+#include "modules/zmq/logger.h"
+
+#include <chrono>
+
+InverseWorker::InverseWorker()
+    : m_generation(0)
+    , m_running(false)
+{
+    for (int axis = X ; axis <= Y ; axis++) {
+        m_jobs[axis].pending = false;
+        m_ready[axis] = nullptr;
+        m_retired[axis] = nullptr;
+    }
+}
+
+InverseWorker::~InverseWorker()
+{
+    this->stop();
+    for (int axis = X ; axis <= Y ; axis++) {
+        delete m_ready[axis].exchange(nullptr);
+        delete m_retired[axis].exchange(nullptr);
+    }
+}
+
+void InverseWorker::start()
+{
+    if (m_running) {
+        return;
+    }
+    m_running = true;
+    m_thread = std::thread(&InverseWorker::workLoop, this);
+    RealTime::moveToHousekeeping(m_thread, "Re-inversion");
+}
+
+void InverseWorker::stop()
+{
+    if (!m_running) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+        m_cond.notify_all();
+    }
+    m_thread.join();
+    this->reclaim();
+}
+
+void InverseWorker::request(Axis axis, const arma::mat& Smat, int Ivec, bool weighted)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_jobs[axis].pending = true;
+    m_jobs[axis].Smat = Smat;
+    m_jobs[axis].Ivec = Ivec;
+    m_jobs[axis].weighted = weighted;
+    m_cond.notify_all();
+}
+
+void InverseWorker::cancel()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_generation++;
+    for (int axis = X ; axis <= Y ; axis++) {
+        m_jobs[axis].pending = false;
+        delete m_ready[axis].exchange(nullptr, std::memory_order_acq_rel);
+    }
+}
+
+bool InverseWorker::adopt(Axis axis, SmatInverse*& current)
+{
+    // The previous one must be deleted first, so that retired holds only one
+    if (m_retired[axis].load(std::memory_order_acquire) != nullptr) {
+        return false;
+    }
+    SmatInverse* next = m_ready[axis].exchange(nullptr, std::memory_order_acq_rel);
+    if (next == nullptr) {
+        return false;
+    }
+    m_retired[axis].store(current, std::memory_order_release);
+    current = next;
+    return true;
+}
+
+void InverseWorker::reclaim()
+{
+    for (int axis = X ; axis <= Y ; axis++) {
+        delete m_retired[axis].exchange(nullptr, std::memory_order_acq_rel);
+    }
+}
+
+void InverseWorker::workLoop()
+{
+    while (m_running) {
+        Job_t job;
+        int axis = -1;
+        unsigned long generation;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            // Wake up regularly to delete what the correction thread retired
+            m_cond.wait_for(lock, std::chrono::milliseconds(10), [&]{
+                return !m_running || m_jobs[X].pending || m_jobs[Y].pending;
+            });
+            for (int a = X ; a <= Y ; a++) {
+                if (m_jobs[a].pending) {
+                    job = m_jobs[a];
+                    m_jobs[a].pending = false;
+                    axis = a;
+                    break;
+                }
+            }
+            generation = m_generation;
+        }
+        this->reclaim();
+        if (axis < 0) {
+            continue;
+        }
+
+        const char axisName = (axis == X) ? 'X' : 'Y';
+        Logger::Logger() << "Compute a new SmatInv for axis " << axisName << " in the background";
+        SmatInverse* inverse = new SmatInverse();
+        if (inverse->compute(job.Smat, job.Ivec, job.weighted)) {
+            Logger::error(_ME_) << "New SmatInv for axis " << axisName << " not computed";
+            delete inverse;
+            continue;
+        }
+        inverse->benchmark();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (generation != m_generation) {
+            // cancel() was called meanwhile: this one is outdated
+            delete inverse;
+            continue;
+        }
+        // If the previous one was never adopted, it is replaced
+        delete m_ready[axis].exchange(inverse, std::memory_order_acq_rel);
+        Logger::Logger() << "New SmatInv for axis " << axisName << " ready";
+    }
+}
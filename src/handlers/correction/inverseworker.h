@@ -0,0 +1,142 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INVERSEWORKER_H
+#define INVERSEWORKER_H
+
+#include <armadillo>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+class SmatInverse;
+
+/**
+ * @brief Compute new inverses of the response matrices in a background thread.
+ *
+ * The correction thread never waits for it: a new SmatInverse is published in
+ * a `ready` slot and adopted by the correction thread at a cycle boundary
+ * (adopt()) with a pointer swap. The previous one is put in a `retired` slot
+ * and deleted by the worker, so that the correction thread does not free
+ * memory either.
+ *
+ * A new inverse is only adopted once the previous retired one has been
+ * deleted, so each slot holds at most one pointer.
+ *
+ * \code{.cpp}
+ * worker.start();
+ * worker.request(InverseWorker::X, SmatX, IvecX, true); // Any thread
+ *
+ * worker.adopt(InverseWorker::X, inverseX); // Correction thread, each cycle
+ * \endcode
+ */
+class InverseWorker
+{
+public:
+    /**
+     * @brief Axis of an inverse.
+     */
+    enum Axis {
+        X = 0,
+        Y = 1
+    };
+
+    /**
+     * @brief Constructor. The thread is started by start().
+     */
+    explicit InverseWorker();
+
+    /**
+     * @brief Destructor. Stops the thread and deletes the pending inverses.
+     */
+    ~InverseWorker();
+
+    /**
+     * @brief Start the worker thread (off the real-time core).
+     */
+    void start();
+
+    /**
+     * @brief Stop and join the worker thread.
+     */
+    void stop();
+
+    /**
+     * @brief Ask for a new inverse. A request not yet started is replaced.
+     *
+     * @param axis Axis of the matrix
+     * @param Smat Matrix to inverse
+     * @param Ivec Number of singular values to keep
+     * @param weighted Should the correctors be weighted?
+     */
+    void request(Axis axis, const arma::mat& Smat, int Ivec, bool weighted);
+
+    /**
+     * @brief Drop the pending requests and the inverses not yet adopted.
+     *
+     * To be called from the correction thread (e.g. when it computes the
+     * inverses itself at initialization).
+     */
+    void cancel();
+
+    /**
+     * @brief Swap `current` with the new inverse, if one is ready.
+     *
+     * To be called from the correction thread between two cycles. Does not
+     * block nor allocate.
+     *
+     * @param axis Axis of the inverse
+     * @param[in,out] current Inverse in use
+     * @return True if `current` was replaced.
+     */
+    bool adopt(Axis axis, SmatInverse*& current);
+
+private:
+    /**
+     * @brief Parameters of a requested inverse.
+     */
+    struct Job_t {
+        bool pending;  /**< @brief Is there something to compute? */
+        arma::mat Smat; /**< @brief Matrix to inverse */
+        int Ivec;      /**< @brief Number of singular values to keep */
+        bool weighted; /**< @brief Should the correctors be weighted? */
+    };
+
+    /**
+     * @brief Loop of the worker thread.
+     */
+    void workLoop();
+
+    /**
+     * @brief Delete the inverses retired by the correction thread.
+     */
+    void reclaim();
+
+    Job_t m_jobs[2]; /**< @brief Requests for each axis (protected by m_mutex) */
+    std::atomic<SmatInverse*> m_ready[2]; /**< @brief Inverses to adopt */
+    std::atomic<SmatInverse*> m_retired[2]; /**< @brief Inverses to delete */
+    unsigned long m_generation; /**< @brief Incremented by cancel() (protected by m_mutex) */
+
+    std::atomic<bool> m_running; /**< @brief Whether the thread should keep working */
+    std::thread m_thread; /**< @brief Worker thread */
+    std::mutex m_mutex; /**< @brief Mutex protecting the requests */
+    std::condition_variable m_cond; /**< @brief Notified at each request */
+};
+
+#endif // INVERSEWORKER_H
@@ -0,0 +1,141 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "handlers/correction/pidbank.h"
+
+#include "modules/zmq/logger.h"
+
+#include <algorithm>
+#include <limits>
+#include <thread>
+
+PIDBank::PIDBank()
+    : m_nbX(0)
+    , m_size(0)
+    , m_stagingBusy(false)
+    , m_hasStaged(false)
+{
+    m_gains.ramp = m_staged.ramp = 0.01;
+}
+
+void PIDBank::init(int nbX, int nbY, double P, double I, double D)
+{
+    while (m_stagingBusy.exchange(true, std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+    m_nbX = nbX;
+    m_size = nbX + nbY;
+
+    m_gains.P.set_size(m_size);
+    m_gains.P.fill(P);
+    m_gains.I.set_size(m_size);
+    m_gains.I.fill(I);
+    m_gains.D.set_size(m_size);
+    m_gains.D.fill(D);
+    m_gains.windup.set_size(m_size);
+    m_gains.windup.fill(std::numeric_limits<double>::infinity());
+    m_gains.ramp = 0.01;
+    m_staged = m_gains;
+    m_hasStaged = false;
+
+    m_currentP.zeros(m_size);
+    m_sum.zeros(m_size);
+    m_last.zeros(m_size);
+    m_stagingBusy.store(false, std::memory_order_release);
+}
+
+arma::vec& PIDBank::parameterOf(Gains_t& gains, Parameter parameter)
+{
+    switch (parameter) {
+    case P:
+        return gains.P;
+    case I:
+        return gains.I;
+    case D:
+        return gains.D;
+    default:
+        return gains.windup;
+    }
+}
+
+int PIDBank::stage(Parameter parameter, Axis axis, const arma::vec& values)
+{
+    int first = this->begin(axis);
+    int size = this->end(axis) - first;
+    if (values.n_elem != size) {
+        Logger::error(_ME_) << "PID: " << values.n_elem << " values given for " << size << " channels";
+        return 1;
+    }
+    while (m_stagingBusy.exchange(true, std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+    arma::vec& staged = parameterOf(m_staged, parameter);
+    std::copy(values.memptr(), values.memptr() + size, staged.memptr() + first);
+    m_hasStaged.store(true, std::memory_order_relaxed);
+    m_stagingBusy.store(false, std::memory_order_release);
+    return 0;
+}
+
+void PIDBank::stageRamp(double step)
+{
+    while (m_stagingBusy.exchange(true, std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+    m_staged.ramp = step;
+    m_hasStaged.store(true, std::memory_order_relaxed);
+    m_stagingBusy.store(false, std::memory_order_release);
+}
+
+void PIDBank::commit()
+{
+    if (!m_hasStaged.load(std::memory_order_relaxed)) {
+        return;
+    }
+    // Never wait: if stage() is running, try again at the next cycle
+    if (m_stagingBusy.exchange(true, std::memory_order_acquire)) {
+        return;
+    }
+    // Same sizes: copied in place
+    m_gains.P = m_staged.P;
+    m_gains.I = m_staged.I;
+    m_gains.D = m_staged.D;
+    m_gains.windup = m_staged.windup;
+    m_gains.ramp = m_staged.ramp;
+    m_hasStaged.store(false, std::memory_order_relaxed);
+    m_stagingBusy.store(false, std::memory_order_release);
+}
+
+void PIDBank::apply(const double* dCM, double* CM, int begin, int end)
+{
+    const double* __restrict delta = dCM;
+    double* __restrict out = CM;
+    const double* __restrict P = m_gains.P.memptr();
+    const double* __restrict I = m_gains.I.memptr();
+    const double* __restrict D = m_gains.D.memptr();
+    const double* __restrict windup = m_gains.windup.memptr();
+    double* __restrict currentP = m_currentP.memptr();
+    double* __restrict sum = m_sum.memptr();
+    double* __restrict last = m_last.memptr();
+    const double ramp = m_gains.ramp;
+
+    for (int i = begin ; i < end ; i++) {
+        currentP[i] = std::min(currentP[i] + ramp, P[i]);
+        sum[i] = std::max(-windup[i], std::min(sum[i] + delta[i], windup[i]));
+        out[i] -= (delta[i] * currentP[i]) + (I[i] * sum[i]) + (D[i] * (delta[i] - last[i]));
+        last[i] = delta[i];
+    }
+}
@@ -0,0 +1,158 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PIDBANK_H
+#define PIDBANK_H
+
+#include <armadillo>
+
+#include <atomic>
+
+/**
+ * @brief PID controllers of all correctors (x then y), one channel each.
+ *
+ * Each channel has its own P, I and D gains and an anti-windup limit on its
+ * integrator. The proportional gain is ramped in from 0 by a configurable
+ * step at each cycle. The state is kept in contiguous arrays, updated in
+ * place by one loop over the channels of the corrected plane(s).
+ *
+ * The gains can be changed from another thread with stage(): they are
+ * copied into the active arrays at the next commit(), called by the
+ * correction thread at the cycle boundary. Nothing is allocated after
+ * init(), and commit() never waits: if stage() is running, the new gains are
+ * taken one cycle later.
+ *
+ * \code{.cpp}
+ * PIDBank bank;
+ * bank.init(nbCMx, nbCMy, P, I, D);
+ * bank.stage(PIDBank::P, PIDBank::X, newGainsX); // Any thread
+ *
+ * bank.commit(); // Correction thread, each cycle
+ * bank.apply(dCM, CM, 0, nbCMx + nbCMy);
+ * \endcode
+ */
+class PIDBank
+{
+public:
+    /**
+     * @brief Parameter that can be staged.
+     */
+    enum Parameter {
+        P,      /**< @brief Proportional gain */
+        I,      /**< @brief Integral gain */
+        D,      /**< @brief Derivative gain */
+        Windup  /**< @brief Limit of the absolute value of the integrator */
+    };
+
+    /**
+     * @brief Plane of a set of channels.
+     */
+    enum Axis {
+        X = 0,
+        Y = 1
+    };
+
+    /**
+     * @brief Constructor. The bank is empty until init() is called.
+     */
+    explicit PIDBank();
+
+    /**
+     * @brief Allocate the arrays and reset the state.
+     *
+     * All channels get the same gains, no windup limit and a ramp step of
+     * 0.01.
+     *
+     * @param nbX Number of channels of the x axis
+     * @param nbY Number of channels of the y axis
+     * @param P, I, D Gains
+     */
+    void init(int nbX, int nbY, double P, double I, double D);
+
+    /**
+     * @brief Prepare new values of a parameter for one axis.
+     *
+     * @param parameter Parameter to change
+     * @param axis Channels to change
+     * @param values One value per channel of the axis
+     * @return Error code: 1 if the size is wrong, else 0.
+     */
+    int stage(Parameter parameter, Axis axis, const arma::vec& values);
+
+    /**
+     * @brief Prepare a new ramp step (increase of P per cycle).
+     */
+    void stageRamp(double step);
+
+    /**
+     * @brief Make the staged parameters active. To be called by the
+     * correction thread at the cycle boundary.
+     */
+    void commit();
+
+    /**
+     * @brief Apply the PID to channels [begin, end) and subtract the result
+     * from the correctors, in place.
+     *
+     * @param[in] dCM Corrector deltas (all channels)
+     * @param[in,out] CM Corrector values (all channels)
+     * @param begin First channel
+     * @param end Channel after the last one
+     */
+    void apply(const double* dCM, double* CM, int begin, int end);
+
+    /**
+     * @brief First channel of an axis.
+     */
+    int begin(Axis axis) const { return (axis == X) ? 0 : m_nbX; }
+
+    /**
+     * @brief Channel after the last one of an axis.
+     */
+    int end(Axis axis) const { return (axis == X) ? m_nbX : m_size; }
+
+private:
+    /**
+     * @brief Parameters that can be changed at runtime.
+     */
+    struct Gains_t {
+        arma::vec P;      /**< @brief Proportional gains */
+        arma::vec I;      /**< @brief Integral gains */
+        arma::vec D;      /**< @brief Derivative gains */
+        arma::vec windup; /**< @brief Limits of the integrators */
+        double ramp;      /**< @brief Increase of P per cycle */
+    };
+
+    /**
+     * @brief Parameter array of a Gains_t.
+     */
+    static arma::vec& parameterOf(Gains_t& gains, Parameter parameter);
+
+    int m_nbX;  /**< @brief Number of x channels */
+    int m_size; /**< @brief Number of channels */
+
+    Gains_t m_gains;  /**< @brief Active parameters */
+    Gains_t m_staged; /**< @brief Parameters for the next commit() */
+    std::atomic<bool> m_stagingBusy; /**< @brief Is m_staged being written or read? */
+    std::atomic<bool> m_hasStaged;   /**< @brief Does m_staged contain new values? */
+
+    arma::vec m_currentP;  /**< @brief Ramped proportional gains */
+    arma::vec m_sum;       /**< @brief Integrators */
+    arma::vec m_last;      /**< @brief Last corrector deltas */
+};
+
+#endif // PIDBANK_H
@@ -0,0 +1,135 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "handlers/correction/smatinverse.h"
+
+#include "handlers/correction/svdcache.h"
+#include "modules/zmq/logger.h"
+
+#include <chrono>
+
+SmatInverse::SmatInverse()
+    : m_mode(Mode::Dense)
+{
+}
+
+int SmatInverse::compute(const arma::mat& Smat, int Ivec, bool weighted)
+{
+    using namespace std::chrono;
+
+    Logger::Logger() << "Calculate Smat";
+    Logger::Logger() << "\tGiven : " << " Smat cols: " << Smat.n_cols << " smat rows " << Smat.n_rows << "  Ivec : " << Ivec;
+
+    SvdCache cache;
+    uint64_t key = SvdCache::key(Smat, Ivec, weighted);
+    if (cache.load(key, *this)) {
+        return 0;
+    }
+    steady_clock::time_point start = steady_clock::now();
+
+    arma::vec CMWeight = arma::ones<arma::vec>(Smat.n_cols);
+    arma::mat Smat_w = Smat;
+    if (weighted) {
+        Logger::Logger() << "\tcalc CMWeights";
+        CMWeight = 1/(arma::trans(arma::stddev(Smat)));
+        Logger::Logger() << "\tInclude CMWeight in SMat";
+        for (int i = 0; i < Smat.n_cols; i++) {
+            Smat_w.col(i) *= CMWeight(i);
+        }
+    }
+
+    Logger::Logger() << "\tcalc SVD";
+    arma::mat U, V;
+    arma::vec s;
+    if (!arma::svd(U, s, V, Smat_w)) {
+        Logger::error(_ME_) << "SVD failed";
+        return 1;
+    }
+    if (Ivec > s.n_elem) {
+        Logger::Logger() << "\tIvec > " << s.n_elem << ": Setting Ivec = " << s.n_elem;
+        Ivec = s.n_elem;
+    }
+    if (Ivec < 1) {
+        Logger::error(_ME_) << "Ivec must be at least 1";
+        return 1;
+    }
+
+    Logger::Logger() << "\treduce U, S, V to Ivec";
+    m_SUt = arma::trans(U.cols(0, Ivec-1));
+    m_SUt.each_col() /= s.subvec(0, Ivec-1);
+    m_WV = V.cols(0, Ivec-1);
+    m_WV.each_col() %= CMWeight;
+
+    Logger::Logger() << "\tCalc new Matrix";
+    m_dense = m_WV * m_SUt;
+    m_projection.zeros(Ivec);
+
+    Logger::Logger() << "SVD complete ...";
+    cache.store(key, *this, duration_cast<duration<double> >(steady_clock::now() - start).count());
+    return 0;
+}
+
+void SmatInverse::setFactors(const arma::mat& SUt, const arma::mat& WV, const arma::mat& dense)
+{
+    m_SUt = SUt;
+    m_WV = WV;
+    m_dense = dense;
+    m_projection.zeros(SUt.n_rows);
+}
+
+SmatInverse::Mode SmatInverse::benchmark(int repetitions)
+{
+    using namespace std::chrono;
+
+    arma::vec diff = arma::randu<arma::vec>(m_dense.n_cols);
+    arma::vec dCM(m_dense.n_rows);
+
+    double elapsed[2];
+    const Mode modes[2] = { Mode::Dense, Mode::Factored };
+    for (int m = 0 ; m < 2 ; m++) {
+        m_mode = modes[m];
+        this->apply(diff, dCM); // warm-up
+        steady_clock::time_point start = steady_clock::now();
+        for (int i = 0 ; i < repetitions ; i++) {
+            this->apply(diff, dCM);
+        }
+        elapsed[m] = duration_cast<duration<double> >(steady_clock::now() - start).count();
+    }
+
+    m_mode = (elapsed[1] < elapsed[0]) ? Mode::Factored : Mode::Dense;
+    Logger::Logger() << "\tSmatInv " << m_dense.n_rows << 'x' << m_dense.n_cols
+                     << ", rank " << this->rank() << " -- "
+                     << "Dense: " << elapsed[0]*1e6/repetitions << " us -- "
+                     << "Factored: " << elapsed[1]*1e6/repetitions << " us -- "
+                     << "Use " << ((m_mode == Mode::Factored) ? "factored" : "dense");
+    return m_mode;
+}
+
+int SmatInverse::apply(const arma::vec& diff, arma::vec& dCM)
+{
+    if ((m_dense.n_cols != diff.n_elem) || (m_dense.n_rows != dCM.n_elem)) {
+        return 1;
+    }
+    // Written into existing memory: no allocation
+    if (m_mode == Mode::Factored) {
+        m_projection = m_SUt * diff;
+        dCM = m_WV * m_projection;
+    } else {
+        dCM = m_dense * diff;
+    }
+    return 0;
+}
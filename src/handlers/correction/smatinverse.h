@@ -0,0 +1,135 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SMATINVERSE_H
+#define SMATINVERSE_H
+
+#include <armadillo>
+
+/**
+ * @brief Pseudo-inverse of the response matrix (Smat) of one plane.
+ *
+ * The SVD of the (weighted) Smat is truncated to the `Ivec` greatest singular
+ * values. The inverse can then be applied in two ways:
+ *  * Dense: `dCM = SmatInv * diff`, with `SmatInv = W V_k s_k^-1 U_k'`
+ *    (n_CM x n_BPM flops)
+ *  * Factored: `dCM = (W V_k) * ((s_k^-1 U_k') * diff)`
+ *    ((n_CM + n_BPM) x Ivec flops)
+ *
+ * where W is the diagonal matrix of the corrector weights. The factored form
+ * is cheaper when Ivec is small, but it does two smaller products instead of
+ * one: benchmark() measures both paths and keeps the fastest.
+ *
+ * \code{.cpp}
+ * SmatInverse inverse;
+ * inverse.compute(Smat, Ivec, true);
+ * inverse.benchmark();
+ * inverse.apply(diff, dCM); // In the loop, no allocation
+ * \endcode
+ */
+class SmatInverse
+{
+public:
+    /**
+     * @brief How apply() computes the product.
+     */
+    enum class Mode {
+        Dense,
+        Factored
+    };
+
+    /**
+     * @brief Constructor. The inverse is empty until compute() is called.
+     */
+    explicit SmatInverse();
+
+    /**
+     * @brief Calculate the truncated pseudo-inverse.
+     *
+     * The result is taken from the SvdCache when possible, else it is
+     * computed and stored there.
+     *
+     * @param Smat Matrix to inverse (n_BPM x n_CM)
+     * @param Ivec Number of singular values to keep (reduced to the number
+     *             of singular values if greater)
+     * @param weighted Should the correctors be weighted by 1/stddev(Smat)?
+     * @return Error code: 1 if the SVD failed or Ivec < 1, else 0.
+     */
+    int compute(const arma::mat& Smat, int Ivec, bool weighted);
+
+    /**
+     * @brief Time both paths on a random orbit and keep the fastest.
+     *
+     * @param repetitions Number of products timed for each path
+     * @return The chosen mode
+     */
+    Mode benchmark(int repetitions = 1000);
+
+    /**
+     * @brief Apply the inverse (weights included).
+     *
+     * @param[in] diff Differential orbit (n_BPM)
+     * @param[out] dCM Corrector deltas, must already have n_CM elements
+     * @return Error code: 1 if the sizes do not match the inverse (e.g.
+     *         compute() failed), else 0.
+     */
+    int apply(const arma::vec& diff, arma::vec& dCM);
+
+    /**
+     * @brief Force the mode used by apply().
+     */
+    void setMode(Mode mode) { m_mode = mode; }
+
+    /**
+     * @brief Mode used by apply().
+     */
+    Mode mode() const { return m_mode; }
+
+    /**
+     * @brief Dense pseudo-inverse (weights included).
+     */
+    const arma::mat& dense() const { return m_dense; }
+
+    /**
+     * @brief s_k^-1 U_k' (Ivec x n_BPM).
+     */
+    const arma::mat& SUt() const { return m_SUt; }
+
+    /**
+     * @brief W V_k (n_CM x Ivec).
+     */
+    const arma::mat& WV() const { return m_WV; }
+
+    /**
+     * @brief Number of singular values kept.
+     */
+    int rank() const { return m_projection.n_elem; }
+
+    /**
+     * @brief Set the factors directly (e.g. from the SvdCache).
+     */
+    void setFactors(const arma::mat& SUt, const arma::mat& WV, const arma::mat& dense);
+
+private:
+    Mode m_mode; /**< @brief Mode used by apply() */
+    arma::mat m_dense; /**< @brief W V_k s_k^-1 U_k' (n_CM x n_BPM) */
+    arma::mat m_SUt; /**< @brief s_k^-1 U_k' (Ivec x n_BPM) */
+    arma::mat m_WV; /**< @brief W V_k (n_CM x Ivec) */
+    arma::vec m_projection; /**< @brief Workspace for (s_k^-1 U_k') * diff */
+};
+
+#endif // SMATINVERSE_H
@@ -0,0 +1,192 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "handlers/correction/svdcache.h"
+
+#include "handlers/correction/smatinverse.h"
+#include "modules/zmq/logger.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    const char s_magic[8] = { 'M', 'B', 'O', 'X', 'S', 'V', 'D', '\0' };
+    const uint32_t s_version = 1;
+
+    /**
+     * @brief Header of a cache file, followed by the matrices s_k^-1 U_k',
+     * W V_k and the dense inverse (column-major doubles).
+     */
+    struct Header_t {
+        char magic[8];
+        uint32_t version;
+        uint32_t rank;
+        uint32_t nbBPM;
+        uint32_t nbCM;
+        uint64_t key;
+        double computeTime;
+    };
+
+    uint64_t fnv1a(uint64_t hash, const void* data, size_t size)
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0 ; i < size ; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+}
+
+SvdCache::SvdCache()
+{
+    const char* home = std::getenv("HOME");
+    if (home == NULL) {
+        return;
+    }
+    std::string cache = std::string(home) + "/.cache";
+    std::string directory = cache + "/mbox";
+    mkdir(cache.c_str(), 0755);
+    mkdir(directory.c_str(), 0755);
+    struct stat info;
+    if ((stat(directory.c_str(), &info) == 0) && S_ISDIR(info.st_mode)) {
+        m_directory = directory;
+    } else {
+        Logger::error(_ME_) << "SVD cache disabled: cannot create " << directory;
+    }
+}
+
+uint64_t SvdCache::key(const arma::mat& Smat, int Ivec, bool weighted)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    uint64_t dimensions[2] = { Smat.n_rows, Smat.n_cols };
+    hash = fnv1a(hash, dimensions, sizeof(dimensions));
+    hash = fnv1a(hash, Smat.memptr(), Smat.n_elem*sizeof(double));
+    hash = fnv1a(hash, &Ivec, sizeof(Ivec));
+    unsigned char flag = weighted;
+    hash = fnv1a(hash, &flag, sizeof(flag));
+    return hash;
+}
+
+std::string SvdCache::path(uint64_t key) const
+{
+    std::ostringstream name;
+    name << m_directory << "/smat-" << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+    return name.str();
+}
+
+bool SvdCache::load(uint64_t key, SmatInverse& inverse)
+{
+    using namespace std::chrono;
+
+    if (m_directory.empty()) {
+        return false;
+    }
+    steady_clock::time_point start = steady_clock::now();
+    std::string file = this->path(key);
+
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0) {
+        Logger::Logger() << "\tSVD cache miss (" << file << ')';
+        return false;
+    }
+    struct stat info;
+    if ((fstat(fd, &info) != 0) || (info.st_size < sizeof(Header_t))) {
+        close(fd);
+        Logger::error(_ME_) << "SVD cache: " << file << " is corrupted";
+        return false;
+    }
+    void* mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        Logger::error(_ME_) << "SVD cache: cannot map " << file << ": " << std::strerror(errno);
+        return false;
+    }
+
+    Header_t header;
+    std::memcpy(&header, mapping, sizeof(header));
+    size_t rank = header.rank, nbBPM = header.nbBPM, nbCM = header.nbCM;
+    size_t expectedSize = sizeof(Header_t) + sizeof(double)*(rank*nbBPM + nbCM*rank + nbCM*nbBPM);
+    bool valid = (std::memcmp(header.magic, s_magic, sizeof(s_magic)) == 0)
+            && (header.version == s_version)
+            && (header.key == key)
+            && (info.st_size == expectedSize);
+    if (valid) {
+        const double* data = reinterpret_cast<const double*>(static_cast<const char*>(mapping) + sizeof(Header_t));
+        arma::mat SUt(data, rank, nbBPM);
+        data += rank*nbBPM;
+        arma::mat WV(data, nbCM, rank);
+        data += nbCM*rank;
+        arma::mat dense(data, nbCM, nbBPM);
+        inverse.setFactors(SUt, WV, dense);
+    }
+    munmap(mapping, info.st_size);
+
+    if (!valid) {
+        Logger::error(_ME_) << "SVD cache: " << file << " is invalid, ignored";
+        return false;
+    }
+    double loadTime = duration_cast<duration<double> >(steady_clock::now() - start).count();
+    Logger::Logger() << "\tSVD cache hit (" << file << "): loaded in " << loadTime*1e3
+                     << " ms, " << (header.computeTime - loadTime)*1e3 << " ms saved";
+    return true;
+}
+
+void SvdCache::store(uint64_t key, const SmatInverse& inverse, double computeTime)
+{
+    if (m_directory.empty()) {
+        return;
+    }
+    Header_t header;
+    std::memcpy(header.magic, s_magic, sizeof(s_magic));
+    header.version = s_version;
+    header.rank = inverse.rank();
+    header.nbBPM = inverse.dense().n_cols;
+    header.nbCM = inverse.dense().n_rows;
+    header.key = key;
+    header.computeTime = computeTime;
+
+    // Written next to the final file, then renamed: readers never see half a file
+    std::string file = this->path(key);
+    std::string tmpFile = file + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    std::ofstream out(tmpFile, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(inverse.SUt().memptr()), inverse.SUt().n_elem*sizeof(double));
+    out.write(reinterpret_cast<const char*>(inverse.WV().memptr()), inverse.WV().n_elem*sizeof(double));
+    out.write(reinterpret_cast<const char*>(inverse.dense().memptr()), inverse.dense().n_elem*sizeof(double));
+    out.close();
+
+    if (!out || std::rename(tmpFile.c_str(), file.c_str())) {
+        std::remove(tmpFile.c_str());
+        Logger::error(_ME_) << "SVD cache: cannot write " << file;
+        return;
+    }
+    Logger::Logger() << "\tSVD cache: stored " << file;
+}
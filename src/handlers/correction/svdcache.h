@@ -0,0 +1,89 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SVDCACHE_H
+#define SVDCACHE_H
+
+#include <armadillo>
+
+#include <cstdint>
+#include <string>
+
+class SmatInverse;
+
+/**
+ * @brief On-disk cache of the inverses of the response matrices.
+ *
+ * The SVD of the Smat is the longest part of the initialization, but the
+ * Smat rarely changes between two runs. The factors of a SmatInverse are
+ * therefore saved in `$HOME/.cache/mbox/smat-<key>.bin`, where the key is a
+ * FNV-1a hash of the Smat, Ivec and the weighting flag. The file is read
+ * with mmap.
+ *
+ * \code{.cpp}
+ * SvdCache cache;
+ * uint64_t key = SvdCache::key(Smat, Ivec, weighted);
+ * if (!cache.load(key, inverse)) {
+ *     // compute the inverse...
+ *     cache.store(key, inverse, computeSeconds);
+ * }
+ * \endcode
+ *
+ * The cache is disabled if `$HOME` is not set. Errors are logged but never
+ * fatal: the inverse is just computed again.
+ */
+class SvdCache
+{
+public:
+    /**
+     * @brief Constructor. Creates the cache directory if needed.
+     */
+    explicit SvdCache();
+
+    /**
+     * @brief Hash of the parameters of an inverse.
+     */
+    static uint64_t key(const arma::mat& Smat, int Ivec, bool weighted);
+
+    /**
+     * @brief Fill the inverse from the cache.
+     *
+     * @param key Key given by key()
+     * @param[out] inverse Inverse to fill
+     * @return True on a hit.
+     */
+    bool load(uint64_t key, SmatInverse& inverse);
+
+    /**
+     * @brief Save an inverse in the cache.
+     *
+     * @param key Key given by key()
+     * @param inverse Inverse to save
+     * @param computeTime Time needed to compute it (s), reported on later hits
+     */
+    void store(uint64_t key, const SmatInverse& inverse, double computeTime);
+
+private:
+    /**
+     * @brief Path of the file for a given key.
+     */
+    std::string path(uint64_t key) const;
+
+    std::string m_directory; /**< @brief Cache directory (empty if disabled) */
+};
+
+#endif // SVDCACHE_H
@@ -0,0 +1,123 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "handlers/gatherplan.h"
+
+#include "handlers/handler.h"
+#include "modules/zmq/logger.h"
+
+#include <algorithm>
+
+GatherPlan::GatherPlan()
+{
+}
+
+int GatherPlan::compile(const std::vector<double>& waveIndex,
+                        const arma::vec& gain, const arma::vec& offset, double sign,
+                        const std::vector<FeedForward_t>& feedForward)
+{
+    m_index.clear();
+    m_scale.clear();
+    m_offset.clear();
+    m_ffSource.clear();
+    m_ffTarget.clear();
+    m_ffScale.clear();
+
+    int size = waveIndex.size();
+    if ((gain.n_elem != size) || (offset.n_elem != size)) {
+        Logger::error(_ME_) << "Gather plan: " << size << " BPMs but "
+                            << gain.n_elem << " gains and " << offset.n_elem << " offsets";
+        return 1;
+    }
+
+    for (int i = 0 ; i < size ; i++) {
+        int position = static_cast<int>(waveIndex[i]) - 1;
+        if ((position < 0) || (position >= ADC_BUFFER_SIZE)) {
+            Logger::error(_ME_) << "Gather plan: BPM " << i << " is out of the ADC buffer";
+            m_index.clear();
+            m_scale.clear();
+            m_offset.clear();
+            return 1;
+        }
+        m_index.push_back(position);
+        m_scale.push_back(sign * gain(i) * numbers::cf);
+        m_offset.push_back(offset(i));
+    }
+
+    for (const FeedForward_t& entry : feedForward) {
+        auto it = std::find(waveIndex.begin(), waveIndex.end(), entry.waveIndex);
+        if ((entry.source < 0) || (entry.source >= ADC_BUFFER_SIZE) || (it == waveIndex.end())) {
+            Logger::error(_ME_) << "Gather plan: feed-forward from ADC " << entry.source
+                                << " to BPM " << entry.waveIndex << " ignored";
+            continue;
+        }
+        m_ffSource.push_back(entry.source);
+        m_ffTarget.push_back(it - waveIndex.begin());
+        m_ffScale.push_back(entry.coefficient * numbers::cf);
+        Logger::Logger() << "\tFeed-forward ADC " << entry.source << " -> idx "
+                         << m_ffTarget.back() << " : " << entry.coefficient;
+    }
+
+    return 0;
+}
+
+void GatherPlan::apply(const RFM2G_INT16* adc, arma::vec& diff) const
+{
+    const int size = m_index.size();
+    const int* __restrict index = m_index.data();
+    const double* __restrict scale = m_scale.data();
+    const double* __restrict offset = m_offset.data();
+    double* __restrict out = diff.memptr();
+
+    for (int i = 0 ; i < size ; i++) {
+        out[i] = adc[index[i]] * scale[i] - offset[i];
+    }
+
+    const int ffSize = m_ffSource.size();
+    for (int k = 0 ; k < ffSize ; k++) {
+        out[m_ffTarget[k]] -= m_ffScale[k] * adc[m_ffSource[k]];
+    }
+}
+
+std::vector<FeedForward_t> GatherPlan::feedForwardFromVec(const arma::vec& values)
+{
+    std::vector<FeedForward_t> table;
+    if (values.n_elem % 3 != 0) {
+        Logger::error(_ME_) << "Feed-forward table: size " << values.n_elem
+                            << " is not a multiple of 3";
+        return table;
+    }
+    for (unsigned int i = 0 ; i < values.n_elem ; i += 3) {
+        FeedForward_t entry;
+        entry.source = static_cast<int>(values(i));
+        entry.waveIndex = values(i+1);
+        entry.coefficient = values(i+2);
+        table.push_back(entry);
+    }
+    return table;
+}
+
+arma::vec GatherPlan::feedForwardToVec(const std::vector<FeedForward_t>& table)
+{
+    arma::vec values(3*table.size());
+    for (unsigned int i = 0 ; i < table.size() ; i++) {
+        values(3*i) = table[i].source;
+        values(3*i+1) = table[i].waveIndex;
+        values(3*i+2) = table[i].coefficient;
+    }
+    return values;
+}
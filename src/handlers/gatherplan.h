@@ -0,0 +1,113 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GATHERPLAN_H
+#define GATHERPLAN_H
+
+#include "define.h"
+
+#include <armadillo>
+#include <vector>
+
+/**
+ * @brief Entry of the feed-forward table: a signal read on the ADC is
+ * subtracted from one BPM (e.g. FS BUMP, ARTOF).
+ *
+ * `diff[BPM] -= coefficient * cf * ADC[source]`
+ */
+struct FeedForward_t {
+    int source;         /**< @brief Index of the source signal in the ADC buffer */
+    double waveIndex;   /**< @brief Wave index of the BPM to correct (as in ADC_BPMIndex_Pos) */
+    double coefficient; /**< @brief Coefficient applied to the source signal */
+};
+
+/**
+ * @brief Plan to gather the BPM values of one axis from the ADC buffer.
+ *
+ * The index table, gains, offsets and feed-forward table are compiled once
+ * in Handler::init() into contiguous arrays (structure of arrays). Each cycle
+ * then needs one pass over the BPMs:
+ *
+ *     diff[i] = ADC[index[i]] * scale[i] - offset[i]
+ *
+ * with `scale = sign * gain * cf`, followed by the few feed-forward entries.
+ *
+ * \code{.cpp}
+ * GatherPlan plan;
+ * plan.compile(ADC_WaveIndexX, gainX, offsetX, -1, feedForwardX);
+ * plan.apply(adc->buffer(), diffX);
+ * \endcode
+ */
+class GatherPlan
+{
+public:
+    /**
+     * @brief Constructor. The plan is empty until compile() is called.
+     */
+    explicit GatherPlan();
+
+    /**
+     * @brief Build the plan.
+     *
+     * Invalid feed-forward entries are reported and ignored.
+     *
+     * @param waveIndex Position (1-based) of each BPM in the ADC buffer
+     * @param gain Gain of each BPM
+     * @param offset Offset of each BPM
+     * @param sign Sign of the axis (-1 for x, 1 for y)
+     * @param feedForward Feed-forward table
+     * @return Error code: 1 if the sizes do not match, else 0.
+     */
+    int compile(const std::vector<double>& waveIndex,
+                const arma::vec& gain, const arma::vec& offset, double sign,
+                const std::vector<FeedForward_t>& feedForward);
+
+    /**
+     * @brief Gather, scale and correct the BPM values.
+     *
+     * @param[in] adc ADC buffer (ADC_BUFFER_SIZE values)
+     * @param[out] diff Differential orbit, must already have size() elements
+     */
+    void apply(const RFM2G_INT16* adc, arma::vec& diff) const;
+
+    /**
+     * @brief Number of BPMs in the plan.
+     */
+    int size() const { return m_index.size(); }
+
+    /**
+     * @brief Convert a flat vector of triplets (source, wave index, coefficient)
+     * as exchanged with the Messenger into a feed-forward table.
+     */
+    static std::vector<FeedForward_t> feedForwardFromVec(const arma::vec& values);
+
+    /**
+     * @brief Convert a feed-forward table into a flat vector of triplets.
+     */
+    static arma::vec feedForwardToVec(const std::vector<FeedForward_t>& table);
+
+private:
+    std::vector<int> m_index;     /**< @brief Position of each BPM in the ADC buffer */
+    std::vector<double> m_scale;  /**< @brief sign * gain * cf for each BPM */
+    std::vector<double> m_offset; /**< @brief Offset of each BPM */
+
+    std::vector<int> m_ffSource;      /**< @brief Feed-forward: ADC index of the source */
+    std::vector<int> m_ffTarget;      /**< @brief Feed-forward: BPM to correct */
+    std::vector<double> m_ffScale;    /**< @brief Feed-forward: coefficient * cf */
+};
+
+#endif // GATHERPLAN_H
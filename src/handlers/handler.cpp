@@ -21,14 +21,34 @@
 #include "dac.h"
 #include "dma.h"
 #include "rfm_helper.h"
+#include "modules/flightrecorder.h"
+#include "modules/latency.h"
+#include "modules/perfcounters.h"
 #include "modules/timers.h"
 #include "modules/zmq/logger.h"
 #include "modules/zmq/messenger.h"
 
+#include <atomic>
+#include <cstring>
 #include <iostream>
 #include <string>
 #include <vector>
 
+namespace {
+    /**
+     * @brief Values saturated since the last init(), per axis. Written by the
+     * correction thread, read by publishSaturation().
+     */
+    std::atomic<unsigned long> s_saturated[2];
+
+    /**
+     * @brief Values last published by publishSaturation(), per axis. Set to
+     * UNPUBLISHED by init(), so that the next value is always published.
+     */
+    std::atomic<unsigned long> s_published[2];
+    const unsigned long UNPUBLISHED = ~0UL;
+}
+
 Handler::Handler(RFMDriver *driver, DMA *dma, bool weightedCorr)
 {
     m_weightedCorr = weightedCorr;
@@ -38,6 +58,11 @@ Handler::Handler(RFMDriver *driver, DMA *dma, bool weightedCorr)
     m_adc = new ADC(m_driver, m_dma);
     m_dac = new DAC(m_driver, m_dma);
 
+    m_timers.make = TimingModule::registerTimer("int Handler::make()");
+    m_timers.acquisition = TimingModule::registerTimer("ADC_Full");
+    m_timers.computation = TimingModule::registerTimer("Computation");
+    m_timers.output = TimingModule::registerTimer("DAC_Full");
+
     if (m_adc->stop()) {
         exit(1);
     }
@@ -57,7 +82,25 @@ void Handler::disable()
     m_dac->changeStatus(DAC_DISABLE);
 }
 
-void Handler::init()
+void Handler::setPipelined(bool pipelined)
+{
+    m_dac->setPipelined(pipelined);
+}
+
+void Handler::publishSaturation()
+{
+    static const char* keys[2] = { "DAC-SATURATED-X", "DAC-SATURATED-Y" };
+
+    // A count read just before init() is published once, then replaced
+    for (int axis = 0 ; axis < 2 ; axis++) {
+        unsigned long count = s_saturated[axis].load(std::memory_order_relaxed);
+        if (s_published[axis].exchange(count, std::memory_order_relaxed) != count) {
+            Messenger::updateMap(keys[axis], static_cast<int>(count));
+        }
+    }
+}
+
+int Handler::init()
 {
     Logger::Logger() << "Read Data from RFM";
 
@@ -111,14 +154,30 @@ void Handler::init()
     m_numCM.x = SmatX.n_cols;
     m_numCM.y = SmatY.n_cols;
 
+    m_input.diff.x.zeros(m_numBPM.x);
+    m_input.diff.y.zeros(m_numBPM.y);
+    m_CMout.x.zeros(m_numCM.x);
+    m_CMout.y.zeros(m_numCM.y);
+
+    if (m_scatterPlan.x.compile(DAC_WaveIndexX, m_scaleDigits.x)) {
+        Logger::error(_ME_) << "Invalid scatter plan for the x axis";
+    }
+    if (m_scatterPlan.y.compile(DAC_WaveIndexY, m_scaleDigits.y)) {
+        Logger::error(_ME_) << "Invalid scatter plan for the y axis";
+    }
+
     m_dac->setWaveIndexX(DAC_WaveIndexX);
     m_dac->setWaveIndexY(DAC_WaveIndexY);
     m_adc->setWaveIndexX(ADC_WaveIndexX);
     m_adc->setWaveIndexY(ADC_WaveIndexY);
 
-    this->setProcessor(SmatX, SmatY, IvecX, IvecY, Frequency, P/100, I/100, D/100, CMx, CMy, m_weightedCorr);
+    int processorError = this->setProcessor(SmatX, SmatY, IvecX, IvecY, Frequency, P/100, I/100, D/100, CMx, CMy, m_weightedCorr);
+    if (processorError) {
+        Logger::error(_ME_) << "Cannot set the processor";
+        return processorError;
+    }
 
-    this->initIndexes(ADC_WaveIndexX);
+    this->initGatherPlans(ADC_WaveIndexX, ADC_WaveIndexY);
 
     Messenger::updateMap("SMAT-X", SmatX);
     Messenger::updateMap("SMAT-Y", SmatY);
@@ -136,127 +195,159 @@ void Handler::init()
     Messenger::updateMap("NB-CM-Y", m_numCM.y);
     Messenger::updateMap("CM-X", CMx);
     Messenger::updateMap("CM-Y", CMy);
+    for (int axis = 0 ; axis < 2 ; axis++) {
+        s_saturated[axis].store(0, std::memory_order_relaxed);
+        s_published[axis].store(UNPUBLISHED, std::memory_order_relaxed);
+    }
+    Messenger::updateMap("DAC-SATURATED-X", 0);
+    Messenger::updateMap("DAC-SATURATED-Y", 0);
 
     if (!READONLY) {
         m_adc->init();
         m_dac->changeStatus(DAC_ENABLE);
     }
+    return 0;
 }
 
-void Handler::initIndexes(const std::vector<double>& ADC_WaveIndexX)
-{
-    Logger::Logger() << "Init Indexes";
-    //FS BUMP
-    m_idxHBP2D6R  = 160; //(2*81)-1(X) -1(C)
-    m_idxBPMZ6D6R = getIdx(ADC_WaveIndexX, 163);
-    Logger::Logger() << "\tidx 6D6 : " << m_idxBPMZ6D6R;
-    //ARTOF
-    m_idxHBP1D5R  = 142; //(2*72)-1(x) -1(C)
-    m_idxBPMZ3D5R = getIdx(ADC_WaveIndexX, 123);
-    Logger::Logger() << "\tidx 3Z5 : " << m_idxBPMZ3D5R;
-    m_idxBPMZ4D5R = getIdx(ADC_WaveIndexX, 125);
-    Logger::Logger() << "\tidx 4Z5 : " << m_idxBPMZ4D5R;
-    m_idxBPMZ5D5R = getIdx(ADC_WaveIndexX, 129);
-    Logger::Logger() << "\tidx 5Z5 : " << m_idxBPMZ5D5R;
-    m_idxBPMZ6D5R = getIdx(ADC_WaveIndexX, 131);
-    Logger::Logger() << "\tidx 6Z5 : " << m_idxBPMZ6D5R;
-}
-
-int Handler::getIdx(const std::vector<double>& ADC_BPMIndex_Pos, double DeviceWaveIndex)
+void Handler::initGatherPlans(const std::vector<double>& ADC_WaveIndexX,
+                              const std::vector<double>& ADC_WaveIndexY)
 {
-    auto it = std::find(ADC_BPMIndex_Pos.begin(), ADC_BPMIndex_Pos.end(), DeviceWaveIndex);
-    int position = it - ADC_BPMIndex_Pos.begin();
+    Logger::Logger() << "Init gather plans";
+    arma::vec feedForwardX, feedForwardY;
+    Messenger::get("FEED-FORWARD-X", feedForwardX);
+    Messenger::get("FEED-FORWARD-Y", feedForwardY);
+
+    if (feedForwardX.empty()) {
+        // Entries: ADC index of the source, BPM wave index, coefficient
+        std::vector<FeedForward_t> defaultTable = {
+            //FS BUMP: HBP2D6R = (2*81)-1(X) -1(C)
+            { 160, 163, -0.325 * 0.8 },
+            //ARTOF: HBP1D5R = (2*72)-1(x) -1(C)
+            { 142, 123, -0.42 * 0.8 },
+            { 142, 125, -0.84 * 0.8 },
+            { 142, 129, +0.84 * 0.8 },
+            { 142, 131, +0.42 * 0.8 },
+        };
+        feedForwardX = GatherPlan::feedForwardToVec(defaultTable);
+        Messenger::updateMap("FEED-FORWARD-X", feedForwardX);
+    }
 
-    return position;
+    if (m_gatherPlan.x.compile(ADC_WaveIndexX, m_gain.x, m_BPMoffset.x, -1,
+                               GatherPlan::feedForwardFromVec(feedForwardX))) {
+        Logger::error(_ME_) << "Invalid gather plan for the x axis";
+    }
+    if (m_gatherPlan.y.compile(ADC_WaveIndexY, m_gain.y, m_BPMoffset.y, 1,
+                               GatherPlan::feedForwardFromVec(feedForwardY))) {
+        Logger::error(_ME_) << "Invalid gather plan for the y axis";
+    }
 }
 
 int Handler::make()
 {
-    TimingModule::addTimer(_ME_);
+    if (PerfCounters::config().enabled && !m_perfGroup.isOpened()) {
+        // The counters follow the thread which opens them: the loop's one
+        m_perfGroup.open();
+    }
+    TimingModule::start(m_timers.make);
+
+    m_times.acquisition = 0;
+    m_times.computation = 0;
+    m_times.output = 0;
+    memset(&m_counters, 0, sizeof(m_counters));
+    m_counters.available = m_perfGroup.available();
+    int errornr = this->correctionCycle();
+
+    // Every cycle is recorded, the failed ones first
+    FlightRecorder::record(m_dma->status()->loopPos, errornr, m_times,
+                           m_input.diff.x, m_input.diff.y, m_CMout.x, m_CMout.y,
+                           m_adc->buffer(), ADC_BUFFER_SIZE);
+    if (!errornr) {
+        PerfCounters::record(m_counters);
+        // BPM, CM and ADC values of the cycle, in one telemetry frame
+        Logger::frame(m_dma->status()->loopPos, m_input.typeCorr, m_times, m_counters,
+                      m_input.diff.x, m_input.diff.y, m_CMout.x, m_CMout.y,
+                      m_input.adcBuffer, ADC_BUFFER_SIZE);
+    }
 
-    arma::vec diffX, diffY;
-    arma::vec CMx = arma::zeros<arma::vec>(m_numCM.x);
-    arma::vec CMy = arma::zeros<arma::vec>(m_numCM.y);;
-    bool newInjection = false;
+    TimingModule::stop(m_timers.make);
 
-    TimingModule::addTimer("ADC_Full");
-    int readError = this->getNewData(diffX, diffY, newInjection);
+    return errornr;
+}
+
+int Handler::correctionCycle()
+{
+    m_input.newInjection = false;
+
+    m_perfGroup.begin();
+    TimingModule::start(m_timers.acquisition);
+    int readError = this->getNewData(m_input.diff.x, m_input.diff.y, m_input.newInjection);
+    // Stopped in any case: this also closes the span of the trace
+    TimingModule::stop(m_timers.acquisition);
+    m_perfGroup.end(m_counters.acquisition);
+    m_times.acquisition = TimingModule::timer(m_timers.acquisition).timeSpan();
     if (readError)
     {
         Logger::error(_ME_) << "Cannot correct, error in data acquisition";
         return readError;
     }
-    TimingModule::timer("ADC_Full").stop();
-
-    Logger::values(LogValue::BPM, m_dma->status()->loopPos, std::vector<arma::vec>({diffX, diffY}));
-    Logger::values(LogValue::ADC, m_dma->status()->loopPos, std::vector<std::vector<RFM2G_INT16> >({m_adc->buffer()}));
 
-    CorrectionInput_t input;
+    // Values committed together through the Messenger take effect here
+    Messenger::applyCommit(m_dma->status()->loopPos);
 
-    input.typeCorr = this->typeCorrection();
+    m_input.typeCorr = this->typeCorrection();
+    m_input.adcBuffer = m_adc->buffer();
 
-    input.diff.x = diffX;
-    input.diff.y = diffY;
-    input.newInjection = newInjection;
-    input.value10Hz = m_adc->bufferAt(62);
+    m_CMout.x.zeros();
+    m_CMout.y.zeros();
 
-    TimingModule::addTimer("Computation");
-    int errornr = this->callProcessorRoutine(input, CMx, CMy);
-    TimingModule::timer("Computation").stop();
+    m_perfGroup.begin();
+    TimingModule::start(m_timers.computation);
+    int errornr = this->callProcessorRoutine(m_input, m_CMout.x, m_CMout.y);
+    TimingModule::stop(m_timers.computation);
+    m_perfGroup.end(m_counters.computation);
+    m_times.computation = TimingModule::timer(m_timers.computation).timeSpan();
     if (errornr) {
         return errornr;
     }
 
-    Logger::values(LogValue::CM, m_dma->status()->loopPos, std::vector<arma::vec>({CMx, CMy}));
-
-    TimingModule::addTimer("DAC_Full");
-    this->prepareCorrectionValues(CMx, CMy, input.typeCorr);
-
-    if (!READONLY) {
-        int writeError = this->writeCorrection();
-        if (writeError) {
-            return writeError;
+    m_perfGroup.begin();
+    TimingModule::start(m_timers.output);
+    int writeError = 0;
+    if ((m_scatterPlan.x.size() != m_CMout.x.n_elem) || (m_scatterPlan.y.size() != m_CMout.y.n_elem)) {
+        Logger::error(_ME_) << "No valid scatter plan";
+        writeError = Error::DAC;
+    } else {
+        this->prepareCorrectionValues(m_CMout.x, m_CMout.y, m_input.typeCorr);
+        if (!READONLY) {
+            writeError = this->writeCorrection();
         }
     }
-    TimingModule::timer("DAC_Full").stop();
-
-    TimingModule::timer(_ME_).stop();
+    TimingModule::stop(m_timers.output);
+    m_perfGroup.end(m_counters.output);
+    m_times.output = TimingModule::timer(m_timers.output).timeSpan();
 
-    return 0;
+    return writeError;
 }
 
 int Handler::getNewData(arma::vec &diffX, arma::vec &diffY, bool &newInjection)
 {
-    arma::vec rADCdataX(m_numBPM.x), rADCdataY(m_numBPM.y);
+    if ((m_gatherPlan.x.size() != diffX.n_elem) || (m_gatherPlan.y.size() != diffY.n_elem)) {
+        Logger::error(_ME_) << "No valid gather plan";
+        return Error::ADC;
+    }
     if (m_adc->read()) {
         Logger::error(_ME_) << "Read Error";
         return Error::ADC;
     }
 
-    for (unsigned int i = 0; i < m_numBPM.x; i++) {
-        unsigned int  lADCPos = m_adc->waveIndexXAt(i)-1;
-        rADCdataX(i) =  m_adc->bufferAt(lADCPos);
-    }
+    const RFM2G_INT16* buffer = m_adc->buffer();
+    newInjection = (buffer[INJECT_TRIG] > 1000);
 
-    for (unsigned int i = 0; i < m_numBPM.y; i++) {
-        unsigned int lADCPos = m_adc->waveIndexYAt(i)-1;
-        rADCdataY(i) =  m_adc->bufferAt(lADCPos);
-    }
-
-    newInjection = (m_adc->bufferAt(INJECT_TRIG) > 1000);
-
-    diffX = (rADCdataX % m_gain.x * numbers::cf * -1 ) - m_BPMoffset.x;
-    diffY = (rADCdataY % m_gain.y * numbers::cf      ) - m_BPMoffset.y;
-    //FS BUMP
-    double HBP2D6R = m_adc->bufferAt(m_idxHBP2D6R) * numbers::cf * 0.8;
-    diffX[m_idxBPMZ6D6R] -= (-0.325 * HBP2D6R);
-
-    //ARTOF
-    double HBP1D5R = m_adc->bufferAt(m_idxHBP1D5R) * numbers::cf * 0.8;
-    diffX[m_idxBPMZ3D5R] -= (-0.42 * HBP1D5R);
-    diffX[m_idxBPMZ4D5R] -= (-0.84 * HBP1D5R);
-    diffX[m_idxBPMZ5D5R] -= (+0.84 * HBP1D5R);
-    diffX[m_idxBPMZ6D5R] -= (+0.42 * HBP1D5R);
+    // Gain, offset and feed-forward (FS BUMP, ARTOF...) in one pass
+    uint64_t gatherStart = TimingModule::now();
+    m_gatherPlan.x.apply(buffer, diffX);
+    m_gatherPlan.y.apply(buffer, diffY);
+    Latency::record(Latency::Stage::Gather, TimingModule::now() - gatherStart);
 
     return 0;
 }
@@ -264,19 +355,13 @@ int Handler::getNewData(arma::vec &diffX, arma::vec &diffY, bool &newInjection)
 void Handler::prepareCorrectionValues(const arma::vec& CMx, const arma::vec& CMy, int typeCorr)
 {
     if ((typeCorr & Correction::Horizontal) == Correction::Horizontal) {
-        arma::vec Data_CMx = (CMx % m_scaleDigits.x) + numbers::halfDigits;
-        for (int i = 0; i <  Data_CMx.n_elem; i++)
-        {
-            int corPos = m_dac->waveIndexXAt(i)-1;
-            m_DACout[corPos] = Data_CMx(i);
+        if (m_scatterPlan.x.apply(CMx, m_DACout)) {
+            s_saturated[0].store(m_scatterPlan.x.saturatedCount(), std::memory_order_relaxed);
         }
     }
     if ((typeCorr & Correction::Vertical) == Correction::Vertical) {
-        arma::vec Data_CMy = (CMy % m_scaleDigits.y) + numbers::halfDigits;
-
-        for (int i = 0; i < Data_CMy.n_elem; i++) {
-            int corPos = m_dac->waveIndexYAt(i)-1;
-            m_DACout[corPos] = Data_CMy(i);
+        if (m_scatterPlan.y.apply(CMy, m_DACout)) {
+            s_saturated[1].store(m_scatterPlan.y.saturatedCount(), std::memory_order_relaxed);
         }
     }
     m_DACout[112] = (m_loopDir*2500000) + numbers::halfDigits;
@@ -19,7 +19,11 @@
 #define HANDLER_H
 
 #include "define.h"
+#include "handlers/gatherplan.h"
+#include "handlers/scatterplan.h"
 #include "handlers/structures.h"
+#include "modules/timers.h"
+#include "modules/zmq/telemetry.h"
 
 #include <armadillo>
 
@@ -79,6 +83,9 @@ public:
      *      * a function that do the calculations (in the Processor)
      *      * prepareCorrectionValues()
      *      * writeCorrectors() to write the results on the RFM
+     *
+     * Each cycle is then recorded by the FlightRecorder and, if it
+     * succeeded, published as a telemetry frame.
      */
     int make();
 
@@ -86,15 +93,40 @@ public:
      * @brief Initialize the attributes and call setProcessor().
      *
      * This will read the RFM to get the parameters from the cBox and initialize the ADC/DAC.
+     * If setProcessor() fails, the ADC and the DAC are not initialized.
+     *
+     * @return Error code of setProcessor(), else 0.
      */
-    void init();
+    int init();
 
     /**
      * @brief Disaqble te ADC and the DAC.
      */
     void disable();
 
+    /**
+     * @brief Collect the DAC acknowledgements while the next ADC event is
+     * awaited (see DAC::setPipelined()).
+     */
+    void setPipelined(bool pipelined);
+
+    /**
+     * @brief Publish the saturation counters to the Messenger
+     * (DAC-SATURATED-X/Y) when they changed. To be called periodically by
+     * the AsyncBackend thread, never by the correction loop.
+     */
+    static void publishSaturation();
+
 protected:
+    /**
+     * @brief Stages of make(): acquisition, computation and output.
+     *
+     * Fills m_times with the duration of the stages that were reached, and
+     * m_counters with their performance counters.
+     * @return Error code of the first stage that failed, else 0.
+     */
+    int correctionCycle();
+
     /**
      * @brief Read the data given on the RFM.
      *
@@ -130,6 +162,10 @@ protected:
     /**
      * @brief Prepare the values to be written by the DAC
      *
+     * Only the channels of the corrected plane(s) are written, through the
+     * scatter plans. The saturation counters are only stored, see
+     * publishSaturation().
+     *
      * @param CMx the corrector values for axis x
      * @param CMy the corrector values for axis y
      * @param typeCorr int value in the following set:
@@ -147,22 +183,24 @@ protected:
     int writeCorrection();
 
     /**
-     * @brief Get the index of a given index
-     * @return Error code.
-     */
-    int getIdx(const std::vector<double> &ADC_BPMIndex_Pos, double DeviceWaveIndex);
-
-    /**
-     * @brief Get the index of a given index
+     * @brief Compile the gather plans of both axes.
+     *
+     * The feed-forward tables are read from the Messenger (FEED-FORWARD-X/Y).
+     * When a table is empty, the default one (FS BUMP and ARTOF on the x axis)
+     * is used and published.
      */
-    void initIndexes(const std::vector<double> &ADC_WaveIndexX);
+    void initGatherPlans(const std::vector<double> &ADC_WaveIndexX,
+                         const std::vector<double> &ADC_WaveIndexY);
 
     /**
      * @brief Define the processor and its parameters.
      *
      * This is where a processor should be instanciated.
+     *
+     * @return Error code (see Error::ErrorCode), the correction must not
+     *         start if it is not 0.
      */
-    virtual void setProcessor(arma::mat SmatX, arma::mat SmatY,
+    virtual int setProcessor(arma::mat SmatX, arma::mat SmatY,
                               double IvecX, double IvecY,
                               double Frequency,
                               double P, double I, double D,
@@ -174,13 +212,6 @@ protected:
     RFMDriver *m_driver;
     bool m_weightedCorr;
 
-    int m_idxHBP2D6R,
-        m_idxBPMZ6D6R,
-        m_idxHBP1D5R,
-        m_idxBPMZ3D5R,
-        m_idxBPMZ4D5R,
-        m_idxBPMZ5D5R,
-        m_idxBPMZ6D5R;
     double m_loopDir;
     double m_plane;
     Pair_t<arma::vec> m_scaleDigits;
@@ -189,6 +220,33 @@ protected:
     Pair_t<int> m_numBPM;
     Pair_t<int> m_numCM;
     Pair_t<arma::vec> m_BPMoffset;
+    Pair_t<GatherPlan> m_gatherPlan; /**< @brief Plans to read the BPMs from the ADC buffer */
+    Pair_t<ScatterPlan> m_scatterPlan; /**< @brief Plans to write the correctors to the DAC buffer */
+
+    /**
+     * @brief Workspaces of make(), sized in init() so that a cycle does not
+     * allocate.
+     */
+    CorrectionInput_t m_input;
+    Pair_t<arma::vec> m_CMout;  /**< @brief Corrector values computed in make() */
+    Logger::StageTimes_t m_times; /**< @brief Duration of the stages of the cycle */
+    Logger::StageCounters_t m_counters; /**< @brief Performance counters of the stages of the cycle */
+
+    /**
+     * @brief Performance counters of the correction thread, opened by the
+     * first make() if PerfCounters is enabled.
+     */
+    PerfCounters::Group m_perfGroup;
+
+    /**
+     * @brief Timers of make() and of its stages, registered in the constructor.
+     */
+    struct {
+        TimerId make;
+        TimerId acquisition;
+        TimerId computation;
+        TimerId output;
+    } m_timers;
 
     RFM2G_UINT32 m_DACout[DAC_BUFFER_SIZE];
 };
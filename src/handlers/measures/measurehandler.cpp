@@ -22,6 +22,8 @@
 #include "dac.h"
 #include "dma.h"
 #include "handlers/structures.h"
+#include "modules/latency.h"
+#include "modules/timers.h"
 #include "modules/zmq/logger.h"
 
 #include <iostream>
@@ -69,8 +71,9 @@ int MeasureHandler::typeCorrection()
 int MeasureHandler::callProcessorRoutine(const CorrectionInput_t& input,
                                          arma::vec& CMx, arma::vec& CMy)
 {
-
+    uint64_t computeStart = TimingModule::now();
     int error = this->callPythonFunction(input.diff.x, input.diff.x, CMx, CMy);
+    Latency::record(Latency::Stage::Compute, TimingModule::now() - computeStart);
 
     // Add to init values
     CMx += m_CM.x;
@@ -79,7 +82,7 @@ int MeasureHandler::callProcessorRoutine(const CorrectionInput_t& input,
     return error;
 }
 
-void MeasureHandler::setProcessor(arma::mat SmatX, arma::mat SmatY,
+int MeasureHandler::setProcessor(arma::mat SmatX, arma::mat SmatY,
                                   double IvecX, double IvecY,
                                   double Frequency,
                                   double P, double I, double D,
@@ -93,7 +96,9 @@ void MeasureHandler::setProcessor(arma::mat SmatX, arma::mat SmatY,
     std::cout << m_CM.x[1] << '\n';
     if (errorPythonInit) {
         Logger::error(_ME_) << "error";
+        return Error::Unkonwn;
     }
+    return 0;
 }
 
 /**
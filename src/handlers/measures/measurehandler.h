@@ -75,8 +75,10 @@ public:
 private:
     /**
      * @brief Set the processor, here Python.
+     *
+     * @return Error::Unkonwn if Python cannot be initialized, else 0.
      */
-    virtual void setProcessor(arma::mat SmatX, arma::mat SmatY,
+    virtual int setProcessor(arma::mat SmatX, arma::mat SmatY,
                               double IvecX, double IvecY,
                               double Frequency,
                               double P, double I, double D,
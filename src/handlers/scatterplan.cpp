@@ -0,0 +1,72 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "handlers/scatterplan.h"
+
+#include "handlers/handler.h"
+#include "modules/zmq/logger.h"
+
+ScatterPlan::ScatterPlan()
+    : m_saturatedCount(0)
+{
+}
+
+int ScatterPlan::compile(const std::vector<double>& waveIndex, const arma::vec& scale)
+{
+    m_index.clear();
+    m_scale.clear();
+    m_saturatedCount = 0;
+
+    int size = waveIndex.size();
+    if (scale.n_elem != size) {
+        Logger::error(_ME_) << "Scatter plan: " << size << " correctors but "
+                            << scale.n_elem << " scales";
+        return 1;
+    }
+    for (int i = 0 ; i < size ; i++) {
+        int position = static_cast<int>(waveIndex[i]) - 1;
+        if ((position < 0) || (position >= DAC_BUFFER_SIZE)) {
+            Logger::error(_ME_) << "Scatter plan: corrector " << i << " is out of the DAC buffer";
+            m_index.clear();
+            m_scale.clear();
+            return 1;
+        }
+        m_index.push_back(position);
+        m_scale.push_back(scale(i));
+    }
+    return 0;
+}
+
+int ScatterPlan::apply(const arma::vec& CM, RFM2G_UINT32* DACout)
+{
+    const int size = m_index.size();
+    const int* __restrict index = m_index.data();
+    const double* __restrict scale = m_scale.data();
+    const double* __restrict cm = CM.memptr();
+    const double max = maxDigits;
+
+    int saturated = 0;
+    for (int i = 0 ; i < size ; i++) {
+        double value = cm[i] * scale[i] + numbers::halfDigits;
+        saturated += (value < 0) | (value > max);
+        value = (value < 0) ? 0 : value;
+        value = (value > max) ? max : value;
+        DACout[index[i]] = static_cast<RFM2G_UINT32>(value);
+    }
+    m_saturatedCount += saturated;
+    return saturated;
+}
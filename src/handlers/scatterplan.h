@@ -0,0 +1,91 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SCATTERPLAN_H
+#define SCATTERPLAN_H
+
+#include "define.h"
+
+#include <armadillo>
+#include <vector>
+
+/**
+ * @brief Plan to write the corrector values of one axis into the DAC buffer.
+ *
+ * The DAC positions and the scales (digits per unit) are compiled once in
+ * Handler::init(). Each cycle then needs one pass over the correctors:
+ *
+ *     DAC[index[i]] = saturate(CM[i] * scale[i] + halfDigits)
+ *
+ * where the value is saturated to the 24-bit range of the DAC. The number of
+ * saturated values is counted.
+ *
+ * \code{.cpp}
+ * ScatterPlan plan;
+ * plan.compile(DAC_WaveIndexX, scaleDigitsX);
+ * plan.apply(CMx, DACout);
+ * \endcode
+ */
+class ScatterPlan
+{
+public:
+    /**
+     * @brief Greatest value accepted by the DAC (24 bits).
+     */
+    static const RFM2G_UINT32 maxDigits = (1 << 24) - 1;
+
+    /**
+     * @brief Constructor. The plan is empty until compile() is called.
+     */
+    explicit ScatterPlan();
+
+    /**
+     * @brief Build the plan and reset the counters.
+     *
+     * @param waveIndex Position (1-based) of each corrector in the DAC buffer
+     * @param scale Digits per unit of each corrector
+     * @return Error code: 1 if the sizes do not match or a position is out
+     *         of the DAC buffer, else 0.
+     */
+    int compile(const std::vector<double>& waveIndex, const arma::vec& scale);
+
+    /**
+     * @brief Scale, saturate and scatter the corrector values.
+     *
+     * @param[in] CM Corrector values, size() elements
+     * @param[out] DACout DAC buffer (DAC_BUFFER_SIZE values)
+     * @return Number of values saturated during this call.
+     */
+    int apply(const arma::vec& CM, RFM2G_UINT32* DACout);
+
+    /**
+     * @brief Number of correctors in the plan.
+     */
+    int size() const { return m_index.size(); }
+
+    /**
+     * @brief Number of values saturated since compile().
+     */
+    unsigned long saturatedCount() const { return m_saturatedCount; }
+
+private:
+    std::vector<int> m_index;    /**< @brief Position of each corrector in the DAC buffer */
+    std::vector<double> m_scale; /**< @brief Digits per unit of each corrector */
+    unsigned long m_saturatedCount; /**< @brief Values saturated since compile() */
+};
+
+#endif // SCATTERPLAN_H
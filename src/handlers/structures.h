@@ -18,6 +18,8 @@
 #ifndef STRUCTURES_H
 #define STRUCTURES_H
 
+#include "define.h"
+
 #include <armadillo>
 
 /**
@@ -35,7 +37,7 @@ struct CorrectionInput_t {
     Pair_t<arma::vec> diff; /**< @brief Differential orbit */
     bool newInjection; /**< @brief Is there a new injection? */
     int typeCorr; /**< @brief Type of correction to apply */
-    double value10Hz; /**< @brief Last current value of the 10Hz magnet */
+    const RFM2G_INT16* adcBuffer; /**< @brief ADC buffer of the cycle (references of the harmonics) */
 };
 
 #endif //STRUCTURES_H
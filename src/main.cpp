@@ -23,6 +23,11 @@
 
 #include "define.h"
 #include "mbox.h"
+#include "handlers/handler.h"
+#include "modules/latency.h"
+#include "modules/perfcounters.h"
+#include "modules/trace.h"
+#include "modules/zmq/asyncbackend.h"
 #include "modules/zmq/logger.h"
 #include "modules/zmq/messenger.h"
 #include "modules/timers.h"
@@ -33,6 +38,11 @@ bool READONLY; /**< Global variable to authorize or not to write to the RFM */
 zmq::context_t context(1); /**< ZMQ Context */
 /** Global socket used for the logging */
 zmq_ext::socket_t logSocket(context, ZMQ_PUB /*zmq::socket_type::pub*/);
+/**
+ * @brief Thread sending the logs on logSocket.
+ * @note Defined between logSocket and mbox: stopped after the mBox, before the socket.
+ */
+Logger::AsyncBackend logBackend;
 namespace TimingModule{
 TimerList tm;
 }
@@ -68,6 +78,11 @@ int main(int argc, char *argv[])
     mbox.parseArgs(argc, argv);
 
     Logger::setSocket(&logSocket);
+    logBackend.addPeriodicTask(Handler::publishSaturation, std::chrono::seconds(1));
+    logBackend.addPeriodicTask(Latency::publish, std::chrono::seconds(1));
+    logBackend.addPeriodicTask(PerfCounters::publish, std::chrono::seconds(1));
+    logBackend.addPeriodicTask(Trace::writeRequestedDump, std::chrono::milliseconds(100));
+    logBackend.start();
     // Wait to be sure that the socket is configured
     std::this_thread::sleep_for(std::chrono::seconds(1));
 
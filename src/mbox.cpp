@@ -19,23 +19,38 @@
 
 #include "mbox.h"
 
+#include <cstring>
 #include <iostream>
 #include <chrono>
 #include <thread>
+#include <unistd.h>
 
 #include "adc.h"
+#include "controlwatcher.h"
 #include "dac.h"
 #include "dma.h"
 #include "rfmdriver.h"
 #include "rfm_helper.h"
+#include "rfmbenchmark.h"
 #include "handlers/correction/correctionhandler.h"
 #include "handlers/measures/measurehandler.h"
+#include "modules/zmq/asyncbackend.h"
 #include "modules/zmq/logger.h"
 #include "modules/zmq/messenger.h"
+#include "modules/zmq/telemetry.h"
+#include "modules/alloccounter.h"
+#include "modules/flightrecorder.h"
+#include "modules/perfcounters.h"
+#include "modules/realtime.h"
 #include "modules/timers.h"
+#include "modules/trace.h"
 
 mBox::mBox()
-    : m_dma(NULL)
+    : m_pipelined(false)
+    , m_mappedPio(true)
+    , m_watcher(NULL)
+    , m_recorder(NULL)
+    , m_dma(NULL)
     , m_driver(NULL)
     , m_handler(NULL)
 {
@@ -43,6 +58,8 @@ mBox::mBox()
 
 mBox::~mBox()
 {
+    delete m_watcher;
+    delete m_recorder;
     delete m_handler,
            m_dma,
            m_driver;
@@ -63,6 +80,23 @@ void mBox::init(const char* deviceName, const bool weightedCorr)
         Logger::error(_ME_) << "DMA Error .... Quit";
         exit(res);
     }
+    if (m_mappedPio && (m_dma->pioWindow() != NULL)) {
+        // The window bypasses the byte swapping of the driver
+        RFM2G_BOOL byteSwap = RFM2G_TRUE;
+        RFM2G_STATUS swapError = m_driver->getPIOByteSwap(&byteSwap);
+        if (swapError) {
+            Logger::error(_ME_) << "Cannot read the PIO byte swapping, no mapped PIO: "
+                                << m_driver->errorMsg(swapError);
+        } else if (byteSwap) {
+            Logger::Logger() << "PIO byte swapping enabled: no mapped PIO";
+        } else {
+            m_driver->window().map(m_dma->pioWindow(), m_dma->pioSize());
+        }
+    }
+    // Before the ADC and DAC are created: they choose their transfer from it
+    RFMBenchmark benchmark(m_driver, m_dma);
+    benchmark.run();
+    benchmark.configure();
     Logger::Logger logger;
     logger.setRFM(m_driver);
 
@@ -71,6 +105,26 @@ void mBox::init(const char* deviceName, const bool weightedCorr)
     } else {
         m_handler = new CorrectionHandler(m_driver, m_dma, weightedCorr);
     }
+    m_handler->setPipelined(m_pipelined);
+    m_watcher = new ControlWatcher(m_driver);
+
+    if (FlightRecorder::config().enabled) {
+        m_recorder = new FlightRecorder();
+        if (int error = m_recorder->open()) {
+            Logger::error(_ME_) << "Cannot open the flight recorder " << FlightRecorder::config().path
+                                << ": " << std::strerror(error);
+            delete m_recorder;
+            m_recorder = NULL;
+        } else {
+            m_recorder->start();
+        }
+    }
+    Logger::Logger() << "Timer overhead (start + stop): " << TimingModule::measureOverhead() << " ns";
+    if (Trace::config().enabled) {
+        Trace::start();
+        Messenger::addEditableKey("TRACE-DUMP", 0);
+        Messenger::addListener("TRACE-DUMP", []() { Trace::requestDump(Trace::Request::Client); });
+    }
     Messenger::messenger.startServing();
 }
 
@@ -78,17 +132,30 @@ void mBox::startLoop()
 {
     Logger::Logger() << "...Wait for start...";
     std::cout << "...Wait for start... \n";
+    m_watcher->start();
+
+    RealTime::moveToHousekeeping(Messenger::messenger.serverThread(), "Messenger");
+    RealTime::moveToHousekeeping(m_watcher->thread(), "Control watcher");
+    if (m_recorder != NULL) {
+        RealTime::moveToHousekeeping(m_recorder->thread(), "Flight recorder");
+    }
+    if (Logger::AsyncBackend* backend = Logger::AsyncBackend::instance()) {
+        RealTime::moveToHousekeeping(backend->thread(), "Logger");
+    }
+    RealTime::enterRealTime();
+    Trace::nameThread("Correction loop");
+    // The logs of the loop only go through lock-free rings
+    Logger::AsyncBackend::setHotThread();
+
     for(;;) {
-        m_driver->read(CTRL_MEMPOS, &m_mBoxStatus, 1);
+        m_mBoxStatus = m_watcher->status();
 
         if (m_mBoxStatus == Status::RestartedThing) {
             std::cout << "  !!! MDIZ4T4R was restarted !!! ... Wait for initialization \n";
             Logger::postError(Error::ADCReset);
 
-            while (m_mBoxStatus != Status::Idle) {
-                m_driver->read(CTRL_MEMPOS , &m_mBoxStatus, 1);
-                sleep(1);
-            }
+            m_watcher->waitFor(Status::Idle);
+            m_mBoxStatus = m_watcher->status();
             Logger::Logger() << "...Wait for start...";
         }
 
@@ -101,19 +168,32 @@ void mBox::startLoop()
          * Initialize correction
          */
         if ((m_mBoxStatus == Status::Running) && (m_currentState == State::Preinit)) {
-            m_handler->init();
-            std::this_thread::sleep_for(std::chrono::nanoseconds(4000000));
-            m_currentState = State::Initialized;
+            m_dma->status()->errornr = m_handler->init();
+            if (m_dma->status()->errornr) {
+                // Do not correct: wait until the cBox stops and restarts
+                m_currentState = State::Error;
+                Logger::postError(m_dma->status()->errornr);
+                Logger::error(_ME_) << Logger::errorMessage(m_dma->status()->errornr);
+            } else {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(4000000));
+                m_currentState = State::Initialized;
 
-            Logger::Logger() << "mBox running";
-            Logger::Logger().sendMessage("FOFB mBox++ started");
+                Logger::Logger() << "mBox running";
+                Logger::Logger().sendMessage("FOFB mBox++ started");
+            }
+            if (!READONLY) {
+                m_driver->write(STATUS_MEMPOS, m_dma->status(), sizeof(t_status));
+            }
         }
 
         /**
          * Read and correct
          */
         if ((m_mBoxStatus == Status::Running) && (m_currentState == State::Initialized)) {
-            if (m_dma->status()->errornr = m_handler->make()) {
+            unsigned long allocations = AllocCounter::count();
+            m_dma->status()->errornr = m_handler->make();
+            AllocCounter::addCycle(AllocCounter::count() - allocations);
+            if (m_dma->status()->errornr) {
                 m_currentState = State::Error;
                 Logger::postError(m_dma->status()->errornr);
                 Logger::error(_ME_) << Logger::errorMessage(m_dma->status()->errornr);
@@ -136,7 +216,14 @@ void mBox::startLoop()
         }
 
         TimingModule::printAll(Timer::Unit::ms, 1000);
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        AllocCounter::printAll(1000);
+
+        // While correcting, make() is called back-to-back: it already blocks
+        // on the ADC event. Else nothing happens before the cBox changes the
+        // control word.
+        if ((m_mBoxStatus != Status::Running) || (m_currentState != State::Initialized)) {
+            m_watcher->waitForChange(m_mBoxStatus, std::chrono::milliseconds(100));
+        }
     }
 }
 
@@ -193,6 +280,7 @@ void mBox::parseArgs(int argc, char* argv[])
         startError();
     }
     Logger::Logger logger;
+    bool aggregationsSet = false;
     for (int i=1; i < argc ; i++) {
         if (!std::string(argv[i]).compare("--debug")) {
             logger.setDebug(true);
@@ -210,8 +298,63 @@ void mBox::parseArgs(int argc, char* argv[])
                 std::cout << "A port should be given (1000 to 65535), different from logport.\n";
                 exit(-1);
             }
+        } else if (!std::string(argv[i]).compare("--pipelined")) {
+            m_pipelined = true;
+        } else if (!std::string(argv[i]).compare("--no-mapped-pio")) {
+            m_mappedPio = false;
+        } else if (!std::string(argv[i]).compare("--realtime")) {
+            RealTime::config().enabled = true;
+        } else if (!std::string(argv[i]).compare("--rt-priority")) {
+            if ((i+1 < argc) && atoi(argv[i+1]) > 0 && atoi(argv[i+1]) < 100) {
+                RealTime::config().priority = atoi(argv[i+1]);
+            } else {
+                std::cout << "A priority should be given (1 to 99)\n";
+                exit(-1);
+            }
+        } else if (!std::string(argv[i]).compare("--no-raw-frames")) {
+            Logger::telemetryConfig().rawFrames = false;
+        } else if (!std::string(argv[i]).compare("--aggregate")) {
+            if ((i+1 < argc) && atoi(argv[i+1]) > 0) {
+                if (!aggregationsSet) {
+                    Logger::telemetryConfig().aggregations.clear();
+                    aggregationsSet = true;
+                }
+                Logger::telemetryConfig().aggregations.push_back(atoi(argv[i+1]));
+            } else {
+                std::cout << "A number of cycles should be given (> 0)\n";
+                exit(-1);
+            }
+        } else if (!std::string(argv[i]).compare("--recorder")) {
+            if (i+1 < argc) {
+                FlightRecorder::config().path = argv[i+1];
+            } else {
+                std::cout << "A file should be given\n";
+                exit(-1);
+            }
+        } else if (!std::string(argv[i]).compare("--no-recorder")) {
+            FlightRecorder::config().enabled = false;
+        } else if (!std::string(argv[i]).compare("--perf-counters")) {
+            PerfCounters::config().enabled = true;
+        } else if (!std::string(argv[i]).compare("--trace")) {
+            if (i+1 < argc) {
+                Trace::config().enabled = true;
+                Trace::config().path = argv[i+1];
+            } else {
+                std::cout << "A file prefix should be given\n";
+                exit(-1);
+            }
+        } else if (!std::string(argv[i]).compare("--rt-cpu")) {
+            if ((i+1 < argc) && atoi(argv[i+1]) >= 0 && atoi(argv[i+1]) < sysconf(_SC_NPROCESSORS_ONLN)) {
+                RealTime::config().cpu = atoi(argv[i+1]);
+            } else {
+                std::cout << "A valid CPU number should be given\n";
+                exit(-1);
+            }
         }
     }
+    if (RealTime::config().enabled) {
+        startflag += " [REAL-TIME]";
+    }
     std::string startMessage = "Starting the mBox " + startflag;
     std::cout << std::string(startMessage.size(),'=') << '\n'
               << startMessage << '\n'
@@ -249,5 +392,41 @@ void mBox::printHelp()
               << "--logport <PORT>\n"
               << "     Which port the log publisher should use.\n"
               << "--queryport <PORT>\n"
-              << "     Which port the query messenger should use.\n\n";
+              << "     Which port the query messenger should use.\n"
+              << "--pipelined\n"
+              << "     Collect the DAC acknowledgements while the next ADC event\n"
+              << "     is already awaited.\n"
+              << "--no-mapped-pio\n"
+              << "     Do not read/write the RFM through the mapped PIO window:\n"
+              << "     every transfer is done by the driver. By default, a\n"
+              << "     benchmark at startup chooses the way of each size.\n"
+              << "--realtime\n"
+              << "     Run the correction loop with SCHED_FIFO, pinned to one CPU,\n"
+              << "     with locked and pre-faulted memory. The other threads are\n"
+              << "     moved to the other CPUs.\n"
+              << "--rt-priority <PRIORITY>\n"
+              << "     SCHED_FIFO priority in real-time mode (1 to 99, default 80).\n"
+              << "--rt-cpu <CPU>\n"
+              << "     CPU of the correction loop in real-time mode (default: last).\n"
+              << "--aggregate <CYCLES>\n"
+              << "     Publish the mean/min/max/RMS of the BPM and CM values over\n"
+              << "     <CYCLES> cycles on FOFB-AGG-<CYCLES>. Can be repeated\n"
+              << "     (default: --aggregate 15 --aggregate 150).\n"
+              << "--no-raw-frames\n"
+              << "     Do not publish the FOFB-FRAME telemetry frame of each cycle.\n"
+              << "--recorder <FILE>\n"
+              << "     Ring file of the flight recorder, which keeps the last cycles\n"
+              << "     and saves them in <FILE>.<DATE>.snapshot on error. It should\n"
+              << "     be on a tmpfs (default: /dev/shm/mbox-flightrecorder.rec).\n"
+              << "--no-recorder\n"
+              << "     Disable the flight recorder.\n"
+              << "--perf-counters\n"
+              << "     Count the cycles, instructions, cache misses, page faults and\n"
+              << "     context switches of each stage (perf_event_open). Sent in the\n"
+              << "     telemetry frames and summed up in PERF-<STAGE>.\n"
+              << "--trace <PREFIX>\n"
+              << "     Record the steps of each thread (timers, stages, RFM calls)\n"
+              << "     and dump the last ones as a Chrome trace in\n"
+              << "     <PREFIX>.<DATE>.json on error or when TRACE-DUMP is set\n"
+              << "     (e.g. --trace /tmp/mbox-trace).\n\n";
 }
@@ -21,6 +21,8 @@
 #include <armadillo>
 #include "define.h"
 
+class ControlWatcher;
+class FlightRecorder;
 class Handler;
 class RFMDriver;
 class RFMHelper;
@@ -107,6 +109,17 @@ private:
      */
     std::string m_inputFile;
 
+    /**
+     * @brief Collect the DAC acknowledgements asynchronously (--pipelined).
+     */
+    bool m_pipelined;
+
+    /**
+     * @brief Serve the small RFM transfers from the mapped PIO window
+     * (disabled by --no-mapped-pio).
+     */
+    bool m_mappedPio;
+
     /**
      * @brief Current state of the mBox (state machine).
      */
@@ -116,6 +129,16 @@ private:
      * @brief Status of the mBox (Running? Idle? ...).
      */
     Status m_mBoxStatus;
+
+    /**
+     * @brief Watcher of the control word: gives m_mBoxStatus without RFM access.
+     */
+    ControlWatcher *m_watcher;
+
+    /**
+     * @brief Recorder of the cycles (nullptr if disabled or if it cannot be opened).
+     */
+    FlightRecorder *m_recorder;
     DMA *m_dma;
     Handler *m_handler;
     RFMDriver *m_driver;
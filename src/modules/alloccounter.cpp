@@ -0,0 +1,140 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "modules/alloccounter.h"
+
+#include "config.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+namespace {
+    /**
+     * @brief Allocations done by the current thread.
+     */
+    thread_local unsigned long t_allocations = 0;
+
+    unsigned long s_cycles = 0;
+    unsigned long s_allocatingCycles = 0;
+    unsigned long s_total = 0;
+    unsigned long s_max = 0;
+}
+
+#ifdef ALLOC_COUNTER
+// Linked with -Wl,--wrap=malloc,... : every call to malloc() in the
+// executable lands in __wrap_malloc(), __real_malloc() is the libc one.
+extern "C" {
+    void* __real_malloc(size_t size);
+    void* __real_calloc(size_t nmemb, size_t size);
+    void* __real_realloc(void* ptr, size_t size);
+    int __real_posix_memalign(void** memptr, size_t alignment, size_t size);
+
+    void* __wrap_malloc(size_t size)
+    {
+        ++t_allocations;
+        return __real_malloc(size);
+    }
+
+    void* __wrap_calloc(size_t nmemb, size_t size)
+    {
+        ++t_allocations;
+        return __real_calloc(nmemb, size);
+    }
+
+    void* __wrap_realloc(void* ptr, size_t size)
+    {
+        ++t_allocations;
+        return __real_realloc(ptr, size);
+    }
+
+    int __wrap_posix_memalign(void** memptr, size_t alignment, size_t size)
+    {
+        ++t_allocations;
+        return __real_posix_memalign(memptr, alignment, size);
+    }
+}
+
+void* operator new(std::size_t size)
+{
+    ++t_allocations;
+    void* ptr = __real_malloc(size ? size : 1);
+    if (ptr == NULL) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](std::size_t size)
+{
+    return ::operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+#endif
+
+bool AllocCounter::enabled()
+{
+#ifdef ALLOC_COUNTER
+    return true;
+#else
+    return false;
+#endif
+}
+
+unsigned long AllocCounter::count()
+{
+    return t_allocations;
+}
+
+void AllocCounter::addCycle(unsigned long allocations)
+{
+    if (!enabled()) {
+        return;
+    }
+    s_cycles++;
+    s_total += allocations;
+    if (allocations > 0) {
+        s_allocatingCycles++;
+    }
+    if (allocations > s_max) {
+        s_max = allocations;
+    }
+}
+
+void AllocCounter::printAll(unsigned long period)
+{
+    if (!enabled() || (s_cycles < period)) {
+        return;
+    }
+    std::cout << "==================" << '\n'
+              << " [Allocations]\t"
+              << "Cycles: " << s_cycles << " -- "
+              << "Allocating: " << s_allocatingCycles << " -- "
+              << "Max: " << s_max << " -- "
+              << "Mean: " << static_cast<double>(s_total)/s_cycles << '\n'
+              << "==================" << '\n';
+    s_cycles = s_allocatingCycles = s_total = s_max = 0;
+}
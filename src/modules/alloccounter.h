@@ -0,0 +1,64 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ALLOCCOUNTER_H
+#define ALLOCCOUNTER_H
+
+/**
+ * @brief Namespace to count the heap allocations of the correction loop.
+ *
+ * The correction cycle must not allocate once it is initialized: every
+ * workspace is sized in Handler::init(). This counter is a debug tool to
+ * check it. It is only active when the project is configured with
+ * `-DALLOC_COUNTER=ON`: `operator new` is replaced and `malloc`, `calloc`,
+ * `realloc` and `posix_memalign` are wrapped at link time, so that each
+ * thread counts its own allocations. Else all functions are no-ops.
+ *
+ * Allocations done inside shared libraries (e.g. by libzmq) are not seen.
+ *
+ * \code{.cpp}
+ * unsigned long allocations = AllocCounter::count();
+ * handler->make();
+ * AllocCounter::addCycle(AllocCounter::count() - allocations);
+ * AllocCounter::printAll(1000);
+ * \endcode
+ */
+namespace AllocCounter {
+
+    /**
+     * @brief Is the counter compiled in?
+     */
+    bool enabled();
+
+    /**
+     * @brief Number of allocations done by the calling thread since it started.
+     */
+    unsigned long count();
+
+    /**
+     * @brief Record the number of allocations done during one cycle.
+     */
+    void addCycle(unsigned long allocations);
+
+    /**
+     * @brief Print the allocations per cycle and reset the statistics.
+     * @param period Number of recorded cycles before printing.
+     */
+    void printAll(unsigned long period);
+}
+
+#endif // ALLOCCOUNTER_H
@@ -0,0 +1,262 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "modules/flightrecorder.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+
+#include <fcntl.h>
+#include <linux/magic.h>
+#include <sys/mman.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
+#include "modules/zmq/logger.h"
+
+std::atomic<FlightRecorder*> FlightRecorder::s_instance(nullptr);
+
+namespace {
+    FlightRecorder::Config_t s_config = { true, "/dev/shm/mbox-flightrecorder.rec", 4096, 10.0 };
+
+    /**
+     * @brief Size of a slot: header, 4 arrays of doubles and the ADC buffer,
+     * rounded to a cache line.
+     */
+    const size_t SLOT_SIZE = (sizeof(RecorderSlot_t)
+                              + 4*ADC_BUFFER_SIZE*sizeof(double)
+                              + ADC_BUFFER_SIZE*sizeof(RFM2G_INT16) + 63) / 64 * 64;
+
+    /**
+     * @brief Copy at most ADC_BUFFER_SIZE values of `values` into the array
+     * number `index` of a slot.
+     *
+     * @return The number of values copied.
+     */
+    uint16_t copyValues(RecorderSlot_t* slot, int index, const arma::vec& values)
+    {
+        double* array = reinterpret_cast<double*>(slot + 1) + index*ADC_BUFFER_SIZE;
+        uint16_t size = std::min<int>(values.n_elem, ADC_BUFFER_SIZE);
+        memcpy(array, values.memptr(), size*sizeof(double));
+        return size;
+    }
+}
+
+FlightRecorder::Config_t& FlightRecorder::config()
+{
+    return s_config;
+}
+
+FlightRecorder::FlightRecorder()
+    : m_header(nullptr)
+    , m_fileSize(0)
+    , m_frozen(false)
+    , m_running(false)
+{
+    s_instance.store(this, std::memory_order_release);
+}
+
+FlightRecorder::~FlightRecorder()
+{
+    this->stop();
+    FlightRecorder* self = this;
+    s_instance.compare_exchange_strong(self, nullptr);
+    if (m_header != nullptr) {
+        munmap(m_header, m_fileSize);
+    }
+}
+
+int FlightRecorder::open()
+{
+    if (m_header != nullptr) {
+        return 0;
+    }
+    m_fileSize = sizeof(RecorderHeader_t) + s_config.slotCount*SLOT_SIZE;
+
+    int fd = ::open(s_config.path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return errno;
+    }
+    struct statfs filesystem;
+    if (!fstatfs(fd, &filesystem) && (filesystem.f_type != TMPFS_MAGIC)) {
+        Logger::error(_ME_) << "Flight recorder: " << s_config.path << " is not on a tmpfs, "
+                            << "the correction loop may wait for its writeback";
+    }
+    if (ftruncate(fd, m_fileSize)) {
+        int error = errno;
+        ::close(fd);
+        return error;
+    }
+    void* map = mmap(nullptr, m_fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int error = (map == MAP_FAILED) ? errno : 0;
+    ::close(fd);
+    if (error) {
+        return error;
+    }
+
+    // Allocate the blocks of the file and map every page now: record()
+    // must not fault
+    memset(map, 0, m_fileSize);
+    m_header = static_cast<RecorderHeader_t*>(map);
+    strncpy(m_header->magic, "FOFBREC", sizeof(m_header->magic));
+    m_header->version = RECORDER_VERSION;
+    m_header->headerSize = sizeof(RecorderHeader_t);
+    m_header->slotSize = SLOT_SIZE;
+    m_header->slotCount = s_config.slotCount;
+    m_header->valueSize = ADC_BUFFER_SIZE;
+    for (uint64_t n = 0 ; n < s_config.slotCount ; n++) {
+        this->slot(n)->sequence = UINT64_MAX;
+    }
+
+    Logger::Logger() << "Flight recorder: " << s_config.slotCount << " cycles in " << s_config.path;
+    return 0;
+}
+
+void FlightRecorder::start()
+{
+    if (m_running || (m_header == nullptr)) {
+        return;
+    }
+    m_running = true;
+    m_thread = std::thread(&FlightRecorder::run, this);
+}
+
+void FlightRecorder::stop()
+{
+    if (!m_running) {
+        return;
+    }
+    m_running = false;
+    m_thread.join();
+}
+
+RecorderSlot_t* FlightRecorder::slot(uint64_t n) const
+{
+    unsigned char* first = reinterpret_cast<unsigned char*>(m_header) + sizeof(RecorderHeader_t);
+    return reinterpret_cast<RecorderSlot_t*>(first + (n % m_header->slotCount)*SLOT_SIZE);
+}
+
+void FlightRecorder::record(int loopPos, unsigned int errornr, const Logger::StageTimes_t& times,
+                            const arma::vec& diffX, const arma::vec& diffY,
+                            const arma::vec& CMx, const arma::vec& CMy,
+                            const RFM2G_INT16* adc, int adcSize)
+{
+    FlightRecorder* recorder = instance();
+    if ((recorder == nullptr) || (recorder->m_header == nullptr)
+            || recorder->m_frozen.load(std::memory_order_acquire)) {
+        return;
+    }
+    RecorderHeader_t* header = recorder->m_header;
+    uint64_t n = header->written;
+    RecorderSlot_t* slot = recorder->slot(n);
+
+    // A reader of the file sees the slot as invalid until it is complete
+    slot->sequence = UINT64_MAX;
+    std::atomic_thread_fence(std::memory_order_release);
+
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    slot->timestamp = static_cast<uint64_t>(now.tv_sec)*1000000000 + now.tv_nsec;
+    slot->loopPos = loopPos;
+    slot->errorCode = errornr;
+    slot->times = times;
+    slot->nbBPMx = copyValues(slot, 0, diffX);
+    slot->nbBPMy = copyValues(slot, 1, diffY);
+    slot->nbCMx = copyValues(slot, 2, CMx);
+    slot->nbCMy = copyValues(slot, 3, CMy);
+    slot->nbADC = std::min(adcSize, ADC_BUFFER_SIZE);
+    RFM2G_INT16* adcArray = reinterpret_cast<RFM2G_INT16*>(reinterpret_cast<double*>(slot + 1) + 4*ADC_BUFFER_SIZE);
+    memcpy(adcArray, adc, slot->nbADC*sizeof(RFM2G_INT16));
+
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->sequence = n;
+    header->written = n + 1;
+}
+
+void FlightRecorder::freeze(unsigned int errornr)
+{
+    FlightRecorder* recorder = instance();
+    if ((recorder == nullptr) || (recorder->m_header == nullptr)
+            || recorder->m_frozen.load(std::memory_order_acquire)) {
+        return;
+    }
+    RecorderHeader_t* header = recorder->m_header;
+    header->frozen = 1;
+    header->errorCode = errornr;
+    header->frozenAt = header->written;
+    recorder->m_frozen.store(true, std::memory_order_release);
+}
+
+void FlightRecorder::snapshot()
+{
+    uint64_t written = m_header->written;
+    if (written == 0) {
+        Logger::Logger() << "Flight recorder: nothing recorded, no snapshot";
+        return;
+    }
+
+    // Go back from the last record for snapshotSeconds, or through the ring
+    uint64_t last = written - 1;
+    uint64_t available = std::min<uint64_t>(written, m_header->slotCount);
+    uint64_t duration = s_config.snapshotSeconds*1e9;
+    uint64_t lastTime = this->slot(last)->timestamp;
+    uint64_t first = last;
+    while ((last - first + 1 < available)
+           && (this->slot(first - 1)->sequence == first - 1)
+           && (lastTime - this->slot(first - 1)->timestamp <= duration)) {
+        first--;
+    }
+    uint32_t count = last - first + 1;
+
+    char date[32];
+    std::time_t now = std::time(nullptr);
+    strftime(date, sizeof(date), "%Y%m%d-%H%M%S", std::localtime(&now));
+    std::string filename = s_config.path + '.' + date + ".snapshot";
+
+    // The slots keep their record numbers: written stays one after the last
+    RecorderHeader_t header = *m_header;
+    header.slotCount = count;
+    header.written = last + 1;
+
+    std::ofstream file(filename, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(RecorderHeader_t));
+    for (uint64_t n = first ; n <= last ; n++) {
+        file.write(reinterpret_cast<const char*>(this->slot(n)), SLOT_SIZE);
+    }
+    file.close();
+    if (!file) {
+        Logger::error(_ME_) << "Flight recorder: cannot write " << filename;
+        return;
+    }
+    Logger::Logger() << "Flight recorder: " << count << " cycles saved in " << filename;
+}
+
+void FlightRecorder::run()
+{
+    while (m_running.load(std::memory_order_acquire)) {
+        if (m_frozen.load(std::memory_order_acquire)) {
+            this->snapshot();
+            m_header->frozen = 0;
+            m_frozen.store(false, std::memory_order_release);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
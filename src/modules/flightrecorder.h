@@ -0,0 +1,210 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLIGHTRECORDER_H
+#define FLIGHTRECORDER_H
+
+#include <armadillo>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "define.h"
+#include "rfmdriver.h"
+#include "modules/zmq/telemetry.h"
+
+/**
+ * @brief Version of the flight recorder file layout.
+ */
+const uint16_t RECORDER_VERSION = 1;
+
+/**
+ * @brief Header of a flight recorder file (ring or snapshot).
+ *
+ * It is followed by `slotCount` slots of `slotSize` bytes. Each slot is a
+ * RecorderSlot_t followed by diffX, diffY, CMx, CMy (`valueSize` doubles each)
+ * and the ADC buffer (`valueSize` shorts); only the first nbXXX values are
+ * meaningful.
+ *
+ * In the ring file, the record number n is in the slot n % slotCount. In a
+ * snapshot, the slots are in chronological order and keep their record
+ * numbers: `written` is the number of the last one plus 1.
+ */
+struct RecorderHeader_t {
+    char magic[8];       /**< @brief "FOFBREC" */
+    uint16_t version;    /**< @brief RECORDER_VERSION */
+    uint16_t headerSize; /**< @brief Offset of the first slot */
+    uint32_t slotSize;   /**< @brief Size of a slot */
+    uint32_t slotCount;  /**< @brief Number of slots */
+    uint32_t valueSize;  /**< @brief Maximum number of values per array */
+    uint64_t written;    /**< @brief Number of records written since the start */
+    uint32_t frozen;     /**< @brief 1 while a snapshot is being taken */
+    uint32_t errorCode;  /**< @brief Error of the last freeze */
+    uint64_t frozenAt;   /**< @brief `written` at the last freeze */
+    uint64_t reserved[2]; /**< @brief 0 */
+};
+
+static_assert(sizeof(RecorderHeader_t) == 64, "The flight recorder layout changed: increase RECORDER_VERSION");
+
+/**
+ * @brief Header of a slot of the flight recorder.
+ */
+struct RecorderSlot_t {
+    uint64_t sequence;   /**< @brief Record number (UINT64_MAX while it is written) */
+    uint64_t timestamp;  /**< @brief CLOCK_MONOTONIC, in ns */
+    int32_t loopPos;     /**< @brief Loop position */
+    uint32_t errorCode;  /**< @brief Error returned by the cycle (see Error::ErrorCode) */
+    Logger::StageTimes_t times; /**< @brief Duration of the stages (0 if not reached) */
+    uint16_t nbBPMx;     /**< @brief Number of diffX values */
+    uint16_t nbBPMy;     /**< @brief Number of diffY values */
+    uint16_t nbCMx;      /**< @brief Number of CMx values */
+    uint16_t nbCMy;      /**< @brief Number of CMy values */
+    uint16_t nbADC;      /**< @brief Number of ADC values */
+    uint16_t reserved;   /**< @brief 0 */
+};
+
+static_assert(sizeof(RecorderSlot_t) == 48, "The flight recorder layout changed: increase RECORDER_VERSION");
+
+/**
+ * @brief Record every correction cycle in a memory-mapped ring file, and
+ * save the last seconds when an error occurs.
+ *
+ * The correction thread appends a record per cycle with record(): a few
+ * memcpy in a mapped file, prefaulted at open(), without lock nor system
+ * call. The file must be on a tmpfs (default: /dev/shm): on a disk, the
+ * writeback write-protects the pages it cleans and record() would then
+ * fault, and maybe wait for the filesystem. open() warns if it is not.
+ * The file outlives the process, so it can be read after a crash as well
+ * (but not after a reboot).
+ *
+ * Logger::postError() calls freeze(): the appends are suspended, and the
+ * thread of the recorder copies the last `snapshotSeconds` of records into
+ * `<path>.<date>.snapshot` before resuming. python_tools/flight_recorder.py
+ * reads both files.
+ *
+ * \code{.cpp}
+ * FlightRecorder recorder; // Registers itself
+ * if (!recorder.open()) {
+ *     recorder.start();
+ * }
+ * // In the correction thread
+ * FlightRecorder::record(loopPos, errornr, times, diffX, diffY, CMx, CMy, adc, size);
+ * // On error
+ * FlightRecorder::freeze(errornr);
+ * \endcode
+ */
+class FlightRecorder
+{
+public:
+    /**
+     * @brief Parameters of the flight recorder.
+     */
+    struct Config_t {
+        bool enabled;           /**< @brief Is the recorder requested? */
+        std::string path;       /**< @brief Ring file */
+        size_t slotCount;       /**< @brief Number of cycles in the ring */
+        double snapshotSeconds; /**< @brief Duration saved at each freeze */
+    };
+
+    /**
+     * @brief Access to the configuration (to be set before open()).
+     */
+    static Config_t& config();
+
+    /**
+     * @brief Constructor. Registers this recorder as the one used by
+     * record() and freeze().
+     */
+    FlightRecorder();
+
+    /**
+     * @brief Destructor. Stops the thread and unmaps the file.
+     */
+    ~FlightRecorder();
+
+    /**
+     * @brief Create the ring file, map and prefault it.
+     *
+     * @return 0 on success, else an errno value.
+     */
+    int open();
+
+    /**
+     * @brief Start the thread taking the snapshots.
+     */
+    void start();
+
+    /**
+     * @brief Stop and join the thread.
+     */
+    void stop();
+
+    /**
+     * @brief Access to the thread (e.g. to set its affinity).
+     */
+    std::thread& thread() { return m_thread; }
+
+    /**
+     * @brief Recorder used by record() and freeze() (nullptr if none).
+     */
+    static FlightRecorder* instance() { return s_instance.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Append the record of a cycle (correction thread only).
+     *
+     * Does nothing if there is no open recorder or while it is frozen.
+     */
+    static void record(int loopPos, unsigned int errornr, const Logger::StageTimes_t& times,
+                       const arma::vec& diffX, const arma::vec& diffY,
+                       const arma::vec& CMx, const arma::vec& CMy,
+                       const RFM2G_INT16* adc, int adcSize);
+
+    /**
+     * @brief Suspend the appends and request a snapshot.
+     *
+     * Ignored while a snapshot is being taken.
+     */
+    static void freeze(unsigned int errornr);
+
+private:
+    /**
+     * @brief Loop of the thread: wait for a freeze and take the snapshot.
+     */
+    void run();
+
+    /**
+     * @brief Save the last records into a snapshot file.
+     */
+    void snapshot();
+
+    /**
+     * @brief Slot of the record number `n`.
+     */
+    RecorderSlot_t* slot(uint64_t n) const;
+
+    static std::atomic<FlightRecorder*> s_instance; /**< @brief Recorder used by record() */
+
+    RecorderHeader_t* m_header; /**< @brief Mapped file (nullptr if not open) */
+    size_t m_fileSize; /**< @brief Size of the mapping */
+    std::atomic<bool> m_frozen; /**< @brief Are the appends suspended? */
+    std::atomic<bool> m_running; /**< @brief Whether the thread should keep running */
+    std::thread m_thread; /**< @brief Thread taking the snapshots */
+};
+
+#endif // FLIGHTRECORDER_H
@@ -0,0 +1,195 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "modules/latency.h"
+
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "modules/timers.h"
+#include "modules/trace.h"
+#include "modules/zmq/logger.h"
+#include "modules/zmq/messenger.h"
+
+namespace {
+    Latency::Histogram s_histograms[Latency::STAGE_NB];
+
+    /**
+     * @brief Number of snapshots kept: one per second, for the last minute.
+     */
+    const int SNAPSHOT_NB = 61;
+
+    /**
+     * @brief Snapshots of the counts since the start (SNAPSHOT_NB x
+     * STAGE_NB x BUCKET_NB), taken by publish().
+     */
+    std::vector<uint64_t> s_snapshots;
+    int s_published = 0; /**< @brief Number of snapshots taken */
+
+    /**
+     * @brief Counts of a stage in a snapshot.
+     */
+    uint64_t* snapshot(int index, int stage)
+    {
+        return s_snapshots.data() + ((index % SNAPSHOT_NB)*Latency::STAGE_NB + stage)*Latency::Histogram::BUCKET_NB;
+    }
+
+    /**
+     * @brief Count, p50, p99, p99.9 and max of a histogram.
+     */
+    void statistics(const uint64_t* counts, uint64_t* stats)
+    {
+        uint64_t total = 0;
+        int last = -1;
+        for (int i = 0 ; i < Latency::Histogram::BUCKET_NB ; i++) {
+            total += counts[i];
+            if (counts[i]) {
+                last = i;
+            }
+        }
+        stats[0] = total;
+        stats[1] = Latency::Histogram::percentile(counts, total, 0.5);
+        stats[2] = Latency::Histogram::percentile(counts, total, 0.99);
+        stats[3] = Latency::Histogram::percentile(counts, total, 0.999);
+        stats[4] = (last < 0) ? 0 : Latency::Histogram::highestValue(last);
+    }
+}
+
+Latency::Histogram::Histogram()
+{
+    for (int i = 0 ; i < BUCKET_NB ; i++) {
+        m_counts[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void Latency::Histogram::copy(uint64_t* counts) const
+{
+    for (int i = 0 ; i < BUCKET_NB ; i++) {
+        counts[i] = m_counts[i].load(std::memory_order_relaxed);
+    }
+}
+
+uint64_t Latency::Histogram::highestValue(int bucket)
+{
+    if (bucket < 2*SUB_COUNT) {
+        return bucket;
+    }
+    int exponent = bucket/SUB_COUNT + SUB_BITS - 1;
+    int shift = exponent - SUB_BITS;
+    uint64_t lowest = static_cast<uint64_t>(SUB_COUNT + bucket % SUB_COUNT) << shift;
+    return lowest + (static_cast<uint64_t>(1) << shift) - 1;
+}
+
+uint64_t Latency::Histogram::percentile(const uint64_t* counts, uint64_t total, double quantile)
+{
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = std::ceil(quantile*total);
+    uint64_t cumulated = 0;
+    for (int i = 0 ; i < BUCKET_NB ; i++) {
+        cumulated += counts[i];
+        if (cumulated >= rank) {
+            return highestValue(i);
+        }
+    }
+    return highestValue(BUCKET_NB - 1);
+}
+
+void Latency::record(Stage stage, uint64_t duration)
+{
+    s_histograms[static_cast<int>(stage)].record(duration);
+    if (Trace::recording.load(std::memory_order_relaxed)) {
+        Trace::addEvent('X', stageName(stage), duration);
+    }
+}
+
+const char* Latency::stageName(Stage stage)
+{
+    switch (stage) {
+    case Stage::ADCWait:
+        return "ADC-WAIT";
+    case Stage::ADCTransfer:
+        return "ADC-TRANSFER";
+    case Stage::Gather:
+        return "GATHER";
+    case Stage::Compute:
+        return "COMPUTE";
+    case Stage::DynamicCorrection:
+        return "DYNAMIC-CORRECTION";
+    case Stage::DACWrite:
+        return "DAC-WRITE";
+    case Stage::DACAck:
+        return "DAC-ACK";
+    default:
+        return "UNKNOWN";
+    }
+}
+
+void Latency::publish()
+{
+    const int bucketNb = Histogram::BUCKET_NB;
+    if (s_snapshots.empty()) {
+        s_snapshots.assign(SNAPSHOT_NB*STAGE_NB*bucketNb, 0);
+    }
+
+    // Windows: differences with the snapshots of 1 s and 1 min ago (or of
+    // the start, before)
+    int current = s_published;
+    int previous[WINDOW_NB - 1] = { current - 1, current - (SNAPSHOT_NB - 1) };
+    s_published++;
+
+    const size_t valueNb = STAGE_NB*WINDOW_NB*STAT_NB;
+    zmq::message_t message(sizeof(LatencyHeader_t) + valueNb*sizeof(uint64_t));
+    LatencyHeader_t* header = static_cast<LatencyHeader_t*>(message.data());
+    memset(header, 0, sizeof(LatencyHeader_t));
+    strncpy(header->topic, "FOFB-LATENCY", sizeof(header->topic));
+    header->version = LATENCY_VERSION;
+    header->headerSize = sizeof(LatencyHeader_t);
+    header->frameSize = message.size();
+    header->timestamp = TimingModule::now();
+    header->stageNb = STAGE_NB;
+    header->windowNb = WINDOW_NB;
+    header->statNb = STAT_NB;
+    uint64_t* values = reinterpret_cast<uint64_t*>(header + 1);
+
+    std::vector<uint64_t> window(bucketNb);
+    for (int stage = 0 ; stage < STAGE_NB ; stage++) {
+        uint64_t* counts = snapshot(current, stage);
+        s_histograms[stage].copy(counts);
+
+        uint64_t* stats = values + stage*WINDOW_NB*STAT_NB;
+        for (int w = 0 ; w < WINDOW_NB - 1 ; w++) {
+            const uint64_t* before = (previous[w] < 0) ? nullptr : snapshot(previous[w], stage);
+            for (int i = 0 ; i < bucketNb ; i++) {
+                window[i] = counts[i] - (before ? before[i] : 0);
+            }
+            statistics(window.data(), stats + w*STAT_NB);
+        }
+        statistics(counts, stats + (WINDOW_NB - 1)*STAT_NB);
+
+        arma::vec key(WINDOW_NB*STAT_NB);
+        for (int i = 0 ; i < WINDOW_NB*STAT_NB ; i++) {
+            key(i) = stats[i];
+        }
+        Messenger::updateMap(std::string("LATENCY-") + stageName(static_cast<Stage>(stage)), key);
+    }
+
+    Logger::Logger::sendZmqMessage(message);
+}
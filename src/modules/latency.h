@@ -0,0 +1,185 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Namespace for the latency histograms of the stages of a cycle.
+ *
+ * Each stage has a log-bucketed histogram (as HdrHistogram): the values below
+ * 32 ns have their own bucket, the others share a bucket with the values
+ * that have the same 5 most significant bits (relative error < 6.25%). A
+ * record is a count-leading-zeros, a shift and an increment, without lock:
+ * only the correction thread records.
+ *
+ * Once per second, publish() (run by the AsyncBackend thread) computes for
+ * the last second, the last minute and since the start the count, p50, p99,
+ * p99.9 and max of each stage. They are published:
+ *  * on the Messenger, as vectors LATENCY-<STAGE> (see publish());
+ *  * on FOFB-LATENCY (see LatencyHeader_t).
+ *
+ * \code{.cpp}
+ * uint64_t start = TimingModule::now();
+ * waitForEvent();
+ * Latency::record(Latency::Stage::ADCWait, TimingModule::now() - start);
+ * \endcode
+ */
+namespace Latency {
+
+    /**
+     * @brief Stages of a cycle.
+     */
+    enum class Stage : int {
+        ADCWait = 0,       /**< @brief Wait for the ADC event */
+        ADCTransfer,       /**< @brief Read of the ADC buffer */
+        Gather,            /**< @brief Gather plan (BPM values) */
+        Compute,           /**< @brief Correction processor */
+        DynamicCorrection, /**< @brief Harmonic correction processor */
+        DACWrite,          /**< @brief Write of the DAC buffer and event */
+        DACAck,            /**< @brief Wait for the DAC acknowledgement */
+        Count              /**< @brief Number of stages */
+    };
+
+    /**
+     * @brief Number of stages.
+     */
+    const int STAGE_NB = static_cast<int>(Stage::Count);
+
+    /**
+     * @brief Windows of the statistics: last second, last minute, since the start.
+     */
+    const int WINDOW_NB = 3;
+
+    /**
+     * @brief Statistics per window: count, p50, p99, p99.9, max.
+     */
+    const int STAT_NB = 5;
+
+    /**
+     * @brief Version of the FOFB-LATENCY layout.
+     */
+    const uint16_t LATENCY_VERSION = 1;
+
+    /**
+     * @brief Header of a FOFB-LATENCY message.
+     *
+     * It is followed by stageNb x windowNb x statNb uint64_t, in ns (the count
+     * is a number of cycles): for each Stage in order, for each window (1 s,
+     * 1 min, since start), count, p50, p99, p99.9 and max.
+     */
+    struct LatencyHeader_t {
+        char topic[16];      /**< @brief "FOFB-LATENCY", padded with '\0' */
+        uint16_t version;    /**< @brief LATENCY_VERSION */
+        uint16_t headerSize; /**< @brief sizeof(LatencyHeader_t) */
+        uint32_t frameSize;  /**< @brief Size of the whole message */
+        uint64_t timestamp;  /**< @brief CLOCK_MONOTONIC_RAW, in ns */
+        uint16_t stageNb;    /**< @brief STAGE_NB */
+        uint16_t windowNb;   /**< @brief WINDOW_NB */
+        uint16_t statNb;     /**< @brief STAT_NB */
+        uint16_t reserved;   /**< @brief 0 */
+    };
+
+    static_assert(sizeof(LatencyHeader_t) == 40, "The latency layout changed: increase LATENCY_VERSION");
+
+    /**
+     * @brief Log-bucketed histogram of durations, in ns.
+     */
+    class Histogram
+    {
+    public:
+        static const int SUB_BITS = 4; /**< @brief Precision: 2^SUB_BITS buckets per power of 2 */
+        static const int SUB_COUNT = 1 << SUB_BITS; /**< @brief Buckets per power of 2 */
+        static const int MAX_EXPONENT = 40; /**< @brief Values from 2^(MAX_EXPONENT+1) ns (37 min) share the last bucket */
+        static const int BUCKET_NB = (MAX_EXPONENT - SUB_BITS + 2)*SUB_COUNT; /**< @brief Number of buckets */
+
+        /**
+         * @brief Constructor. All buckets are empty.
+         */
+        Histogram();
+
+        /**
+         * @brief Add a value (one writer thread only).
+         */
+        void record(uint64_t value) {
+            std::atomic<uint64_t>& count = m_counts[bucket(value)];
+            count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief Copy the counts of the buckets (any thread).
+         */
+        void copy(uint64_t* counts) const;
+
+        /**
+         * @brief Bucket of a value.
+         */
+        static int bucket(uint64_t value) {
+            if (value < static_cast<uint64_t>(SUB_COUNT)) {
+                return value;
+            }
+            int exponent = 63 - __builtin_clzll(value);
+            if (exponent > MAX_EXPONENT) {
+                return BUCKET_NB - 1;
+            }
+            return (exponent - SUB_BITS + 1)*SUB_COUNT + ((value >> (exponent - SUB_BITS)) & (SUB_COUNT - 1));
+        }
+
+        /**
+         * @brief Highest value of a bucket.
+         */
+        static uint64_t highestValue(int bucket);
+
+        /**
+         * @brief Value under which is a fraction `quantile` of the counts.
+         *
+         * @return The highest value of the bucket, 0 if there is no count.
+         */
+        static uint64_t percentile(const uint64_t* counts, uint64_t total, double quantile);
+
+    private:
+        std::atomic<uint64_t> m_counts[BUCKET_NB]; /**< @brief Counts since the start */
+    };
+
+    /**
+     * @brief Add a duration to the histogram of a stage (correction thread).
+     *
+     * In trace mode, the stage is also added to the trace, as an event that
+     * ends now.
+     */
+    void record(Stage stage, uint64_t duration);
+
+    /**
+     * @brief Name of a stage, as in the Messenger keys (e.g. ADC-WAIT).
+     */
+    const char* stageName(Stage stage);
+
+    /**
+     * @brief Compute the statistics and publish them. To be called every
+     * second, by the thread owning the ZMQ socket.
+     *
+     * The Messenger key LATENCY-<STAGE> is a vector of WINDOW_NB x STAT_NB
+     * doubles, ordered as in FOFB-LATENCY.
+     */
+    void publish();
+}
+
+#endif // LATENCY_H
@@ -0,0 +1,258 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "modules/perfcounters.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "modules/zmq/logger.h"
+#include "modules/zmq/messenger.h"
+#include "modules/zmq/telemetry.h"
+
+namespace {
+    PerfCounters::Config_t s_config = { false };
+
+    /**
+     * @brief perf_event type and config of each Counter.
+     */
+    const uint32_t EVENT_TYPES[PerfCounters::COUNTER_NB] = {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+        PERF_TYPE_SOFTWARE, PERF_TYPE_SOFTWARE
+    };
+    const uint64_t EVENT_CONFIGS[PerfCounters::COUNTER_NB] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_SW_PAGE_FAULTS, PERF_COUNT_SW_CONTEXT_SWITCHES
+    };
+
+    const char* STAGE_NAMES[PerfCounters::STAGE_NB] = { "ACQUISITION", "COMPUTATION", "OUTPUT" };
+
+    /**
+     * @brief Statistics written by record() (correction thread only).
+     *
+     * The maxima are kept per second in two banks: record() writes in the
+     * bank of the current window, publish() reads and clears the other one.
+     */
+    std::atomic<uint64_t> s_cycles(0);
+    std::atomic<uint64_t> s_sums[PerfCounters::STAGE_NB][PerfCounters::COUNTER_NB];
+    std::atomic<uint64_t> s_maxima[2][PerfCounters::STAGE_NB][PerfCounters::COUNTER_NB];
+    std::atomic<uint64_t> s_window(0);
+
+    /**
+     * @brief Sums and cycles at the previous publish() (AsyncBackend thread only).
+     */
+    uint64_t s_previousCycles = 0;
+    uint64_t s_previousSums[PerfCounters::STAGE_NB][PerfCounters::COUNTER_NB] = {};
+
+    /**
+     * @brief Open one counter of the calling thread.
+     *
+     * Counting in the kernel is not allowed with a high perf_event_paranoid:
+     * the counter is then opened for the user space only.
+     *
+     * @return The file descriptor, or -1 (errno is set)
+     */
+    int openCounter(int counter, int leader)
+    {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = EVENT_TYPES[counter];
+        attr.config = EVENT_CONFIGS[counter];
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.exclude_hv = 1;
+        attr.disabled = (leader == -1) ? 1 : 0;
+
+        int fd = syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+        if ((fd < 0) && ((errno == EACCES) || (errno == EPERM))) {
+            attr.exclude_kernel = 1;
+            fd = syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+        }
+        return fd;
+    }
+
+    /**
+     * @brief Print and log whether a counter is available.
+     */
+    void report(const char* name, int error)
+    {
+        std::ostringstream line;
+        line << '\t' << std::left << std::setw(45) << std::setfill('.') << name;
+        if (error) {
+            line << "NOT available (" << std::strerror(error) << ")";
+        } else {
+            line << "available";
+        }
+        std::cout << line.str() << '\n';
+        Logger::Logger() << line.str();
+    }
+}
+
+PerfCounters::Config_t& PerfCounters::config()
+{
+    return s_config;
+}
+
+PerfCounters::Group::Group()
+    : m_groupSize(0)
+    , m_leader(-1)
+    , m_available(0)
+    , m_opened(false)
+{
+    for (int i = 0 ; i < COUNTER_NB ; i++) {
+        m_fds[i] = -1;
+        m_index[i] = -1;
+        m_start[i] = m_end[i] = 0;
+    }
+}
+
+PerfCounters::Group::~Group()
+{
+    this->close();
+}
+
+uint32_t PerfCounters::Group::open()
+{
+    this->close();
+    m_opened = true;
+    std::cout << "Performance counters:\n";
+    Logger::Logger() << "Performance counters:";
+
+    for (int i = 0 ; i < COUNTER_NB ; i++) {
+        int fd = openCounter(i, m_leader);
+        report(counterName(static_cast<Counter>(i)), (fd < 0) ? errno : 0);
+        if (fd < 0) {
+            continue;
+        }
+        if (m_leader == -1) {
+            m_leader = fd;
+        }
+        m_fds[i] = fd;
+        m_index[i] = m_groupSize++;
+        m_available |= 1u << i;
+    }
+
+    if ((m_leader != -1) && ioctl(m_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP)) {
+        report("Enable the group", errno);
+        this->close();
+        m_opened = true;
+    }
+    return m_available;
+}
+
+void PerfCounters::Group::close()
+{
+    for (int i = 0 ; i < COUNTER_NB ; i++) {
+        if (m_fds[i] >= 0) {
+            ::close(m_fds[i]);
+        }
+        m_fds[i] = -1;
+        m_index[i] = -1;
+    }
+    m_groupSize = 0;
+    m_leader = -1;
+    m_available = 0;
+    m_opened = false;
+}
+
+bool PerfCounters::Group::read(uint64_t* values)
+{
+    // PERF_FORMAT_GROUP: the number of counters, then their values
+    ssize_t size = (m_groupSize + 1)*sizeof(uint64_t);
+    if (::read(m_leader, m_buffer, size) != size) {
+        return false;
+    }
+    for (int i = 0 ; i < COUNTER_NB ; i++) {
+        values[i] = (m_index[i] < 0) ? 0 : m_buffer[1 + m_index[i]];
+    }
+    return true;
+}
+
+const char* PerfCounters::counterName(Counter counter)
+{
+    switch (counter) {
+    case Counter::Cycles:
+        return "CYCLES";
+    case Counter::Instructions:
+        return "INSTRUCTIONS";
+    case Counter::LLCMisses:
+        return "LLC-MISSES";
+    case Counter::PageFaults:
+        return "PAGE-FAULTS";
+    case Counter::ContextSwitches:
+        return "CONTEXT-SWITCHES";
+    default:
+        return "UNKNOWN";
+    }
+}
+
+void PerfCounters::record(const Logger::StageCounters_t& counters)
+{
+    if (!counters.available) {
+        return;
+    }
+    const uint64_t* stages[STAGE_NB] = { counters.acquisition, counters.computation, counters.output };
+    // Once per cycle: pairs with the flip of publish()
+    int bank = s_window.load(std::memory_order_acquire) & 1;
+    for (int stage = 0 ; stage < STAGE_NB ; stage++) {
+        for (int i = 0 ; i < COUNTER_NB ; i++) {
+            uint64_t value = stages[stage][i];
+            std::atomic<uint64_t>& sum = s_sums[stage][i];
+            sum.store(sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+            std::atomic<uint64_t>& maximum = s_maxima[bank][stage][i];
+            if (value > maximum.load(std::memory_order_relaxed)) {
+                maximum.store(value, std::memory_order_relaxed);
+            }
+        }
+    }
+    s_cycles.store(s_cycles.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void PerfCounters::publish()
+{
+    if (!s_config.enabled) {
+        return;
+    }
+    // record() now writes in the other bank
+    int bank = s_window.fetch_add(1, std::memory_order_acq_rel) & 1;
+
+    uint64_t cycles = s_cycles.load(std::memory_order_acquire);
+    uint64_t windowCycles = cycles - s_previousCycles;
+    s_previousCycles = cycles;
+
+    for (int stage = 0 ; stage < STAGE_NB ; stage++) {
+        arma::vec key(STAT_NB*COUNTER_NB);
+        for (int i = 0 ; i < COUNTER_NB ; i++) {
+            uint64_t sum = s_sums[stage][i].load(std::memory_order_relaxed);
+            key(i) = windowCycles ? static_cast<double>(sum - s_previousSums[stage][i])/windowCycles : 0;
+            key(COUNTER_NB + i) = s_maxima[bank][stage][i].exchange(0, std::memory_order_relaxed);
+            key(2*COUNTER_NB + i) = cycles ? static_cast<double>(sum)/cycles : 0;
+            s_previousSums[stage][i] = sum;
+        }
+        Messenger::updateMap(std::string("PERF-") + STAGE_NAMES[stage], key);
+    }
+}
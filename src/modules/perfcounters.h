@@ -0,0 +1,194 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <cstdint>
+
+namespace Logger {
+    struct StageCounters_t;
+}
+
+/**
+ * @brief Namespace for the hardware and software counters of the stages of
+ * a cycle (perf_event_open).
+ *
+ * When enabled (--perf-counters), the correction thread opens one group of
+ * counters for itself: cycles, instructions, last level cache misses, page
+ * faults and context switches. The group is read (one read() each time)
+ * around the acquisition, computation and output stages, which tells whether
+ * a slow stage missed the cache, faulted or was preempted.
+ *
+ * The deltas of each cycle are in the telemetry frames (see
+ * Logger::StageCounters_t). Once per second, publish() updates the Messenger
+ * keys PERF-<STAGE> with the summary statistics.
+ *
+ * A counter that cannot be opened (no PMU in a VM, perf_event_paranoid...)
+ * is reported at startup and then reads 0, with its bit cleared in
+ * StageCounters_t::available.
+ */
+namespace PerfCounters {
+
+    /**
+     * @brief Counted events.
+     */
+    enum class Counter : int {
+        Cycles = 0,      /**< @brief CPU cycles */
+        Instructions,    /**< @brief Retired instructions */
+        LLCMisses,       /**< @brief Last level cache misses */
+        PageFaults,      /**< @brief Page faults */
+        ContextSwitches, /**< @brief Context switches */
+        Count            /**< @brief Number of counters */
+    };
+
+    /**
+     * @brief Number of counters.
+     */
+    const int COUNTER_NB = static_cast<int>(Counter::Count);
+
+    /**
+     * @brief Number of stages: acquisition, computation, output.
+     */
+    const int STAGE_NB = 3;
+
+    /**
+     * @brief Statistics per counter in PERF-<STAGE>: mean and max over the
+     * last second, mean since the start.
+     */
+    const int STAT_NB = 3;
+
+    /**
+     * @brief Parameters of the counters.
+     */
+    struct Config_t {
+        bool enabled; /**< @brief Are the counters requested? */
+    };
+
+    /**
+     * @brief Access to the configuration.
+     */
+    Config_t& config();
+
+    /**
+     * @brief Group of counters of one thread.
+     */
+    class Group
+    {
+    public:
+        /**
+         * @brief Constructor. Nothing is opened.
+         */
+        Group();
+
+        /**
+         * @brief Destructor. Closes the counters.
+         */
+        ~Group();
+
+        /**
+         * @brief Open the counters for the calling thread and report which
+         * ones are available.
+         *
+         * @return Mask of the available counters (bit i for Counter i)
+         */
+        uint32_t open();
+
+        /**
+         * @brief Close the counters.
+         */
+        void close();
+
+        /**
+         * @brief Whether open() was called, even if no counter is available.
+         */
+        bool isOpened() const { return m_opened; }
+
+        /**
+         * @brief Mask of the available counters (bit i for Counter i).
+         */
+        uint32_t available() const { return m_available; }
+
+        /**
+         * @brief Read the counters at the beginning of a stage.
+         */
+        void begin() {
+            if (m_available) {
+                this->read(m_start);
+            }
+        }
+
+        /**
+         * @brief Read the counters at the end of a stage.
+         *
+         * @param deltas Set to the counts since begin() (COUNTER_NB values,
+         * 0 for the unavailable counters)
+         */
+        void end(uint64_t* deltas) {
+            if (m_available && this->read(m_end)) {
+                for (int i = 0 ; i < COUNTER_NB ; i++) {
+                    deltas[i] = m_end[i] - m_start[i];
+                }
+            }
+        }
+
+    private:
+        /**
+         * @brief Read all the counters at once.
+         *
+         * @param values COUNTER_NB values, 0 for the unavailable counters
+         * @return false if the read failed
+         */
+        bool read(uint64_t* values);
+
+        int m_fds[COUNTER_NB];     /**< @brief File descriptor of each counter (-1 if unavailable) */
+        int m_index[COUNTER_NB];   /**< @brief Position of each counter in the group read (-1 if unavailable) */
+        int m_groupSize;           /**< @brief Number of counters in the group */
+        int m_leader;              /**< @brief File descriptor of the group leader */
+        uint32_t m_available;      /**< @brief Mask of the available counters */
+        bool m_opened;             /**< @brief Whether open() was called */
+        uint64_t m_start[COUNTER_NB]; /**< @brief Values read by begin() */
+        uint64_t m_end[COUNTER_NB];   /**< @brief Values read by end() */
+        uint64_t m_buffer[COUNTER_NB + 1]; /**< @brief Result of the group read */
+    };
+
+    /**
+     * @brief Name of a counter, as in the reports (e.g. LLC-MISSES).
+     */
+    const char* counterName(Counter counter);
+
+    /**
+     * @brief Add the counts of a cycle to the statistics (correction thread).
+     */
+    void record(const Logger::StageCounters_t& counters);
+
+    /**
+     * @brief Compute the statistics and publish them. To be called every
+     * second, by the AsyncBackend thread.
+     *
+     * The Messenger key PERF-<STAGE> (ACQUISITION, COMPUTATION, OUTPUT) is a
+     * vector of STAT_NB x COUNTER_NB doubles: the mean per cycle over the last
+     * second, the max over the last second and the mean since the start of
+     * each Counter, in order.
+     *
+     * The max of a cycle recorded while publish() flips the banks can land
+     * in the bank just cleared: it is then published with a later window.
+     * The means are exact.
+     */
+    void publish();
+}
+
+#endif // PERFCOUNTERS_H
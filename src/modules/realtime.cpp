@@ -0,0 +1,184 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "modules/realtime.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include <alloca.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "modules/zmq/logger.h"
+
+namespace {
+    RealTime::Config_t s_config = { false, 80, -1, 512*1024, 64*1024*1024 };
+
+    /**
+     * @brief Print and log whether a setting was applied.
+     */
+    void report(const std::string& setting, int error)
+    {
+        std::ostringstream line;
+        line << '\t' << std::left << std::setw(45) << std::setfill('.') << setting;
+        if (error) {
+            line << "NOT applied (" << std::strerror(error) << ")";
+        } else {
+            line << "applied";
+        }
+        std::cout << line.str() << '\n';
+        Logger::Logger() << line.str();
+    }
+
+    /**
+     * @brief Touch every page of a stack area so that it is mapped.
+     *
+     * @return E2BIG if the stack limit is too small for this area, ENOMEM
+     * if a page is not resident afterwards, else 0.
+     */
+    __attribute__((noinline)) int prefaultStack(size_t size)
+    {
+        // Keep a margin for the frames already on the stack
+        rlimit limit;
+        if (!getrlimit(RLIMIT_STACK, &limit) && (limit.rlim_cur != RLIM_INFINITY)
+                && (size + 64*1024 > limit.rlim_cur)) {
+            return E2BIG;
+        }
+        volatile unsigned char* stack = static_cast<volatile unsigned char*>(alloca(size));
+        long pageSize = sysconf(_SC_PAGESIZE);
+        for (size_t i = 0 ; i < size ; i += pageSize) {
+            stack[i] = 0;
+        }
+
+        uintptr_t begin = reinterpret_cast<uintptr_t>(stack) & ~(pageSize - 1);
+        size_t length = reinterpret_cast<uintptr_t>(stack) + size - begin;
+        unsigned char resident[length/pageSize + 1];
+        if (mincore(reinterpret_cast<void*>(begin), length, resident)) {
+            return errno;
+        }
+        for (size_t page = 0 ; page < (length + pageSize - 1)/pageSize ; page++) {
+            if (!(resident[page] & 1)) {
+                return ENOMEM;
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * @brief Touch a heap area and give it back to malloc without returning
+     * it to the system.
+     */
+    int prefaultHeap(size_t size)
+    {
+        // Freed memory must stay in the heap, and big blocks must not be mmaped
+        if (!mallopt(M_TRIM_THRESHOLD, -1) || !mallopt(M_MMAP_MAX, 0)) {
+            return EINVAL;
+        }
+        unsigned char* heap = static_cast<unsigned char*>(std::malloc(size));
+        if (heap == NULL) {
+            return ENOMEM;
+        }
+        long pageSize = sysconf(_SC_PAGESIZE);
+        for (size_t i = 0 ; i < size ; i += pageSize) {
+            heap[i] = 0;
+        }
+        std::free(heap);
+        return 0;
+    }
+}
+
+RealTime::Config_t& RealTime::config()
+{
+    return s_config;
+}
+
+int RealTime::realTimeCpu()
+{
+    if (s_config.cpu >= 0) {
+        return s_config.cpu;
+    }
+    return sysconf(_SC_NPROCESSORS_ONLN) - 1;
+}
+
+void RealTime::enterRealTime()
+{
+    if (!s_config.enabled) {
+        return;
+    }
+    std::cout << "Real-time mode:\n";
+    Logger::Logger() << "Real-time mode:";
+
+    int error = 0;
+    if (mlockall(MCL_CURRENT | MCL_FUTURE)) {
+        error = errno;
+    }
+    report("mlockall", error);
+
+    error = prefaultStack(s_config.stackSize);
+    report("Pre-fault stack (" + std::to_string(s_config.stackSize/1024) + " kB)", error);
+
+    error = prefaultHeap(s_config.heapSize);
+    report("Pre-fault heap (" + std::to_string(s_config.heapSize/1024/1024) + " MB)", error);
+
+    int cpu = realTimeCpu();
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    error = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+    report("Pin correction thread to CPU " + std::to_string(cpu), error);
+
+    sched_param param;
+    param.sched_priority = s_config.priority;
+    error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    report("SCHED_FIFO priority " + std::to_string(s_config.priority), error);
+}
+
+void RealTime::moveToHousekeeping(std::thread& thread, const std::string& name)
+{
+    if (!s_config.enabled || !thread.joinable()) {
+        return;
+    }
+    int rtCpu = realTimeCpu();
+    long cpuNb = sysconf(_SC_NPROCESSORS_ONLN);
+
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    for (int cpu = 0 ; cpu < cpuNb ; cpu++) {
+        if (cpu != rtCpu) {
+            CPU_SET(cpu, &cpuset);
+        }
+    }
+    int error = (CPU_COUNT(&cpuset) == 0) ? EINVAL
+              : pthread_setaffinity_np(thread.native_handle(), sizeof(cpuset), &cpuset);
+    if (!error) {
+        // Threads created by the real-time thread inherit its policy
+        sched_param param;
+        param.sched_priority = 0;
+        error = pthread_setschedparam(thread.native_handle(), SCHED_OTHER, &param);
+    }
+    report("Move " + name + " thread off CPU " + std::to_string(rtCpu), error);
+}
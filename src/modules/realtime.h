@@ -0,0 +1,84 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <cstddef>
+#include <string>
+#include <thread>
+
+/**
+ * @brief Namespace to run the correction loop in real-time conditions.
+ *
+ * In real-time mode the thread calling Handler::make() is scheduled with
+ * SCHED_FIFO and pinned to one (isolated) core, the memory is locked and the
+ * stack and heap are pre-faulted. The other threads (Messenger, watchers,
+ * logging...) are moved away from this core.
+ *
+ * \code{.cpp}
+ * RealTime::config().enabled = true;
+ * RealTime::moveToHousekeeping(otherThread, "Messenger");
+ * RealTime::enterRealTime(); // From the correction thread
+ * \endcode
+ *
+ * Each step reports at startup whether it was actually applied.
+ */
+namespace RealTime {
+
+    /**
+     * @brief Parameters of the real-time mode.
+     */
+    struct Config_t {
+        bool enabled;        /**< @brief Is the real-time mode requested? */
+        int priority;        /**< @brief SCHED_FIFO priority (1-99) */
+        int cpu;             /**< @brief Core of the correction thread (-1 = last core) */
+        size_t stackSize;    /**< @brief Size of the stack to pre-fault (bytes) */
+        size_t heapSize;     /**< @brief Size of the heap to pre-fault (bytes) */
+    };
+
+    /**
+     * @brief Access to the configuration (to be set before enterRealTime()).
+     */
+    Config_t& config();
+
+    /**
+     * @brief Apply the real-time settings to the calling thread.
+     *
+     * Lock the memory, pre-fault stack and heap, pin the thread and set its
+     * scheduling policy. Does nothing if the real-time mode is not enabled.
+     */
+    void enterRealTime();
+
+    /**
+     * @brief Move a thread away from the real-time core, with a normal
+     * scheduling policy.
+     *
+     * Does nothing if the real-time mode is not enabled.
+     *
+     * @param thread Thread to move
+     * @param name Name of the thread (for the report)
+     */
+    void moveToHousekeeping(std::thread& thread, const std::string& name);
+
+    /**
+     * @brief Core used by the real-time thread.
+     */
+    int realTimeCpu();
+}
+
+#endif // REALTIME_H
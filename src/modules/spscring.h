@@ -0,0 +1,95 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ * @brief Lock-free ring of N slots between one producer thread and one
+ * consumer thread.
+ *
+ * The slots are written and read in place, so that no record is copied
+ * twice:
+ * \code{.cpp}
+ * // Producer
+ * if (Record_t* record = ring.claim()) {
+ *     record->value = 12;
+ *     ring.publish();
+ * } // else: full, the record is dropped
+ *
+ * // Consumer
+ * while (Record_t* record = ring.front()) {
+ *     use(*record);
+ *     ring.release();
+ * }
+ * \endcode
+ */
+template <typename T, size_t N>
+class SpscRing
+{
+public:
+    /**
+     * @brief Constructor. The ring is empty.
+     */
+    SpscRing() : m_head(0), m_tail(0) {}
+
+    /**
+     * @brief Next slot to write (producer), nullptr if the ring is full.
+     */
+    T* claim() {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == N) {
+            return nullptr;
+        }
+        return &m_slots[head % N];
+    }
+
+    /**
+     * @brief Hand the slot returned by claim() over to the consumer.
+     */
+    void publish() {
+        m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Oldest slot to read (consumer), nullptr if the ring is empty.
+     */
+    T* front() {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &m_slots[tail % N];
+    }
+
+    /**
+     * @brief Give the slot returned by front() back to the producer.
+     */
+    void release() {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    alignas(64) std::atomic<size_t> m_head; /**< @brief Number of published slots */
+    alignas(64) std::atomic<size_t> m_tail; /**< @brief Number of released slots */
+    alignas(64) T m_slots[N]; /**< @brief Slots */
+};
+
+#endif // SPSCRING_H
@@ -17,45 +17,43 @@
 
 #include "modules/timers.h"
 
-#include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
 
 Timer::Timer(const std::string& name)
-    : m_min((double)0)
+    : m_name(name)
+    , m_timeSpan(0)
+    , m_min(0)
     , m_max(0)
+    , m_sum(0)
+    , m_sum2(0)
     , m_callNb(0)
-    , m_name(name)
 {
-    m_start = std::chrono::steady_clock::now();
+    m_start = TimingModule::now();
 }
 
-Timer::~Timer()
-{}
-
 void Timer::start()
 {
-    m_start = std::chrono::steady_clock::now();
+    m_start = TimingModule::now();
 }
 
 void Timer::stop()
 {
-    using namespace std::chrono;
-
-    steady_clock::time_point stop = steady_clock::now();
-    duration<double> duration_time = duration_cast<duration<double> >(stop - m_start);
-    m_timeSpan = duration_time.count();
+    m_timeSpan = TimingModule::now() - m_start;
     this->doArithmetic(m_timeSpan);
 }
 
-void Timer::doArithmetic(double duration)
+void Timer::doArithmetic(uint64_t duration)
 {
-    if (m_min > duration || m_min == 0) {
-        m_min = duration;
-    }
-    if (m_max < duration || m_max == 0) {
-        m_max = duration;
+    if (m_callNb == 0) {
+        m_min = m_max = duration;
+    } else {
+        m_min = std::min(m_min, duration);
+        m_max = std::max(m_max, duration);
     }
     m_sum += duration;
-    m_sum2 += duration*duration;
+    m_sum2 += static_cast<double>(duration)*duration;
     m_callNb++;
 }
 
@@ -64,11 +62,6 @@ double Timer::rms()
     return std::sqrt( m_sum2/m_callNb - std::pow( m_sum/m_callNb, 2));
 }
 
-double Timer::timeSpan() const
-{
-    return m_timeSpan;
-}
-
 void Timer::reset()
 {
     m_min = m_max = 0;
@@ -83,19 +76,19 @@ void Timer::print(Unit unit)
     switch (unit)
     {
         case Unit::ns:
-            coef = 1e9;
+            coef = 1;
             unitName += "ns";
             break;
         case Unit::us:
-            coef = 1e6;
+            coef = 1e-3;
             unitName += "us";
             break;
         case Unit::ms:
-            coef = 1e3;
+            coef = 1e-6;
             unitName += "ms";
             break;
         default:
-            coef = 1;
+            coef = 1e-9;
             unitName += "s";
             break;
     }
@@ -105,15 +98,45 @@ void Timer::print(Unit unit)
               << "RMS: " << rms()*coef << unitName <<'\n';
 }
 
+TimerId TimerList::add(const std::string& name)
+{
+    for (int i = 0 ; i < m_count ; i++) {
+        if (m_timers[i].name() == name) {
+            return i;
+        }
+    }
+    if (m_count == MAX_TIMERS) {
+        std::cout << "ERROR -- Too many timers, " << name << " not registered\n";
+        return -1;
+    }
+    m_timers[m_count] = Timer(name);
+    return m_count++;
+}
+
 void TimerList::print(Timer::Unit unit)
 {
-    if (m_timerMap.empty()) {
+    if (m_count == 0) {
         return;
     }
     std::cout << "==================" <<'\n';
-    for (auto t : m_timerMap) {
+    for (int i = 0 ; i < m_count ; i++) {
+        if (m_timers[i].callNb() == 0) {
+            continue;
+        }
         std::cout << " ";
-        t.second.print(unit);
+        m_timers[i].print(unit);
     }
     std::cout << "==================" <<'\n';
-};
+}
+
+double TimingModule::measureOverhead()
+{
+    const int pairs = 100000;
+    Timer timer("Overhead");
+    uint64_t begin = now();
+    for (int i = 0 ; i < pairs ; i++) {
+        timer.start();
+        timer.stop();
+    }
+    return static_cast<double>(now() - begin)/pairs;
+}
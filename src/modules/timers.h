@@ -18,14 +18,26 @@
 #ifndef TIMERS_H
 #define TIMERS_H
 
-#include <chrono>
-#include <map>
-#include <cmath>
-#include <iostream>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <time.h>
+
+#include "modules/trace.h"
+
+/**
+ * @brief Identifier of a Timer, given by TimingModule::registerTimer().
+ */
+typedef int TimerId;
 
 /**
  * @brief Timer that holds various arithmetic values to profile functions.
  *
+ * Durations are integer nanoseconds of CLOCK_MONOTONIC_RAW (see
+ * TimingModule::now()): start() and stop() neither allocate nor look
+ * anything up.
+ *
  * @see See TimingModule for a more comprehensive use
  */
 class Timer
@@ -44,11 +56,6 @@ public:
      */
     explicit Timer(const std::string& name="Timer");
 
-    /**
-     * @brief Destructor
-     */
-    ~Timer();
-
     /**
      * @brief (Re)Start counting.
      */
@@ -71,56 +78,67 @@ public:
     void reset();
 
     /**
-     * @brief Getter for m_timeSpan.
-     * @return m_timeSpan value.
+     * @brief Last duration between start() and stop(), in ns.
+     */
+    uint64_t timeSpan() const { return m_timeSpan; }
+
+    /**
+     * @brief Getter for m_callNb.
+     * @return Number of calls to stop() since the last reset().
+     */
+    int callNb() const { return m_callNb; }
+
+    /**
+     * @brief Name of the timer.
      */
-    double timeSpan() const;
+    const std::string& name() const { return m_name; }
 
 private:
 
     /**
      * @brief Do the arithmetic to calculate min, max and diverse sums.
-     * @param duration New value to use (in seconds)
+     * @param duration New value to use (in ns)
      */
-    void doArithmetic(double duration);
+    void doArithmetic(uint64_t duration);
 
     /**
      * @brief Calculate the RMS.
-     * @return The RMS Value.
+     * @return The RMS Value (in ns).
      */
     double rms();
 
     std::string m_name; /**< @brief Timer name */
-    std::chrono::steady_clock::time_point m_start; /**< @brief time_point when start() was called */
-    double m_timeSpan; /**< @brief Last duration between start() and stop() */
-    double m_min; /**< @brief Lesser duration */
-    double m_max; /**< @brief Greater duration */
-    double m_sum; /**< @brief Sum of each duration */
-    double m_sum2; /**< @brief Sum of the square of each duration */
+    uint64_t m_start; /**< @brief Time when start() was called (ns) */
+    uint64_t m_timeSpan; /**< @brief Last duration between start() and stop() (ns) */
+    uint64_t m_min; /**< @brief Lesser duration (ns) */
+    uint64_t m_max; /**< @brief Greater duration (ns) */
+    double m_sum; /**< @brief Sum of each duration (ns) */
+    double m_sum2; /**< @brief Sum of the square of each duration (ns^2) */
     int m_callNb; /**< @brief How many time stop() was called */
 };
 
 /**
- * @brief Map of Timer to manage and print them easily.
+ * @brief Fixed array of Timer to manage and print them easily.
  */
 class TimerList
 {
 public:
     /**
-     * @brief Constructor
+     * @brief Maximum number of timers.
      */
-    explicit TimerList(){};
+    static const int MAX_TIMERS = 32;
+
     /**
-     * @brief Destructor
+     * @brief Constructor
      */
-    ~TimerList(){};
+    TimerList() : m_count(0) {}
 
     /**
-     * @brief Add a Timer to the list
-     * @param name Name to call the Timer.
-     * @param timer Timer to add.
+     * @brief Add a Timer to the list, or find the one with this name.
+     * @param name Name of the Timer.
+     * @return Its identifier, -1 if the list is full.
      */
-    inline void addTimer(const std::string& name, Timer timer){ m_timerMap[name] = timer;}
+    TimerId add(const std::string& name);
 
     /**
      * @brief Print the timer data. It uses the Timer::print() function plus some
@@ -131,42 +149,40 @@ public:
     void print(Timer::Unit unit);
 
     /**
-     * @brief Retrieve a timer in the map.
-     * @param name Name of the timer to retrieve.
-     */
-    inline Timer& operator[](const std::string& name) { return m_timerMap[name];}
-
-    /**
-     * @brief Count the number of Timer with given name.
-     *
-     * @param name Name to count,
-     * @return Number of Timer with the given name (can only be 0 or 1)
+     * @brief Retrieve a timer.
+     * @param id Identifier given by add().
      */
-    inline int count(const std::string& name) { return m_timerMap.count(name);}
+    inline Timer& operator[](TimerId id) { return m_timers[id]; }
 
     /**
-     * @brief Empty the map. The TimerList is as newly constructed.
+     * @brief Reset all Timers. They are kept in the list.
      */
-    void reset() { m_timerMap.clear(); }
+    void reset() { for (int i = 0 ; i < m_count ; i++) m_timers[i].reset(); }
 
 private:
-    std::map<std::string, Timer> m_timerMap; /**< @brief Map containing the Timers */
+    Timer m_timers[MAX_TIMERS]; /**< @brief Timers, in the order of registration */
+    int m_count; /**< @brief Number of registered timers */
 };
 
 /**
  * @brief Namespace for Timing static functions.
  *
- * To start a timer call
+ * Timers are registered once, at initialization, and then used through
+ * their identifier:
  * ~~~~.cpp
- * TimingModule::addTimer("name_of_timer");
+ * TimerId id = TimingModule::registerTimer("name_of_timer");
+ * ~~~~
+ * To start it:
+ * ~~~~.cpp
+ * TimingModule::start(id);
  * ~~~~
  * To stop it:
  * ~~~~.cpp
- * TimingModule::timer("name_of_timer").stop();
+ * TimingModule::stop(id);
  * ~~~~
  * To print its values in ms:
  * ~~~~.cpp
- * TimingModule::timer("name_of_timer").print(Timer::Unit::ms);
+ * TimingModule::timer(id).print(Timer::Unit::ms);
  * ~~~~
  * To print all Timer values in ms every 1000 loops:
  * ~~~~.cpp
@@ -177,26 +193,65 @@ namespace TimingModule {
     extern TimerList tm;
 
     /**
-     * @brief Global wrapper to TimeList::addTimer() function
-     * @param name Name of the new Timer to create or to restart
+     * @brief Current time of CLOCK_MONOTONIC_RAW (in ns).
+     *
+     * This clock is not slewed by NTP, and is read through the vDSO, without
+     * system call.
      */
-    inline void addTimer(const std::string& name) {
-        if (tm.count(name) > 0) {
-            tm[name].start();
-            return;
+    inline uint64_t now() {
+        timespec time;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &time);
+        return static_cast<uint64_t>(time.tv_sec)*1000000000 + time.tv_nsec;
+    }
+
+    /**
+     * @brief Register a Timer (at initialization: it allocates its name).
+     * @param name Name of the Timer
+     * @return Its identifier (the same for the same name)
+     */
+    inline TimerId registerTimer(const std::string& name) {
+        return tm.add(name);
+    }
+
+    /**
+     * @brief Start a Timer (ignored for an invalid identifier).
+     *
+     * In trace mode, it also records the beginning of an event named as
+     * the Timer.
+     */
+    inline void start(TimerId id) {
+        if (id >= 0) {
+            Trace::begin(tm[id].name().c_str());
+            tm[id].start();
+        }
+    }
+
+    /**
+     * @brief Stop a Timer (ignored for an invalid identifier).
+     *
+     * In trace mode, it also records the end of the event.
+     */
+    inline void stop(TimerId id) {
+        if (id >= 0) {
+            tm[id].stop();
+            Trace::end(tm[id].name().c_str());
         }
-        Timer timer(name);
-        tm.addTimer(name, timer);
     }
 
     /**
      * @brief Access a given Timer.
-     * @param name Name of the Timer to access
+     * @param id Identifier of the Timer to access
      */
-    inline Timer& timer(const std::string& name) {
-        return tm[name];
+    inline Timer& timer(TimerId id) {
+        return tm[id];
     }
 
+    /**
+     * @brief Measure the cost of a start()/stop() pair.
+     * @return Mean duration of a pair, in ns.
+     */
+    double measureOverhead();
+
     /**
      * @brief Print Timers values.
      * @param unit Unit in which the values are printed.
@@ -0,0 +1,248 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "modules/trace.h"
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "modules/timers.h"
+#include "modules/zmq/logger.h"
+
+namespace {
+    Trace::Config_t s_config = { false, "/tmp/mbox-trace", 10.0 };
+
+    /**
+     * @brief Sequence of a slot being written.
+     */
+    const uint64_t INVALID = UINT64_MAX;
+
+    /**
+     * @brief Event of the ring.
+     */
+    struct Event_t {
+        std::atomic<uint64_t> sequence; /**< @brief Event number (INVALID while it is written) */
+        uint64_t timestamp;  /**< @brief Beginning of the event, CLOCK_MONOTONIC_RAW in ns */
+        const char* name;    /**< @brief Name of the event */
+        uint32_t duration;   /**< @brief Duration of a 'X' event, in ns */
+        uint32_t tid;        /**< @brief Thread ID (as in ps -L) */
+        char phase;          /**< @brief 'B', 'E' or 'X' */
+    };
+
+    /**
+     * @brief Copy of an event, for the dump.
+     */
+    struct Copy_t {
+        uint64_t timestamp;
+        const char* name;
+        uint32_t duration;
+        uint32_t tid;
+        char phase;
+    };
+
+    Event_t s_events[Trace::EVENT_NB];
+    std::atomic<uint64_t> s_head(0); /**< @brief Number of events added since the start */
+    std::atomic<int> s_requested(0); /**< @brief Pending Trace::Request */
+    uint64_t s_lastDump = 0;         /**< @brief Time of the last dump (backend thread only) */
+
+    std::mutex s_namesMutex;
+    std::vector<std::pair<uint32_t, std::string> > s_threadNames;
+
+    thread_local uint32_t t_tid = 0;
+
+    /**
+     * @brief ID of the calling thread (cached: gettid is a system call).
+     */
+    uint32_t threadId()
+    {
+        if (t_tid == 0) {
+            t_tid = syscall(SYS_gettid);
+        }
+        return t_tid;
+    }
+
+    /**
+     * @brief Write a string as a JSON string.
+     */
+    void writeString(std::ostream& out, const std::string& value)
+    {
+        out << '"';
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                out << '\\' << c;
+            } else if (static_cast<unsigned char>(c) >= 0x20) {
+                out << c;
+            }
+        }
+        out << '"';
+    }
+
+    /**
+     * @brief Write a time in ns as µs, without losing the ns.
+     */
+    void writeMicroseconds(std::ostream& out, uint64_t ns)
+    {
+        out << ns/1000 << '.' << std::setw(3) << std::setfill('0') << ns%1000;
+    }
+}
+
+std::atomic<bool> Trace::recording(false);
+
+Trace::Config_t& Trace::config()
+{
+    return s_config;
+}
+
+void Trace::start()
+{
+    if (!s_config.enabled) {
+        return;
+    }
+    for (uint64_t i = 0 ; i < EVENT_NB ; i++) {
+        s_events[i].sequence.store(INVALID, std::memory_order_relaxed);
+    }
+    recording.store(true, std::memory_order_release);
+    Logger::Logger() << "Trace mode: " << EVENT_NB << " events kept, dumped in "
+                     << s_config.path << ".<date>.json";
+}
+
+void Trace::addEvent(char phase, const char* name, uint64_t duration)
+{
+    uint64_t now = TimingModule::now();
+    uint64_t index = s_head.fetch_add(1, std::memory_order_relaxed);
+    Event_t& event = s_events[index & (EVENT_NB - 1)];
+
+    // The readers ignore the slot until its sequence is written back
+    event.sequence.store(INVALID, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    event.timestamp = now - duration;
+    event.name = name;
+    event.duration = (duration > UINT32_MAX) ? UINT32_MAX : duration;
+    event.tid = threadId();
+    event.phase = phase;
+    event.sequence.store(index, std::memory_order_release);
+}
+
+void Trace::nameThread(const std::string& name)
+{
+    uint32_t tid = threadId();
+    std::lock_guard<std::mutex> lock(s_namesMutex);
+    for (auto& threadName : s_threadNames) {
+        if (threadName.first == tid) {
+            threadName.second = name;
+            return;
+        }
+    }
+    s_threadNames.push_back(std::make_pair(tid, name));
+}
+
+void Trace::requestDump(Request request)
+{
+    if (!recording.load(std::memory_order_relaxed)) {
+        return;
+    }
+    // Keep the most important request
+    int value = static_cast<int>(request);
+    int pending = s_requested.load(std::memory_order_relaxed);
+    while ((pending < value)
+           && !s_requested.compare_exchange_weak(pending, value, std::memory_order_relaxed)) {
+    }
+}
+
+void Trace::writeRequestedDump()
+{
+    Request request = static_cast<Request>(s_requested.exchange(0, std::memory_order_relaxed));
+    if (request == Request::None) {
+        return;
+    }
+    uint64_t now = TimingModule::now();
+    if ((request == Request::Error) && (s_lastDump != 0)
+        && (now - s_lastDump < s_config.errorDumpSeconds*1e9)) {
+        return;
+    }
+    s_lastDump = now;
+
+    char date[32];
+    std::time_t time = std::time(nullptr);
+    strftime(date, sizeof(date), "%Y%m%d-%H%M%S", std::localtime(&time));
+    std::string filename = s_config.path + '.' + date + ".json";
+    if (int error = dump(filename)) {
+        Logger::error(_ME_) << "Cannot write the trace " << filename << ": " << std::strerror(error);
+    } else {
+        Logger::Logger() << "Trace written in " << filename;
+    }
+}
+
+int Trace::dump(const std::string& filename)
+{
+    // Copy first: the ring keeps turning while the file is written
+    uint64_t head = s_head.load(std::memory_order_acquire);
+    uint64_t first = (head > EVENT_NB) ? head - EVENT_NB : 0;
+    std::vector<Copy_t> events;
+    events.reserve(head - first);
+    for (uint64_t i = first ; i < head ; i++) {
+        const Event_t& event = s_events[i & (EVENT_NB - 1)];
+        if (event.sequence.load(std::memory_order_acquire) != i) {
+            continue;
+        }
+        Copy_t copy = { event.timestamp, event.name, event.duration, event.tid, event.phase };
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (event.sequence.load(std::memory_order_relaxed) == i) {
+            events.push_back(copy);
+        }
+    }
+
+    std::ofstream file(filename);
+    if (!file) {
+        return errno ? errno : EIO;
+    }
+    int pid = getpid();
+    file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid
+         << ",\"args\":{\"name\":\"mBox\"}}";
+    {
+        std::lock_guard<std::mutex> lock(s_namesMutex);
+        for (const auto& threadName : s_threadNames) {
+            file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+                 << ",\"tid\":" << threadName.first << ",\"args\":{\"name\":";
+            writeString(file, threadName.second);
+            file << "}}";
+        }
+    }
+    for (const Copy_t& event : events) {
+        file << ",\n{\"name\":";
+        writeString(file, event.name);
+        file << ",\"ph\":\"" << event.phase << "\",\"ts\":";
+        writeMicroseconds(file, event.timestamp);
+        if (event.phase == 'X') {
+            file << ",\"dur\":";
+            writeMicroseconds(file, event.duration);
+        }
+        file << ",\"pid\":" << pid << ",\"tid\":" << event.tid << '}';
+    }
+    file << "\n]}\n";
+    file.close();
+    return file ? 0 : (errno ? errno : EIO);
+}
@@ -0,0 +1,161 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Namespace for the trace mode: a timeline of what each thread did.
+ *
+ * When the trace mode is enabled (--trace), begin/end events are recorded
+ * with the thread ID and a CLOCK_MONOTONIC_RAW timestamp in a preallocated
+ * ring, without lock nor allocation. The TimingModule timers, the Latency
+ * stages and the RFMDriver calls feed it, so that the steps of an overrun
+ * Handler::make() (clearEvent, enableEvent, waitForEvent, read, sendEvent,
+ * processors...) can be seen.
+ *
+ * The ring is dumped as a Chrome trace (JSON, which chrome://tracing and the
+ * Perfetto UI load) in `<path>.<date>.json`:
+ *  * when an error is posted (at most once every `errorDumpSeconds`);
+ *  * when a client sets the Messenger key TRACE-DUMP.
+ * The file is written by the AsyncBackend thread (see writeRequestedDump()),
+ * never by the correction thread.
+ *
+ * \code{.cpp}
+ * {
+ *     Trace::Scope scope("RFM2gWaitForEvent");
+ *     RFM2gWaitForEvent(handle, eventInfo);
+ * }
+ * \endcode
+ */
+namespace Trace {
+
+    /**
+     * @brief Number of events kept in the ring (a power of 2).
+     */
+    const uint64_t EVENT_NB = 1 << 17;
+
+    /**
+     * @brief Parameters of the trace mode.
+     */
+    struct Config_t {
+        bool enabled;            /**< @brief Is the trace mode requested? */
+        std::string path;        /**< @brief Prefix of the dumped files */
+        double errorDumpSeconds; /**< @brief Minimum time between two dumps on error */
+    };
+
+    /**
+     * @brief Access to the configuration (to be set before start()).
+     */
+    Config_t& config();
+
+    /**
+     * @brief Whether the events are recorded. Set by start().
+     */
+    extern std::atomic<bool> recording;
+
+    /**
+     * @brief Start recording if the trace mode is enabled.
+     */
+    void start();
+
+    /**
+     * @brief Add an event to the ring (any thread).
+     *
+     * @param phase 'B' (begin), 'E' (end) or 'X' (complete)
+     * @param name Name of the event: must stay valid until the end (literal...)
+     * @param duration Duration of a 'X' event, in ns (it ends now)
+     */
+    void addEvent(char phase, const char* name, uint64_t duration = 0);
+
+    /**
+     * @brief Record the beginning of a step.
+     */
+    inline void begin(const char* name) {
+        if (recording.load(std::memory_order_relaxed)) {
+            addEvent('B', name);
+        }
+    }
+
+    /**
+     * @brief Record the end of a step.
+     */
+    inline void end(const char* name) {
+        if (recording.load(std::memory_order_relaxed)) {
+            addEvent('E', name);
+        }
+    }
+
+    /**
+     * @brief Record a step that just finished and lasted `duration` ns.
+     */
+    inline void complete(const char* name, uint64_t duration) {
+        if (recording.load(std::memory_order_relaxed)) {
+            addEvent('X', name, duration);
+        }
+    }
+
+    /**
+     * @brief Record the beginning and the end of a scope.
+     */
+    class Scope
+    {
+    public:
+        explicit Scope(const char* name) : m_name(name) { begin(m_name); }
+        ~Scope() { end(m_name); }
+
+    private:
+        const char* m_name; /**< @brief Name of the event */
+    };
+
+    /**
+     * @brief Give a name to the calling thread in the dumps.
+     */
+    void nameThread(const std::string& name);
+
+    /**
+     * @brief Origin of a dump request.
+     */
+    enum class Request : int {
+        None = 0,
+        Error,  /**< @brief An error was posted (rate-limited) */
+        Client  /**< @brief Asked through the Messenger */
+    };
+
+    /**
+     * @brief Ask for a dump (any thread, lock-free).
+     */
+    void requestDump(Request request);
+
+    /**
+     * @brief Write the requested dump, if any. Called periodically by the
+     * AsyncBackend thread.
+     */
+    void writeRequestedDump();
+
+    /**
+     * @brief Write the events of the ring in a Chrome trace file.
+     *
+     * @return 0 on success, else an errno code
+     */
+    int dump(const std::string& filename);
+}
+
+#endif // TRACE_H
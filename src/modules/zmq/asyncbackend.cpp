@@ -0,0 +1,228 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "modules/zmq/asyncbackend.h"
+
+#include <chrono>
+#include <cstring>
+#include <string>
+
+#include "modules/trace.h"
+
+std::atomic<Logger::AsyncBackend*> Logger::AsyncBackend::s_instance(nullptr);
+
+Logger::AsyncBackend::AsyncBackend()
+    : m_running(false)
+    , m_hotThread(std::thread::id())
+    , m_dropped(0)
+    , m_reportedDropped(0)
+{
+    s_instance.store(this, std::memory_order_release);
+}
+
+Logger::AsyncBackend::~AsyncBackend()
+{
+    this->stop();
+    AsyncBackend* self = this;
+    s_instance.compare_exchange_strong(self, nullptr);
+}
+
+void Logger::AsyncBackend::start()
+{
+    if (m_running) {
+        return;
+    }
+    m_aggregators.clear();
+    for (int cycles : telemetryConfig().aggregations) {
+        m_aggregators.push_back(Aggregator(cycles));
+    }
+    m_running = true;
+    m_thread = std::thread(&AsyncBackend::run, this);
+}
+
+void Logger::AsyncBackend::stop()
+{
+    if (!m_running) {
+        return;
+    }
+    m_running = false;
+    m_thread.join();
+    // Written by the calling thread from now on, whatever is left
+    this->drain();
+}
+
+void Logger::AsyncBackend::addPeriodicTask(const std::function<void()>& task, std::chrono::milliseconds period)
+{
+    PeriodicTask_t periodicTask;
+    periodicTask.task = task;
+    periodicTask.period = period;
+    periodicTask.next = std::chrono::steady_clock::now() + period;
+    m_periodicTasks.push_back(periodicTask);
+}
+
+void Logger::AsyncBackend::setHotThread()
+{
+    AsyncBackend* backend = instance();
+    if (backend != nullptr) {
+        backend->m_hotThread.store(std::this_thread::get_id(), std::memory_order_release);
+    }
+}
+
+bool Logger::AsyncBackend::running()
+{
+    AsyncBackend* backend = instance();
+    return (backend != nullptr) && backend->m_running.load(std::memory_order_acquire);
+}
+
+void Logger::AsyncBackend::post(const LogRecord_t& record)
+{
+    AsyncBackend* backend = instance();
+    if ((backend == nullptr) || !backend->m_running.load(std::memory_order_acquire)) {
+        Logger::write(record);
+        return;
+    }
+
+    if (std::this_thread::get_id() == backend->m_hotThread.load(std::memory_order_acquire)) {
+        LogRecord_t* slot = backend->m_logRing.claim();
+        if (slot == nullptr) {
+            backend->m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        memcpy(slot, &record, sizeof(LogRecord_t));
+        backend->m_logRing.publish();
+    } else {
+        std::lock_guard<std::mutex> lock(backend->m_queueMutex);
+        if (backend->m_queue.size() >= QUEUE_SIZE) {
+            backend->m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        backend->m_queue.push_back(record);
+    }
+}
+
+void Logger::AsyncBackend::postFrame(unsigned char* frame)
+{
+    AsyncBackend* backend = instance();
+    if ((backend == nullptr) || !backend->m_running.load(std::memory_order_acquire)) {
+        // No aggregation without the backend thread
+        if (telemetryConfig().rawFrames) {
+            Logger::sendFrame(frame);
+        } else {
+            FramePool::release(frame, nullptr);
+        }
+        return;
+    }
+
+    unsigned char** slot = nullptr;
+    if (std::this_thread::get_id() == backend->m_hotThread.load(std::memory_order_acquire)) {
+        slot = backend->m_frameRing.claim();
+    }
+    if (slot == nullptr) {
+        FramePool::release(frame, nullptr);
+        backend->m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    *slot = frame;
+    backend->m_frameRing.publish();
+}
+
+void Logger::AsyncBackend::countDropped()
+{
+    AsyncBackend* backend = instance();
+    if (backend != nullptr) {
+        backend->m_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void Logger::AsyncBackend::dispatchFrame(unsigned char* frame)
+{
+    for (Aggregator& aggregator : m_aggregators) {
+        aggregator.add(frame);
+    }
+    if (telemetryConfig().rawFrames) {
+        Logger::sendFrame(frame);
+    } else {
+        FramePool::release(frame, nullptr);
+    }
+}
+
+int Logger::AsyncBackend::drain()
+{
+    int count = 0;
+    while (LogRecord_t* record = m_logRing.front()) {
+        Logger::write(*record);
+        m_logRing.release();
+        count++;
+    }
+    while (unsigned char** frame = m_frameRing.front()) {
+        this->dispatchFrame(*frame);
+        m_frameRing.release();
+        count++;
+    }
+
+    std::deque<LogRecord_t> queue;
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        queue.swap(m_queue);
+    }
+    for (const LogRecord_t& record : queue) {
+        Logger::write(record);
+        count++;
+    }
+
+    unsigned long dropped = m_dropped.load(std::memory_order_relaxed);
+    if (dropped != m_reportedDropped) {
+        LogRecord_t record;
+        record.type = LogType::Error;
+        record.status = false;
+        record.time = std::time(nullptr);
+        std::string message = std::to_string(dropped - m_reportedDropped) + " log/value/frame records dropped";
+        strncpy(record.message, message.c_str(), RECORD_TEXT_SIZE - 1);
+        record.message[RECORD_TEXT_SIZE - 1] = '\0';
+        strncpy(record.other, "in Logger::AsyncBackend", RECORD_TEXT_SIZE - 1);
+        record.other[RECORD_TEXT_SIZE - 1] = '\0';
+        Logger::write(record);
+        m_reportedDropped = dropped;
+    }
+    return count;
+}
+
+void Logger::AsyncBackend::runPeriodicTasks()
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    for (PeriodicTask_t& periodicTask : m_periodicTasks) {
+        if (now >= periodicTask.next) {
+            periodicTask.task();
+            periodicTask.next += periodicTask.period;
+            if (periodicTask.next < now) {
+                // Late by more than a period: do not try to catch up
+                periodicTask.next = now + periodicTask.period;
+            }
+        }
+    }
+}
+
+void Logger::AsyncBackend::run()
+{
+    Trace::nameThread("Logger");
+    while (m_running.load(std::memory_order_acquire)) {
+        this->runPeriodicTasks();
+        if (this->drain() == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
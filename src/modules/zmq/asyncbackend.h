@@ -0,0 +1,203 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ASYNCBACKEND_H
+#define ASYNCBACKEND_H
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "modules/spscring.h"
+#include "modules/zmq/logger.h"
+#include "modules/zmq/telemetry.h"
+
+namespace Logger {
+
+/**
+ * @brief Thread formatting and sending the logs and telemetry frames.
+ *
+ * The thread calling Handler::make() (the hot thread, see setHotThread())
+ * only copies fixed-size records (or pointers to telemetry frames) into
+ * lock-free rings. The other threads
+ * push their logs into a queue protected by a mutex. The backend thread
+ * is the only one to use the ZMQ socket and to write the messages on the
+ * RFM once it runs.
+ *
+ * When a ring or the queue is full, the records are dropped and counted;
+ * the number of dropped records is logged by the backend thread.
+ *
+ * The backend thread also feeds the telemetry frames to the Aggregator of
+ * each stream of telemetryConfig() before sending them (or not, if the raw
+ * frames are disabled).
+ *
+ * \code{.cpp}
+ * Logger::AsyncBackend backend; // Global, to be deleted after the mBox
+ * backend.start();
+ * // In the correction thread
+ * Logger::AsyncBackend::setHotThread();
+ * \endcode
+ */
+class AsyncBackend
+{
+public:
+    /**
+     * @brief Constructor. Registers this backend as the one used by Logger.
+     */
+    AsyncBackend();
+
+    /**
+     * @brief Destructor. Sends what remains and stops the thread.
+     */
+    ~AsyncBackend();
+
+    /**
+     * @brief Create the aggregation streams of telemetryConfig() and start
+     * the thread.
+     */
+    void start();
+
+    /**
+     * @brief Send what remains and stop the thread. Logs are then sent
+     * directly.
+     */
+    void stop();
+
+    /**
+     * @brief Run a task periodically in the backend thread, e.g. to publish
+     * statistics on the socket. To be called before start().
+     */
+    void addPeriodicTask(const std::function<void()>& task, std::chrono::milliseconds period);
+
+    /**
+     * @brief Access to the thread (e.g. to set its affinity).
+     */
+    std::thread& thread() { return m_thread; }
+
+    /**
+     * @brief Number of records dropped since the start.
+     */
+    unsigned long dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Backend used by Logger (nullptr if none).
+     */
+    static AsyncBackend* instance() { return s_instance.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Make the calling thread the producer of the lock-free rings.
+     */
+    static void setHotThread();
+
+    /**
+     * @brief Is there a running backend?
+     */
+    static bool running();
+
+    /**
+     * @brief Hand a log record over to the backend thread (or write it
+     * directly if there is no running backend).
+     */
+    static void post(const LogRecord_t& record);
+
+    /**
+     * @brief Hand a telemetry frame (see FramePool) over to the backend
+     * thread, or send it directly if there is no running backend.
+     *
+     * From another thread than the hot one, the frame is dropped.
+     */
+    static void postFrame(unsigned char* frame);
+
+    /**
+     * @brief Count a record dropped by the caller.
+     */
+    static void countDropped();
+
+private:
+    /**
+     * @brief Size of the ring for the logs of the hot thread.
+     */
+    static const size_t LOG_RING_SIZE = 256;
+
+    /**
+     * @brief Size of the ring for the telemetry frames.
+     */
+    static const size_t FRAME_RING_SIZE = 16;
+
+    /**
+     * @brief Maximum number of logs waiting from the other threads.
+     */
+    static const size_t QUEUE_SIZE = 1024;
+
+    /**
+     * @brief Task run periodically by the backend thread.
+     */
+    struct PeriodicTask_t {
+        std::function<void()> task; /**< @brief Function to call */
+        std::chrono::milliseconds period; /**< @brief Time between two calls */
+        std::chrono::steady_clock::time_point next; /**< @brief Time of the next call */
+    };
+
+    /**
+     * @brief Loop of the backend thread.
+     */
+    void run();
+
+    /**
+     * @brief Run the periodic tasks that are due.
+     */
+    void runPeriodicTasks();
+
+    /**
+     * @brief Aggregate a telemetry frame, then send it or give it back to
+     * the FramePool.
+     */
+    void dispatchFrame(unsigned char* frame);
+
+    /**
+     * @brief Write all waiting records.
+     *
+     * @return Number of records written.
+     */
+    int drain();
+
+    static std::atomic<AsyncBackend*> s_instance; /**< @brief Backend used by Logger */
+
+    std::atomic<bool> m_running; /**< @brief Whether the thread should keep running */
+    std::atomic<std::thread::id> m_hotThread; /**< @brief Producer of the rings */
+    std::atomic<unsigned long> m_dropped; /**< @brief Number of dropped records */
+    unsigned long m_reportedDropped; /**< @brief Dropped records already logged */
+
+    SpscRing<LogRecord_t, LOG_RING_SIZE> m_logRing; /**< @brief Logs of the hot thread */
+    SpscRing<unsigned char*, FRAME_RING_SIZE> m_frameRing; /**< @brief Telemetry frames of the hot thread */
+
+    std::vector<Aggregator> m_aggregators; /**< @brief Aggregation streams */
+    std::vector<PeriodicTask_t> m_periodicTasks; /**< @brief Tasks of addPeriodicTask() */
+
+    std::mutex m_queueMutex; /**< @brief Mutex protecting m_queue */
+    std::deque<LogRecord_t> m_queue; /**< @brief Logs of the other threads */
+
+    std::thread m_thread; /**< @brief Backend thread */
+};
+
+}
+
+#endif // ASYNCBACKEND_H
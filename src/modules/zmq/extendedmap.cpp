@@ -17,17 +17,58 @@
 
 #include "extendedmap.h"
 
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
 #include "modules/zmq/logger.h"
 
+ExtendedMap::ReadSection::ReadSection(const ExtendedMap& map)
+    : m_map(map)
+{
+    while (true) {
+        unsigned epoch = m_map.m_epoch.load(std::memory_order_seq_cst);
+        m_parity = epoch & 1;
+        m_map.m_readers[m_parity].fetch_add(1, std::memory_order_seq_cst);
+        if (m_map.m_epoch.load(std::memory_order_seq_cst) == epoch) {
+            return;
+        }
+        // A writer started a grace period meanwhile: count in the new epoch
+        m_map.m_readers[m_parity].fetch_sub(1, std::memory_order_seq_cst);
+    }
+}
+
+ExtendedMap::ReadSection::~ReadSection()
+{
+    m_map.m_readers[m_parity].fetch_sub(1, std::memory_order_release);
+}
+
 ExtendedMap::ExtendedMap()
+    : m_index(new Index_t())
+    , m_epoch(0)
+{
+    m_readers[0] = 0;
+    m_readers[1] = 0;
+}
+
+ExtendedMap::~ExtendedMap()
 {
+    const Index_t* index = m_index.load();
+    for (const auto& item : *index) {
+        delete item.second->value.load();
+        delete item.second;
+    }
+    delete index;
 }
 
-std::string ExtendedMap::keyList() {
+std::string ExtendedMap::keyList() const {
     std::string list;
     std::vector<std::string> vect;
-    for (const auto& item : m_map) {
-        vect.push_back(item.first);
+    {
+        ReadSection section(*this);
+        for (const auto& item : *m_index.load(std::memory_order_acquire)) {
+            vect.push_back(item.first);
+        }
     }
     std::sort (vect.begin(), vect.end());
     for (const std::string& item : vect)
@@ -35,17 +76,94 @@ std::string ExtendedMap::keyList() {
 
     return list;
 }
+
+void ExtendedMap::synchronize()
+{
+    // Readers that start from now on see the new epoch, thus what was
+    // published before: wait for the ones of the previous epoch.
+    unsigned epoch = m_epoch.load(std::memory_order_relaxed);
+    m_epoch.store(epoch + 1, std::memory_order_seq_cst);
+    while (m_readers[epoch & 1].load(std::memory_order_seq_cst) != 0) {
+        std::this_thread::yield();
+    }
+}
+
 void ExtendedMap::update(const std::string& key,const std::vector<unsigned char>& value)
 {
-    m_map[key] = value;
+    update(key, value.data(), value.size());
 }
 
 void ExtendedMap::update(const std::string& key, const unsigned char* ptr, const int size)
 {
-    unsigned char arr[size];
-    memcpy(&arr, ptr, size);
-    std::vector<unsigned char> v(arr, arr + size);
-    update(key, v);
+    // Built before taking the lock
+    const std::vector<unsigned char>* value = new std::vector<unsigned char>(ptr, ptr + size);
+
+    std::lock_guard<std::mutex> lock(m_writeMutex);
+    const Index_t* index = m_index.load(std::memory_order_relaxed);
+    auto it = index->find(key);
+    if (it == index->end()) {
+        Index_t* newIndex = new Index_t(*index);
+        (*newIndex)[key] = new Entry_t(value);
+        m_index.store(newIndex, std::memory_order_release);
+        this->synchronize();
+        delete index;
+    } else {
+        const std::vector<unsigned char>* old = it->second->value.exchange(value, std::memory_order_acq_rel);
+        it->second->version.fetch_add(1, std::memory_order_release);
+        this->synchronize();
+        delete old;
+    }
+}
+
+bool ExtendedMap::prepare(const std::vector<std::pair<std::string, std::vector<unsigned char> > >& values,
+                          Batch_t& batch)
+{
+    batch.entries.clear();
+    batch.values.clear();
+    {
+        ReadSection section(*this);
+        const Index_t* index = m_index.load(std::memory_order_acquire);
+        for (const auto& value : values) {
+            auto it = index->find(value.first);
+            if (it == index->end()) {
+                batch.entries.clear();
+                return false;
+            }
+            batch.entries.push_back(it->second);
+        }
+    }
+    for (const auto& value : values) {
+        batch.values.push_back(new std::vector<unsigned char>(value.second));
+    }
+    return true;
+}
+
+bool ExtendedMap::exchange(Batch_t& batch, bool wait)
+{
+    std::unique_lock<std::mutex> lock(m_writeMutex, std::defer_lock);
+    if (wait) {
+        lock.lock();
+    } else if (!lock.try_lock()) {
+        return false;
+    }
+    for (int i = 0 ; i < batch.entries.size() ; i++) {
+        batch.values[i] = batch.entries[i]->value.exchange(batch.values[i], std::memory_order_acq_rel);
+        batch.entries[i]->version.fetch_add(1, std::memory_order_release);
+    }
+    return true;
+}
+
+void ExtendedMap::reclaim(Batch_t& batch)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        this->synchronize();
+    }
+    for (const std::vector<unsigned char>* value : batch.values) {
+        delete value;
+    }
+    batch.entries.clear();
+    batch.values.clear();
 }
 
 void ExtendedMap::update(const std::string& key, const int value)
@@ -74,80 +192,110 @@ void ExtendedMap::update(const std::string& key, const arma::mat& value)
     update(key, (unsigned char*)value.memptr(), size);
 }
 
-const std::vector<unsigned char> ExtendedMap::get(const std::string& key) const
+std::vector<unsigned char> ExtendedMap::get(const std::string& key) const
 {
-    return m_map.at(key);
+    std::vector<unsigned char> value;
+    bool found = read(key, [&](const unsigned char* data, size_t size) {
+        value.assign(data, data + size);
+    });
+    if (!found) {
+        Logger::error(_ME_) << "[" << key << "] does not exist";
+    }
+    return value;
 }
 
-const unsigned char* ExtendedMap::get_raw(const std::string& key) const
+const ExtendedMap::Entry_t* ExtendedMap::entry(const std::string& key) const
 {
-    try {
-        auto v = m_map.at(key);
-        return m_map.at(key).data();
-    } catch (std::exception e) {
-        Logger::error(_ME_) << e.what() << " [" << key << "] does not exist";
+    ReadSection section(*this);
+    const Index_t* index = m_index.load(std::memory_order_acquire);
+    auto it = index->find(key);
+    if (it == index->end()) {
+        Logger::error(_ME_) << "[" << key << "] does not exist";
         return nullptr;
     }
+    return it->second;
+}
+
+bool ExtendedMap::has(const std::string& key) const
+{
+    ReadSection section(*this);
+    return (m_index.load(std::memory_order_acquire)->count(key) > 0);
 }
 
 std::string ExtendedMap::getAsString(const std::string& key) const
 {
-    const char* ptr = (const char*) get_raw(key);
-    if (ptr == nullptr) {
-        return std::string();
-    } else {
-        return std::string(ptr, get_sizeof(key)/sizeof(char));
+    std::string value;
+    bool found = read(key, [&](const unsigned char* data, size_t size) {
+        value.assign((const char*) data, size/sizeof(char));
+    });
+    if (!found) {
+        Logger::error(_ME_) << "[" << key << "] does not exist";
     }
+    return value;
 }
 
 int ExtendedMap::getAsInt(const std::string& key) const
 {
-    int* ptr = (int*) get_raw(key);
-    if (ptr == nullptr) {
-        return 0;
-    } else {
-        return *ptr;
+    int value = 0;
+    bool found = read(key, [&](const unsigned char* data, size_t size) {
+        if (size == sizeof(int)) {
+            memcpy(&value, data, size);
+        }
+    });
+    if (!found) {
+        Logger::error(_ME_) << "[" << key << "] does not exist";
     }
+    return value;
 }
 
 double ExtendedMap::getAsDouble(const std::string& key) const
 {
-    double* ptr = (double*) get_raw(key);
-    if (ptr == nullptr) {
-        return 0;
-    } else {
-        return *ptr;
+    double value = 0;
+    bool found = read(key, [&](const unsigned char* data, size_t size) {
+        if (size == sizeof(double)) {
+            memcpy(&value, data, size);
+        }
+    });
+    if (!found) {
+        Logger::error(_ME_) << "[" << key << "] does not exist";
     }
+    return value;
 }
 
 arma::vec ExtendedMap::getAsVec(const std::string& key) const
 {
-    double* ptr = (double*) get_raw(key);
-    if (ptr == nullptr) {
-        return arma::vec();
-    } else {
-        return arma::vec(ptr, get_sizeof(key)/sizeof(double));
+    arma::vec value;
+    bool found = read(key, [&](const unsigned char* data, size_t size) {
+        value = arma::vec((const double*) data, size/sizeof(double));
+    });
+    if (!found) {
+        Logger::error(_ME_) << "[" << key << "] does not exist";
     }
+    return value;
 }
 
 arma::mat ExtendedMap::getAsMat(const std::string& key, int nrows, int ncols) const
 {
-    double* ptr = (double*) get_raw(key);
-    if (ptr == nullptr) {
-        return arma::mat();
-    } else {
-        return arma::mat(ptr, nrows, ncols);
+    arma::mat value;
+    bool found = read(key, [&](const unsigned char* data, size_t size) {
+        if (size == nrows*ncols*sizeof(double)) {
+            value = arma::mat((const double*) data, nrows, ncols);
+        }
+    });
+    if (!found) {
+        Logger::error(_ME_) << "[" << key << "] does not exist";
     }
+    return value;
 }
 
 const int ExtendedMap::get_sizeof(const std::string& key) const
 {
     int size(0);
-    try {
-        auto v = m_map.at(key);
-        size = v.size();
-    } catch(const std::exception& e) {
-        Logger::error(_ME_) << e.what();
+    bool found = read(key, [&](const unsigned char* data, size_t valueSize) {
+        size = valueSize;
+    });
+    if (!found) {
+        Logger::error(_ME_) << "[" << key << "] does not exist";
     }
     return size;
 }
@@ -201,10 +349,28 @@ void ExtendedMap::selfTest() {
     else
         std::cout << "arma::mat failed" <<'\n';
 
-    m_map.erase("i");
-    m_map.erase("d");
-    m_map.erase("s");
-    m_map.erase("a");
-    m_map.erase("b");
+    erase("i");
+    erase("d");
+    erase("s");
+    erase("a");
+    erase("b");
+}
+
+void ExtendedMap::erase(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(m_writeMutex);
+    const Index_t* index = m_index.load(std::memory_order_relaxed);
+    auto it = index->find(key);
+    if (it == index->end()) {
+        return;
+    }
+    Entry_t* entry = it->second;
+    Index_t* newIndex = new Index_t(*index);
+    newIndex->erase(key);
+    m_index.store(newIndex, std::memory_order_release);
+    this->synchronize();
+    delete index;
+    delete entry->value.load();
+    delete entry;
 }
 #endif
@@ -20,27 +20,97 @@
 
 #include <armadillo>
 
+#include <atomic>
 #include <map>
+#include <mutex>
+#include <string>
+#include <vector>
 
 /**
  * @brief Class providing easier access to a std::map container containing various
  * types.
  *
  * All elements are saved as vectors of unsigned char.
+ *
+ * The map is shared between the Messenger thread and the correction loop. It
+ * is a read-copy-update store:
+ *  - A value is never modified: an update publishes a new value with an
+ *    atomic pointer swap and increments the version of the element.
+ *  - The index (key -> element) is copied when a key is added, then swapped.
+ *  - Readers enter a read section (two atomic increments/decrements), never
+ *    block and always see a whole value.
+ *  - Writers are serialized. The replaced values or index are deleted after
+ *    a grace period: when all the readers that could still see them are gone.
+ *
+ * Elements are never deleted (except in selfTest()), so that a Parameter
+ * can point to them.
  */
 class ExtendedMap
 {
 public:
+    /**
+     * @brief Element of the map.
+     */
+    struct Entry_t {
+        /**
+         * @brief Constructor.
+         */
+        explicit Entry_t(const std::vector<unsigned char>* v) : value(v), version(0) {}
+        std::atomic<const std::vector<unsigned char>*> value; /**< @brief Current value, never modified */
+        std::atomic<unsigned> version; /**< @brief Incremented at each update */
+    };
+
+    /**
+     * @brief Values of existing keys to set together (see prepare()).
+     */
+    struct Batch_t {
+        std::vector<Entry_t*> entries; /**< @brief Elements to set */
+        std::vector<const std::vector<unsigned char>*> values; /**< @brief New values, then the replaced ones */
+    };
+
+    /**
+     * @brief Read section: the values seen inside stay valid until it ends.
+     *
+     * \code{.cpp}
+     * {
+     *     ExtendedMap::ReadSection section(map);
+     *     const std::vector<unsigned char>* value = entry->value.load();
+     *     // use value
+     * }
+     * \endcode
+     */
+    class ReadSection
+    {
+    public:
+        /**
+         * @brief Enter the read section (never blocks).
+         */
+        explicit ReadSection(const ExtendedMap& map);
+
+        /**
+         * @brief Leave the read section.
+         */
+        ~ReadSection();
+
+    private:
+        const ExtendedMap& m_map; /**< @brief Map read */
+        unsigned m_parity; /**< @brief Counter incremented at the entry */
+    };
 
     /**
      * @brief Constructor
      */
     ExtendedMap();
 
+    /**
+     * @brief Destructor. No reader or writer must remain.
+     */
+    ~ExtendedMap();
+
     /**
      * @brief Return the list of all keys known by the std::map container
      */
-    std::string keyList();
+    std::string keyList() const;
 
     /**
      * @brief Update the std::map. If the key doesn't exist, it is created.
@@ -99,6 +169,34 @@ public:
      */
     void update(const std::string& key, const unsigned char* ptr, const int size);
 
+    /**
+     * @brief Build the values of a batch (allocates).
+     *
+     * @param values Keys and values
+     * @param[out] batch Batch to give to exchange()
+     * @return false if a key doesn't exist (the batch is then empty)
+     */
+    bool prepare(const std::vector<std::pair<std::string, std::vector<unsigned char> > >& values,
+                 Batch_t& batch);
+
+    /**
+     * @brief Publish all the values of a batch at once.
+     *
+     * Does not allocate, nor wait for a grace period: the replaced values are
+     * put in the batch, to be given to reclaim().
+     *
+     * @param batch Batch built by prepare()
+     * @param wait If false, give up instead of waiting for another writer
+     * @return false if it gave up (nothing was published)
+     */
+    bool exchange(Batch_t& batch, bool wait);
+
+    /**
+     * @brief Wait for the grace period and delete the values replaced by
+     * exchange().
+     */
+    void reclaim(Batch_t& batch);
+
     /**
      * @brief Get the size of an element.
      * @param key Key of the element which siwe is requested
@@ -108,20 +206,12 @@ public:
     const int get_sizeof(const std::string& key) const;
 
     /**
-     * @brief Get an element (as it is: vector of unsigned char).
+     * @brief Get a copy of an element (as it is: vector of unsigned char).
      * @param key Key of the element to return
      *
      * @return std::vector (empty if the key doesn't exist)
      */
-    const std::vector<unsigned char> get(const std::string& key) const;
-
-    /**
-     * @brief Get an element as a unsigned char* pointer.
-     * @param key Key of the element to return
-     *
-     * @return pointer to the requested element (nullptr if the key doesn't exist)
-     */
-    const unsigned char* get_raw(const std::string& key) const;
+    std::vector<unsigned char> get(const std::string& key) const;
 
     /**
      * @brief Get an element as an integer.
@@ -161,17 +251,28 @@ public:
      * @param nrows Number of rows
      * @param ncols Number of colunms
      *
-     * @return arma::mat object (empty if the key doesn't exist)
+     * @return arma::mat object (empty if the key doesn't exist or if the
+     *         element does not have nrows*ncols values)
      */
     arma::mat getAsMat(const std::string& key, int nrows, int ncols) const;
 
+    /**
+     * @brief Get the element of a key, to read it through a Parameter.
+     *
+     * The element stays at the same address as long as the map exists.
+     *
+     * @param key Key of the element
+     * @return pointer to the element (nullptr if the key doesn't exist)
+     */
+    const Entry_t* entry(const std::string& key) const;
+
     /**
      * @brief Check if the std::map contains a given key.
      *
      * @param key
      * @return true if it contains the key
      */
-    bool has(const std::string& key) { return (m_map.count(key) > 0); };
+    bool has(const std::string& key) const;
 
 #ifndef DEBUG
     /**
@@ -181,11 +282,63 @@ public:
 #endif
 
 private:
+    /**
+     * @brief Index of the elements.
+     */
+    typedef std::map<std::string, Entry_t*> Index_t;
+
+    /**
+     * @brief Call `reader(data, size)` on the current value of a key, in a
+     * read section.
+     *
+     * @return false if the key doesn't exist
+     */
+    template <typename F>
+    bool read(const std::string& key, F reader) const {
+        ReadSection section(*this);
+        const Index_t* index = m_index.load(std::memory_order_acquire);
+        auto it = index->find(key);
+        if (it == index->end()) {
+            return false;
+        }
+        const std::vector<unsigned char>* value = it->second->value.load(std::memory_order_acquire);
+        reader(value->data(), value->size());
+        return true;
+    }
+
+    /**
+     * @brief Wait until no reader can still see what was replaced before
+     * the call. To be called with m_writeMutex.
+     */
+    void synchronize();
+
+#ifndef DEBUG
+    /**
+     * @brief Remove a key. No Parameter must point to it.
+     */
+    void erase(const std::string& key);
+#endif
+
+    /**
+     * @brief Current index, never modified once published.
+     */
+    std::atomic<const Index_t*> m_index;
+
+    /**
+     * @brief Grace period counter: its parity tells which counter of
+     * m_readers new readers increment.
+     */
+    std::atomic<unsigned> m_epoch;
+
+    /**
+     * @brief Number of readers in a read section, per parity of m_epoch.
+     */
+    mutable std::atomic<int> m_readers[2];
 
     /**
-     * @brief std::map container we build on.
+     * @brief Mutex serializing the writers.
      */
-    std::map<std::string, std::vector<unsigned char> > m_map;
+    std::mutex m_writeMutex;
 };
 
 #endif // EXTENDEDMAP_H
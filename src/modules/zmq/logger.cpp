@@ -17,48 +17,107 @@
 
 #include  "modules/zmq/logger.h"
 
+#include <algorithm>
+#include <cstring>
 #include <ctime>
 
+#include "modules/flightrecorder.h"
+#include "modules/trace.h"
+#include "modules/zmq/asyncbackend.h"
+#include "modules/zmq/telemetry.h"
+
 bool Logger::Logger::m_debug = false;
 zmq_ext::socket_t* Logger::Logger::m_zmqSocket = NULL;
 RFMDriver* Logger::Logger::m_driver = NULL;
 int Logger::Logger::m_port = 3333;
 
-Logger::Logger::Logger(LogType type, std::string other)
- : m_logStream( new log_stream_t(type, other) )
- {}
+namespace {
+    /**
+     * @brief Copy a text into a record field, truncated if needed.
+     */
+    void copyText(char* field, const char* text)
+    {
+        strncpy(field, text, Logger::RECORD_TEXT_SIZE - 1);
+        field[Logger::RECORD_TEXT_SIZE - 1] = '\0';
+    }
+}
+
+Logger::Logger::Logger(LogType type, const char* other)
+    : m_stream(&m_buffer)
+{
+    m_record.type = type;
+    m_record.status = false;
+    m_record.message[0] = '\0';
+    copyText(m_record.other, other);
+    m_buffer.reset(m_record.message, RECORD_TEXT_SIZE);
+}
+
+Logger::Logger::Logger(Logger&& logger)
+    : m_stream(&m_buffer)
+{
+    m_record.type = logger.m_record.type;
+    m_record.status = logger.m_record.status;
+    m_record.message[0] = '\0';
+    copyText(m_record.other, logger.m_record.other);
+    m_buffer.reset(m_record.message, RECORD_TEXT_SIZE);
+    m_stream.write(logger.m_record.message, logger.m_buffer.length());
+
+    // The moved logger has nothing to output anymore
+    logger.m_buffer.reset(logger.m_record.message, RECORD_TEXT_SIZE);
+    logger.m_record.status = false;
+}
 
 Logger::Logger::~Logger()
 {
-    if (!m_logStream->message.str().empty())
-    {
-        this->parseAndSend();
+    int length = m_buffer.length();
+    if ((length == 0) && !m_record.status) {
+        return;
     }
-    delete m_logStream;
+    m_record.message[length] = '\0';
+    m_record.time = std::time(nullptr);
+    AsyncBackend::post(m_record);
 }
 
-void Logger::Logger::parseAndSend()
+void Logger::Logger::appendOther(const char* other)
 {
+    size_t length = strlen(m_record.other);
+    strncpy(m_record.other + length, other, RECORD_TEXT_SIZE - 1 - length);
+    m_record.other[RECORD_TEXT_SIZE - 1] = '\0';
+}
+
+void Logger::Logger::write(const LogRecord_t& record)
+{
+    if (record.status) {
+        // error are already shown by Logger::error()
+        if (!strcmp(record.other, " ")) {
+            std::cout << "Status: " << record.message << '\n';
+        }
+        if (!READONLY) {
+            sendRFM(record.message, record.other);
+        }
+        return;
+    }
+
     std::string header;
-    switch (m_logStream->header) {
+    switch (record.type) {
     case LogType::Log:
         header = "LOG";
         if (m_debug) {
             std::clog << '[' << header << "] "
-                      << m_logStream->message.str();
-            if (!m_logStream->other.empty())
-                std::clog << '\t' << m_logStream->other;
+                      << record.message;
+            if (record.other[0] != '\0')
+                std::clog << '\t' << record.other;
             std::clog << '\n';
         }
         break;
     case LogType::Error:
         header = "ERROR";
     std::cerr << "\x1b[1;31m[" << header << ' '
-              << m_logStream->message.str()
-              << "\t\x1b[31m[" << m_logStream->other << "]\x1b[0m\n";
+              << record.message
+              << "\t\x1b[31m[" << record.other << "]\x1b[0m\n";
     }
     if (m_zmqSocket != NULL) {
-       this->sendZmq(header, m_logStream->message.str(), m_logStream->other);
+       sendZmq(header, record.message, record.other, record.time);
     }
 }
 
@@ -82,14 +141,13 @@ int Logger::Logger::port() const
 void Logger::Logger::sendMessage(const std::string& message,
                                  const std::string& errorType)
 {
-    // error are already shown by Logger::error()
-    if (errorType == " ") {
-        std::cout << "Status: " << message << '\n';
-    }
-
-    if (!READONLY) {
-        this->sendRFM(message, errorType);
-    }
+    LogRecord_t record;
+    record.type = LogType::Log;
+    record.status = true;
+    record.time = std::time(nullptr);
+    copyText(record.message, message.c_str());
+    copyText(record.other, errorType.c_str());
+    AsyncBackend::post(record);
 }
 
 void Logger::Logger::sendRFM(const std::string& message, const std::string& error)
@@ -136,9 +194,9 @@ void Logger::Logger::sendRFM(const std::string& message, const std::string& erro
     free(mymem);
 }
 
-void Logger::Logger::sendZmq(const std::string& header, const std::string& message, const std::string& other)
+void Logger::Logger::sendZmq(const std::string& header, const std::string& message, const std::string& other,
+                             std::time_t rawtime)
 {
-    std::time_t rawtime = std::time(nullptr);
     std::string time = std::asctime(std::localtime(&rawtime));
     time = time.substr(0, time.size()-1); // Remove '\n' at the end of the string
 
@@ -153,6 +211,32 @@ void Logger::Logger::sendZmq(const std::string& header, const std::string& messa
     }
 }
 
+void Logger::Logger::sendFrame(unsigned char* frame)
+{
+    if (m_zmqSocket == NULL) {
+        FramePool::release(frame, nullptr);
+        return;
+    }
+    const FrameHeader_t* header = reinterpret_cast<const FrameHeader_t*>(frame);
+    // ZMQ calls FramePool::release() once the message is sent (or dropped)
+    zmq::message_t message(frame, header->frameSize, FramePool::release);
+    sendZmqMessage(message);
+}
+
+void Logger::Logger::sendZmqMessage(zmq::message_t& message)
+{
+    if (m_zmqSocket == NULL) {
+        return;
+    }
+    try {
+        m_zmqSocket->zmq::socket_t::send(message);
+    } catch (zmq::error_t &e) {
+        if (e.num() != EINTR) {
+            throw;
+        }
+    }
+}
+
 // Global functions
 void Logger::setDebug(bool debug)
 {
@@ -176,6 +260,9 @@ void Logger::postError(const unsigned int errornr)
 {
     Logger logger;
     if (errornr) {
+        // Keep the cycles that led to the error
+        FlightRecorder::freeze(errornr);
+        Trace::requestDump(Trace::Request::Error);
         Error::Error error(errornr);
         logger.sendMessage(error.message(), error.type());
     }
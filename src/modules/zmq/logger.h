@@ -18,10 +18,10 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
+#include <ctime>
 #include <string>
 #include <iostream>
-#include <sstream>
-#include <typeinfo>
+#include <streambuf>
 
 #include "define.h"
 #include "modules/zmq/zmqext.h"
@@ -42,29 +42,19 @@ enum class LogType {
     Error = 2,
 };
 
-/**
- * @brief Type of value
- */
-enum class LogValue {
-    None = 0,
-    BPM,
-    CM,
-    ADC
-};
 /**
  * @brief Logging Namespace.
  *
  * The subscribers can subscribe to
- *  * FOFB-ADC-DATA, FOFB-BPM-DATA, FOFB-CM-DATA
+ *  * FOFB-FRAME
+ *  * FOFB-AGG-<N> (see AggregateHeader_t)
+ *  * FOFB-LATENCY (see Latency::LatencyHeader_t)
  *  * LOG
  *  * ERROR
  *
- * The 3 first (type values) are composed of:
- *  0. the header (FOFB-XXX-DATA)
- *  1. the loop position (int between 0 and 512)
- *  2. the type of data ('short' if ADC, else 'double')
- *  3. Array of data (x-axis if BPM or CM)
- *  4. Array of data (only if BPM or CM: y-axis)
+ * FOFB-FRAME is the telemetry frame of each cycle (see FrameHeader_t): a
+ * single message with the BPM, CM and ADC values. FOFB-AGG-<N> are their
+ * statistics over N cycles, for slow subscribers (see Aggregator).
  *
  * LOG and ERROR are composed of:
  *  0. the header ('LOG' or 'ERROR')
@@ -82,19 +72,31 @@ enum class LogValue {
  *      Logger::error(_ME_) << "This is an error description";
  * \endcode
  *
- * To output data (here CM):
+ * To output the data of a cycle (see FrameHeader_t):
  * \code{.cpp}
- *      Logger::values(LogValue::CM, m_dma->status()->loopPos, std::vector<arma::vec>({CMx, CMy}));
+ *      Logger::frame(loopPos, typeCorr, times, counters, BPMx, BPMy, CMx, CMy, adc, ADC_BUFFER_SIZE);
  * \endcode
  *
+ * Logs are fixed-size records, frames come from the FramePool. When an
+ * AsyncBackend runs, they are formatted and sent by its thread; else they
+ * are sent directly.
  */
 namespace Logger {
 
-struct log_stream_t {
-    log_stream_t(LogType type, std::string s_other = "") : header(type), other(s_other) {}
-    LogType header;
-    std::ostringstream message;
-    std:: string other;
+/**
+ * @brief Size of the texts of a LogRecord_t (longer texts are truncated).
+ */
+const int RECORD_TEXT_SIZE = 256;
+
+/**
+ * @brief A log line, an error or a status message, before formatting.
+ */
+struct LogRecord_t {
+    LogType type;   /**< @brief Log or Error */
+    bool status;    /**< @brief Status message (see Logger::sendMessage()) */
+    std::time_t time; /**< @brief Time of emission */
+    char message[RECORD_TEXT_SIZE]; /**< @brief Message (null-terminated) */
+    char other[RECORD_TEXT_SIZE];   /**< @brief Secondary message (null-terminated) */
 };
 
 /**
@@ -106,6 +108,10 @@ struct log_stream_t {
  * ~~~~
  * The log is output at destruction of the object.
  *
+ * The message is written in a fixed-size LogRecord_t held by the object: no
+ * allocation is done while logging (as long as the streamed values do not
+ * allocate themselves).
+ *
  * Relies on some static variables (m_debug, m_port, m_socket, m_driver).
  *
  * @see See \ref #Logger to see  more detailled information.
@@ -116,9 +122,18 @@ public:
     /**
      * @brief Constructor
      *
-     * The ZMQ publisher socket is set here with the default port.
+     * @param type Type of log
+     * @param other Secondary message
+     */
+    explicit Logger(LogType type = LogType::Log, const char* other = "");
+
+    /**
+     * @brief Move constructor (see error()). The moved logger outputs nothing.
      */
-    explicit Logger(LogType type = LogType::Log, std::string other="");
+    Logger(Logger&& logger);
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
 
     /**
      * @brief Destructor
@@ -130,47 +145,41 @@ public:
      */
     void setRFM(RFMDriver* driver) { Logger::m_driver = driver; }
 
+    /**
+     * @brief Output a status message (on the standard output if it is not
+     * an error, and on the RFM).
+     *
+     * @param message Message
+     * @param errorType Type of error (" " if it is not an error)
+     */
     void sendMessage(const std::string &message, const std::string &errorType=" ");
-    void sendZmq(const std::string& header, const std::string& message, const std::string& other);
 
-    template <typename T>
-    void sendZmqValue(const std::string& header, const int loopPos, const std::vector<T>& values)
-    {
-        if (values.size() == 0) {
-            "ERROR -- Tried to send empty values, return";
-            return;
-        }
-
-        try {
-            m_zmqSocket->send(header, ZMQ_SNDMORE);
-            m_zmqSocket->send(loopPos, ZMQ_SNDMORE);
-            std::string type;
-            if (typeid(values.at(0).at(0)) == typeid(double)) {
-                type = "double";
-            } else if (typeid(values.at(0).at(0)) == typeid(short)) {
-                type = "short";
-            }
-            m_zmqSocket->send(type, ZMQ_SNDMORE);
-
-            // Loop until size-1 because last should not have a ZMQ_SNDMORE flag
-            for (int i = 0 ; i < values.size() - 1 ; i++) {
-                m_zmqSocket->send(values.at(i), ZMQ_SNDMORE);
-            }
-            m_zmqSocket->send(values.back());
-
-        } catch (zmq::error_t &e) {
-            if (e.num() != EINTR) {
-                throw;
-            }
-        }
-    }
+    /**
+     * @brief Append to the secondary message.
+     */
+    void appendOther(const char* other);
 
     /**
-     * @brief Send message to the RFM.
-     * @param message message
-     * @param error type of error (= Status)
+     * @brief Format and output a record (logs, ZMQ, RFM).
+     *
+     * Called by the AsyncBackend thread, or directly if there is none.
      */
-    void sendRFM(const std::string& message, const std::string& error);
+    static void write(const LogRecord_t& record);
+
+    /**
+     * @brief Send a telemetry frame of the FramePool over ZMQ without copying
+     * it. The buffer is given back to the pool once sent.
+     *
+     * Called by the AsyncBackend thread, or directly if there is none.
+     */
+    static void sendFrame(unsigned char* frame);
+
+    /**
+     * @brief Send a single-part message over ZMQ (if the socket is set).
+     *
+     * Called by the AsyncBackend thread, or directly if there is none.
+     */
+    static void sendZmqMessage(zmq::message_t& message);
 
     /**
      * @brief Set/Unset the debug mode
@@ -199,21 +208,46 @@ public:
      */
     bool hasDebug() const { return m_debug; }
 
-    /**
-     * @brief Acess to m_logStream
-     */
-    log_stream_t* logStream() { return m_logStream; };
-
     /**
      * @brief Append to the message buffer.
      *
      * @param value value to add to the buffer.
      * @return A Logger object
      */
-    template <typename T> Logger &operator<<(T value) { m_logStream->message << value; return *this;}
+    template <typename T> Logger &operator<<(const T& value) { m_stream << value; return *this;}
 
 private:
-    void parseAndSend();
+    /**
+     * @brief Stream buffer writing into a fixed-size array.
+     *
+     * One character is kept for the final '\0'; what does not fit is lost.
+     */
+    class RecordBuffer : public std::streambuf
+    {
+    public:
+        /**
+         * @brief Write into `size-1` characters from `begin`.
+         */
+        void reset(char* begin, int size) { this->setp(begin, begin + size - 1); }
+
+        /**
+         * @brief Number of characters written.
+         */
+        int length() const { return this->pptr() - this->pbase(); }
+    };
+
+    /**
+     * @brief Send a message over ZMQ.
+     */
+    static void sendZmq(const std::string& header, const std::string& message, const std::string& other,
+                        std::time_t time);
+
+    /**
+     * @brief Send message to the RFM.
+     * @param message message
+     * @param error type of error (= Status)
+     */
+    static void sendRFM(const std::string& message, const std::string& error);
 
     static RFMDriver* m_driver;
 
@@ -226,8 +260,11 @@ private:
      * @brief Is the mBox in debug mode?
      */
     static bool m_debug;
-    log_stream_t* m_logStream;
     static int m_port;
+
+    LogRecord_t m_record; /**< @brief Record being written */
+    RecordBuffer m_buffer; /**< @brief Buffer on m_record.message */
+    std::ostream m_stream; /**< @brief Stream on m_buffer */
 };
 
 
@@ -246,43 +283,11 @@ void setSocket(zmq_ext::socket_t* socket);
  */
 void setPort(const int port);
 
-/**
- * @brief Send a value over ZMQ.
- */
-void values(LogValue name, const int loopPos, const arma::vec& valueX, const arma::vec& valueY);
-
-/**
- * @brief Send a value over ZMQ.
- */
-void values(LogValue name, const int loopPos, const std::vector<RFM2G_INT16>& value);
-
-template <typename T>
-void values(LogValue name, const int loopPos, const std::vector<T> values)
-{
-    std::string header;
-    switch (name) {
-    case LogValue::BPM:
-        header = "FOFB-BPM-DATA";
-        break;
-    case LogValue::CM:
-        header = "FOFB-CM-DATA";
-        break;
-    case LogValue::ADC:
-        header = "FOFB-ADC-DATA";
-        break;
-    default:
-        std::cout << "ERROR -- Tried to send values of unexpected type. RETURN";
-        return;
-    }
-    Logger logger;
-    logger.sendZmqValue(header, loopPos, values);
-}
-
 /**
  * @brief Global wrapper to log errors.
  *
  * @param fctname Name of the function in which is the error.
- * @return Stream Logger::m_logStream.message;
+ * @return Logger to stream the message into.
  *
  * Use it as:
  * \code{.cpp}
@@ -290,10 +295,17 @@ void values(LogValue name, const int loopPos, const std::vector<T> values)
  * \endcode
  * A prepocessor macro `_ME_` is used for `__PRETTY_FUNCTION__`.
  */
-inline Logger error(std::string fctname) { return Logger(LogType::Error, "in " + fctname); }
+inline Logger error(const char* fctname)
+{
+    Logger logger(LogType::Error, "in ");
+    logger.appendOther(fctname);
+    return logger;
+}
 
 /**
  * @brief Global function to post an error code on the RFM.
+ *
+ * Also freezes the FlightRecorder, which saves the last cycles.
  */
 void postError(const unsigned int errornr);
 
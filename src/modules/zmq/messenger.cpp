@@ -19,29 +19,45 @@
 #include "modules/zmq/logger.h"
 
 #include <algorithm>
+#include <chrono>
 
 
 
 #define STOP_MESSAGE "STOP-NOW" /**< @brief Message to stop the ZMQ server */
 #define STOP_SOCKET "406812310648" /**< @brief ID of the server allowed to stop the ZMQ server */
 
+/**
+ * @brief Time after which a commit is applied by the server (loop not running).
+ */
+const std::chrono::seconds COMMIT_TIMEOUT(1);
+
 Messenger::Messenger::Messenger(zmq::context_t& context)
     : m_serve(false)
+    , m_nextListener(0)
+    , m_commitState(NoCommit)
+    , m_commitLoopPos(0)
 {
-    m_map.update("AMPLITUDES-X-10", arma::vec());
-    m_map.update("PHASES-X-10", arma::vec());
-    m_editableKeys.push_back("AMPLITUDES-X-10");
-    m_editableKeys.push_back("PHASES-X-10");
+    // Published by Handler::init(), inverted again in the background when set
+    m_editableKeys.push_back("SMAT-X");
+    m_editableKeys.push_back("SMAT-Y");
+    m_editableKeys.push_back("IVEC-X");
+    m_editableKeys.push_back("IVEC-Y");
+    m_editableSizes["IVEC-X"] = sizeof(double);
+    m_editableSizes["IVEC-Y"] = sizeof(double);
 
-    m_map.update("AMPLITUDES-Y-10", arma::vec());
-    m_map.update("PHASES-Y-10", arma::vec());
-    m_editableKeys.push_back("AMPLITUDES-Y-10");
-    m_editableKeys.push_back("PHASES-Y-10");
+    // Published by CorrectionProcessor::initPID(), applied at the next cycle
+    for (const char* key : { "PID-P-X", "PID-I-X", "PID-D-X", "PID-WINDUP-X",
+                                    "PID-P-Y", "PID-I-Y", "PID-D-Y", "PID-WINDUP-Y",
+                                    "PID-RAMP" }) {
+        m_editableKeys.push_back(key);
+    }
+    m_editableSizes["PID-RAMP"] = sizeof(double);
 
-    m_map.update("AMPLITUDE-REF-10", static_cast<double>(1));
-    m_map.update("PHASE-REF-10", static_cast<double>(0));
-    m_editableKeys.push_back("AMPLITUDE-REF-10");
-    m_editableKeys.push_back("PHASE-REF-10");
+    // Taken into account at the next initialization of the correction
+    m_map.update("FEED-FORWARD-X", arma::vec());
+    m_map.update("FEED-FORWARD-Y", arma::vec());
+    m_editableKeys.push_back("FEED-FORWARD-X");
+    m_editableKeys.push_back("FEED-FORWARD-Y");
 
     m_socket = new zmq_ext::socket_t(context, ZMQ_ROUTER);
     m_port = 3334;
@@ -79,9 +95,15 @@ void Messenger::Messenger::servingLoop()
             m_serve = false;
             std::string s = "ACK";
             m_socket->send(s);
+        } else if (message == "BEGIN") {
+            this->serveBegin(identity);
+        } else if (message == "COMMIT") {
+            this->serveCommit(identity);
+        } else if (message == "ABORT") {
+            this->serveAbort(identity);
         } else if (!message.compare(0, prefixSet.length(), prefixSet) && request.size() > 3) {
             std::string key = message.substr(prefixGet.length(), message.npos);
-            this->serveSet(key, request[3]);
+            this->serveSet(identity, key, request[3]);
         } else if (!message.compare(0, prefixGet.length(), prefixGet)) {
             std::string key =  message.substr(prefixGet.length(), message.npos);
             this->serveGet(key);
@@ -96,36 +118,159 @@ void Messenger::Messenger::servingLoop()
 void Messenger::Messenger::serveHelp()
 {
     std::string s;
-    s = "Use: HELP, KEYLIST, SET <KEY> <VALUE>, GET <KEY>\n\n";
+    s = "Use: HELP, KEYLIST, SET <KEY> <VALUE>, GET <KEY>\n"
+        "To set several keys at the same cycle: BEGIN, SET..., COMMIT (or ABORT)\n\n";
     s += "AVAILABLE KEYS TO GET\n"
          "=====================\n"
          + m_map.keyList() + '\n';
     s += "AVAILABLE KEYS TO SET\n"
          "=====================\n";
-    for (const std::string& key : m_editableKeys) {
-        s += key + '\n';
+    {
+        std::lock_guard<std::mutex> lock(m_editableMutex);
+        for (const std::string& key : m_editableKeys) {
+            s += key + '\n';
+        }
     }
     m_socket->send(s);
 }
-void Messenger::Messenger::serveSet(const std::string& key, const zmq::message_t& request)
+bool Messenger::Messenger::isEditable(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(m_editableMutex);
+    return (std::find(m_editableKeys.begin(), m_editableKeys.end(), key) != m_editableKeys.end());
+}
+
+bool Messenger::Messenger::hasEditableSize(const std::string& key, size_t size)
+{
+    std::lock_guard<std::mutex> lock(m_editableMutex);
+    auto it = m_editableSizes.find(key);
+    return ((it == m_editableSizes.end()) || (it->second == size));
+}
+
+void Messenger::Messenger::notifyListeners(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(m_listenersMutex);
+    auto it = m_listeners.find(key);
+    if (it != m_listeners.end()) {
+        for (auto& listener : it->second) {
+            listener.second();
+        }
+    }
+}
+
+void Messenger::Messenger::serveSet(const std::string& identity, const std::string& key,
+                                    const zmq::message_t& request)
 {
-    bool editable = (std::find(m_editableKeys.begin(), m_editableKeys.end(), key) != m_editableKeys.end());
-    if (m_map.has(key) && editable) {
-        m_map.update(key, (unsigned char*) request.data(), request.size());
+    if (!m_map.has(key) || !this->isEditable(key)) {
+        std::string s = "KEY ERROR";
+        m_socket->send(s);
+        return;
+    }
+    if (!this->hasEditableSize(key, request.size())) {
+        std::string s = "SIZE ERROR";
+        m_socket->send(s);
+        return;
+    }
+
+    const unsigned char* data = (const unsigned char*) request.data();
+    auto transaction = m_transactions.find(identity);
+    if (transaction != m_transactions.end()) {
+        transaction->second.push_back(std::make_pair(key, std::vector<unsigned char>(data, data + request.size())));
         std::string s = "ACK";
         m_socket->send(s);
-    } else {
+        return;
+    }
+
+    m_map.update(key, data, request.size());
+    std::string s = "ACK";
+    m_socket->send(s);
+
+    this->notifyListeners(key);
+}
+
+void Messenger::Messenger::serveBegin(const std::string& identity)
+{
+    // A second BEGIN starts again from scratch
+    m_transactions[identity].clear();
+    std::string s = "ACK";
+    m_socket->send(s);
+}
+
+void Messenger::Messenger::serveAbort(const std::string& identity)
+{
+    m_transactions.erase(identity);
+    std::string s = "ACK";
+    m_socket->send(s);
+}
+
+void Messenger::Messenger::serveCommit(const std::string& identity)
+{
+    auto transaction = m_transactions.find(identity);
+    if (transaction == m_transactions.end()) {
+        std::string s = "TRANSACTION ERROR";
+        m_socket->send(s);
+        return;
+    }
+    std::vector<std::pair<std::string, std::vector<unsigned char> > > values;
+    values.swap(transaction->second);
+    m_transactions.erase(transaction);
+
+    if (!m_map.prepare(values, m_commitBatch)) {
         std::string s = "KEY ERROR";
         m_socket->send(s);
+        return;
+    }
+
+    // Applied by the loop at its next cycle, or here if it does not run.
+    m_commitState.store(Pending, std::memory_order_release);
+    auto deadline = std::chrono::steady_clock::now() + COMMIT_TIMEOUT;
+    std::string reply;
+    while (true) {
+        if (m_commitState.load(std::memory_order_acquire) == Applied) {
+            reply = "ACK " + std::to_string(m_commitLoopPos.load());
+            break;
+        }
+        int expected = Pending;
+        if ((std::chrono::steady_clock::now() > deadline)
+                && m_commitState.compare_exchange_strong(expected, Taken)) {
+            m_map.exchange(m_commitBatch, true);
+            reply = "ACK IDLE";
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    m_map.reclaim(m_commitBatch);
+    m_commitState.store(NoCommit, std::memory_order_release);
+    m_socket->send(reply);
+
+    for (const auto& value : values) {
+        this->notifyListeners(value.first);
+    }
+}
+
+void Messenger::Messenger::applyCommit(int loopPos)
+{
+    if (m_commitState.load(std::memory_order_acquire) != Pending) {
+        return;
+    }
+    int expected = Pending;
+    if (!m_commitState.compare_exchange_strong(expected, Taken)) {
+        return;
     }
+    if (!m_map.exchange(m_commitBatch, false)) {
+        // Another writer is busy: next cycle
+        m_commitState.store(Pending, std::memory_order_release);
+        return;
+    }
+    m_commitLoopPos.store(loopPos, std::memory_order_relaxed);
+    m_commitState.store(Applied, std::memory_order_release);
 }
 
 void Messenger::Messenger::serveGet(const std::string& key)
 {
     if (m_map.has(key)) {
-        int size = m_map.get_sizeof(key);
-        zmq::message_t msg(size);
-        memcpy(msg.data(), m_map.get_raw(key), size);
+        std::vector<unsigned char> value = m_map.get(key);
+        zmq::message_t msg(value.size());
+        memcpy(msg.data(), value.data(), value.size());
         m_socket->zmq::socket_t::send(msg);
     } else {
         std::string s = "KEY ERROR";
@@ -133,6 +278,28 @@ void Messenger::Messenger::serveGet(const std::string& key)
     }
 }
 
+void Messenger::Messenger::get(const std::string& key, arma::mat& value, int nrows, int ncols) const
+{
+    value = m_map.getAsMat(key, nrows, ncols);
+}
+
+int Messenger::Messenger::addListener(const std::string& key, const std::function<void()>& listener)
+{
+    std::lock_guard<std::mutex> lock(m_listenersMutex);
+    int id = m_nextListener++;
+    m_listeners[key][id] = listener;
+    return id;
+}
+
+void Messenger::Messenger::removeListener(int id)
+{
+    // Listeners are called with the lock held: none is running after this
+    std::lock_guard<std::mutex> lock(m_listenersMutex);
+    for (auto& listeners : m_listeners) {
+        listeners.second.erase(id);
+    }
+}
+
 void Messenger::Messenger::startServing()
 {
     Logger::Logger() << "Starting server thread...";
@@ -20,11 +20,18 @@
 
 #include <armadillo>
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <string>
 #include <thread>
+#include <type_traits>
 #include <vector>
 
 #include "modules/zmq/extendedmap.h"
+#include "modules/zmq/parameter.h"
 #include "modules/zmq/zmqext.h"
 
 
@@ -77,6 +84,11 @@ public:
      */
     int port() const;
 
+    /**
+     * @brief Access to the serving thread (e.g. to set its affinity).
+     */
+    std::thread& serverThread() { return m_serverThread; }
+
     /**
      * @brief Shortcut function to update m_map
      */
@@ -99,7 +111,98 @@ public:
         value = m_map.getAsDouble(key);
     }
 
+    /**
+     * @brief Shortcut function to get m_map[key]
+     */
+    void get(const std::string& key, int& value) const {
+        value = m_map.getAsInt(key);
+    }
+
+    /**
+     * @brief Shortcut function to get m_map[key] as a matrix.
+     *
+     * `value` is emptied if the stored value does not have nrows*ncols elements.
+     */
+    void get(const std::string& key, arma::mat& value, int nrows, int ncols) const;
+
+    /**
+     * @brief Resolve a key into a typed handle, to read it in the loop.
+     *
+     * The key must exist (else the handle is invalid).
+     */
+    template <typename T>
+    Parameter<T> parameter(const std::string& key) const {
+        return Parameter<T>(&m_map, m_map.entry(key));
+    }
+
+    /**
+     * @brief Make a key editable through the server.
+     *
+     * The key is created with `defaultValue` if it does not exist yet. Used
+     * for keys that depend on the configuration (e.g. one per harmonic).
+     * If T is a number, a value of another size is rejected by the server.
+     *
+     * @param key Key to make editable
+     * @param defaultValue Value of the key if it does not exist
+     */
+    template <typename T>
+    void addEditableKey(const std::string& key, const T& defaultValue) {
+        std::lock_guard<std::mutex> lock(m_editableMutex);
+        if (!m_map.has(key)) {
+            m_map.update(key, defaultValue);
+        }
+        if (std::find(m_editableKeys.begin(), m_editableKeys.end(), key) == m_editableKeys.end()) {
+            m_editableKeys.push_back(key);
+        }
+        if (std::is_arithmetic<T>::value) {
+            m_editableSizes[key] = sizeof(T);
+        }
+    }
+
+    /**
+     * @brief Call a function each time a key is set through the server.
+     *
+     * The listener is called from the serving thread, after the reply was
+     * sent: it should be short (e.g. hand the work over to another thread).
+     *
+     * @param key Key to listen to
+     * @param listener Function to call
+     * @return Identifier of the listener, to give to removeListener()
+     */
+    int addListener(const std::string& key, const std::function<void()>& listener);
+
+    /**
+     * @brief Stop calling a listener.
+     *
+     * When it returns, the listener is not running and will not be called
+     * again: its owner can be destroyed.
+     *
+     * @param id Identifier returned by addListener()
+     */
+    void removeListener(int id);
+
+    /**
+     * @brief Apply the committed transaction, if any (called by the loop at
+     * the beginning of a cycle).
+     *
+     * Costs one atomic load when there is nothing to apply. Never blocks:
+     * if the map is being written, it is tried again at the next cycle.
+     *
+     * @param loopPos Position of the cycle, sent back to the client
+     */
+    void applyCommit(int loopPos);
+
 private:
+    /**
+     * @brief State of the transaction handed over to the loop.
+     */
+    enum CommitState {
+        NoCommit = 0, /**< @brief Nothing to apply */
+        Pending,      /**< @brief To apply at the next cycle */
+        Taken,        /**< @brief Being applied */
+        Applied       /**< @brief Applied at m_commitLoopPos */
+    };
+
     /**
      * @brief Function containing the REQ/REP loop.
      */
@@ -108,10 +211,55 @@ private:
     /**
      * @brief Process a `SET` request.
      *
+     * Inside a transaction, the value is only staged.
+     *
+     * @param identity Identity of the client
      * @param key Key of the value to set.
      * @param request Contains the value
      */
-    void serveSet(const std::string& key, const zmq::message_t& request);
+    void serveSet(const std::string& identity, const std::string& key, const zmq::message_t& request);
+
+    /**
+     * @brief Process a `BEGIN` request: start a transaction.
+     *
+     * @param identity Identity of the client
+     */
+    void serveBegin(const std::string& identity);
+
+    /**
+     * @brief Process a `COMMIT` request.
+     *
+     * The staged values are applied together by the loop at the beginning of
+     * its next cycle, and the reply is `ACK <loopPos>`. If the loop does not
+     * run, they are applied after a timeout and the reply is `ACK IDLE`.
+     *
+     * @param identity Identity of the client
+     */
+    void serveCommit(const std::string& identity);
+
+    /**
+     * @brief Process an `ABORT` request: drop the staged values.
+     *
+     * @param identity Identity of the client
+     */
+    void serveAbort(const std::string& identity);
+
+    /**
+     * @brief Is a key editable through the server?
+     */
+    bool isEditable(const std::string& key);
+
+    /**
+     * @brief Can a value of this size be set to an editable key?
+     *
+     * Only the size of numbers is known (see m_editableSizes).
+     */
+    bool hasEditableSize(const std::string& key, size_t size);
+
+    /**
+     * @brief Call the listeners of a key.
+     */
+    void notifyListeners(const std::string& key);
 
     /**
      * @brief Process a `GET` request.
@@ -150,6 +298,52 @@ private:
      */
     std::vector<std::string> m_editableKeys;
 
+    /**
+     * @brief Size of the editable keys that hold a number. Otherwise, a
+     * value of the wrong size would be read as 0 (see Parameter::get()).
+     */
+    std::map<std::string, size_t> m_editableSizes;
+
+    /**
+     * @brief Mutex protecting m_editableKeys and m_editableSizes.
+     */
+    std::mutex m_editableMutex;
+
+    /**
+     * @brief Functions to call when a key is set through the server.
+     */
+    std::map<std::string, std::map<int, std::function<void()> > > m_listeners;
+
+    /**
+     * @brief Identifier of the next listener.
+     */
+    int m_nextListener;
+
+    /**
+     * @brief Mutex protecting m_listeners and m_nextListener.
+     */
+    std::mutex m_listenersMutex;
+
+    /**
+     * @brief Staged values of the open transactions, per client identity.
+     */
+    std::map<std::string, std::vector<std::pair<std::string, std::vector<unsigned char> > > > m_transactions;
+
+    /**
+     * @brief Values of the transaction being committed.
+     */
+    ExtendedMap::Batch_t m_commitBatch;
+
+    /**
+     * @brief State of m_commitBatch (see CommitState).
+     */
+    std::atomic<int> m_commitState;
+
+    /**
+     * @brief Position of the cycle at which m_commitBatch was applied.
+     */
+    std::atomic<int> m_commitLoopPos;
+
     /**
      * @brief Server socket
      */
@@ -183,5 +377,56 @@ void get(const std::string& key, T& value) {
     messenger.get(key, value);
 }
 
+/**
+ * @brief Global shortcut to Messenger::parameter method.
+ *
+ * @param key Key to resolve
+ * @return Handle on the value of the key
+ */
+template <typename T>
+Parameter<T> parameter(const std::string& key) {
+    return messenger.parameter<T>(key);
+}
+
+/**
+ * @brief Global shortcut to Messenger::applyCommit method.
+ *
+ * @param loopPos Position of the cycle
+ */
+inline void applyCommit(int loopPos) {
+    messenger.applyCommit(loopPos);
+}
+
+/**
+ * @brief Global shortcut to Messenger::addEditableKey method.
+ *
+ * @param key Key to make editable
+ * @param defaultValue Value of the key if it does not exist
+ */
+template <typename T>
+void addEditableKey(const std::string& key, const T& defaultValue) {
+    messenger.addEditableKey(key, defaultValue);
+}
+
+/**
+ * @brief Global shortcut to Messenger::addListener method.
+ *
+ * @param key Key to listen to
+ * @param listener Function to call when the key is set
+ * @return Identifier of the listener, to give to removeListener()
+ */
+inline int addListener(const std::string& key, const std::function<void()>& listener) {
+    return messenger.addListener(key, listener);
+}
+
+/**
+ * @brief Global shortcut to Messenger::removeListener method.
+ *
+ * @param id Identifier returned by addListener()
+ */
+inline void removeListener(int id) {
+    messenger.removeListener(id);
+}
+
 }
 #endif
@@ -0,0 +1,138 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PARAMETER_H
+#define PARAMETER_H
+
+#include <armadillo>
+
+#include <atomic>
+#include <cstring>
+
+#include "modules/zmq/extendedmap.h"
+
+namespace Messenger {
+
+/**
+ * @brief Typed handle on a value of the Messenger.
+ *
+ * The key is resolved once, when the handle is created. Afterwards, checking
+ * whether the value was set is one atomic load, and the value is only copied
+ * again (in a read section, without blocking) when its version changed.
+ *
+ * \code{.cpp}
+ * Messenger::Parameter<double> ampRef = Messenger::parameter<double>("AMPLITUDE-REF-10");
+ * // In the loop
+ * if (ampRef.changed()) {
+ *     this->rebuild(ampRef.get());
+ * }
+ * \endcode
+ */
+template <typename T>
+class Parameter
+{
+public:
+    /**
+     * @brief Constructor of an invalid handle.
+     */
+    Parameter() : m_map(nullptr), m_entry(nullptr), m_version(NEVER_READ) {}
+
+    /**
+     * @brief Constructor.
+     *
+     * @param map Map containing the element
+     * @param entry Element of the map (see ExtendedMap::entry())
+     */
+    Parameter(const ExtendedMap* map, const ExtendedMap::Entry_t* entry)
+        : m_map(map), m_entry(entry), m_version(NEVER_READ) {}
+
+    /**
+     * @brief Does the handle point to an existing key?
+     */
+    bool valid() const { return (m_entry != nullptr); }
+
+    /**
+     * @brief Was the value set since the last call to get()?
+     *
+     * Always true before the first call to get().
+     */
+    bool changed() const {
+        return valid() && (m_entry->version.load(std::memory_order_acquire) != m_version);
+    }
+
+    /**
+     * @brief Return the value, copied again only if it changed.
+     *
+     * The value is T() if the handle is invalid or if the stored size does
+     * not match T.
+     */
+    const T& get() {
+        if (this->changed()) {
+            this->fetch();
+        }
+        return m_value;
+    }
+
+private:
+    /**
+     * @brief Version given to a handle that was never read (an element
+     * would need 2^32-1 updates to reach it).
+     */
+    static const unsigned NEVER_READ = 0xFFFFFFFF;
+
+    /**
+     * @brief Copy the value, in a read section of the map.
+     */
+    void fetch() {
+        ExtendedMap::ReadSection section(*m_map);
+        // Read before the value: at worst, the same value is fetched again
+        unsigned version = m_entry->version.load(std::memory_order_acquire);
+        const std::vector<unsigned char>* value = m_entry->value.load(std::memory_order_acquire);
+        decode(value->data(), value->size(), m_value);
+        m_version = version;
+    }
+
+    /**
+     * @brief Convert raw bytes to a value of type T.
+     */
+    static void decode(const unsigned char* data, size_t size, T& value) {
+        if (size == sizeof(T)) {
+            memcpy(&value, data, size);
+        } else {
+            value = T();
+        }
+    }
+
+    const ExtendedMap* m_map; /**< @brief Map containing m_entry */
+    const ExtendedMap::Entry_t* m_entry; /**< @brief Element of the map */
+    unsigned m_version; /**< @brief Version of m_value */
+    T m_value; /**< @brief Last value read */
+};
+
+/**
+ * @brief Specialization for vectors: the storage of the last value is
+ * reused if the size did not change.
+ */
+template <>
+inline void Parameter<arma::vec>::decode(const unsigned char* data, size_t size, arma::vec& value) {
+    value.set_size(size/sizeof(double));
+    memcpy(value.memptr(), data, value.n_elem*sizeof(double));
+}
+
+}
+
+#endif // PARAMETER_H
@@ -0,0 +1,219 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "modules/zmq/telemetry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <limits>
+
+#include "modules/zmq/asyncbackend.h"
+
+Logger::FramePool::Slot_t Logger::FramePool::s_slots[POOL_SIZE];
+std::atomic<unsigned> Logger::FramePool::s_next(0);
+
+namespace {
+    Logger::TelemetryConfig_t s_config = { true, { 15, 150 } };
+
+    /**
+     * @brief Copy `size` bytes into the frame at `offset`.
+     *
+     * @return The new offset.
+     */
+    size_t copyPayload(unsigned char* frame, size_t offset, const void* values, size_t size)
+    {
+        memcpy(frame + offset, values, size);
+        return offset + size;
+    }
+}
+
+Logger::TelemetryConfig_t& Logger::telemetryConfig()
+{
+    return s_config;
+}
+
+unsigned char* Logger::FramePool::acquire()
+{
+    unsigned start = s_next.load(std::memory_order_relaxed);
+    for (unsigned i = 0 ; i < POOL_SIZE ; i++) {
+        Slot_t& slot = s_slots[(start + i) % POOL_SIZE];
+        bool used = false;
+        if (slot.used.compare_exchange_strong(used, true, std::memory_order_acquire)) {
+            s_next.store(start + i + 1, std::memory_order_relaxed);
+            return slot.data;
+        }
+    }
+    return nullptr;
+}
+
+void Logger::FramePool::release(void* data, void* /*hint*/)
+{
+    for (size_t i = 0 ; i < POOL_SIZE ; i++) {
+        if (s_slots[i].data == data) {
+            s_slots[i].used.store(false, std::memory_order_release);
+            return;
+        }
+    }
+}
+
+void Logger::frame(int loopPos, int typeCorr, const StageTimes_t& times, const StageCounters_t& counters,
+                   const arma::vec& BPMx, const arma::vec& BPMy,
+                   const arma::vec& CMx, const arma::vec& CMy,
+                   const RFM2G_INT16* adc, int adcSize)
+{
+    static std::atomic<uint64_t> sequence(0);
+    uint64_t number = sequence.fetch_add(1, std::memory_order_relaxed);
+
+    unsigned char* buffer = FramePool::acquire();
+    if (buffer == nullptr) {
+        AsyncBackend::countDropped();
+        return;
+    }
+
+    FrameHeader_t* header = reinterpret_cast<FrameHeader_t*>(buffer);
+    memset(header, 0, sizeof(FrameHeader_t));
+    strncpy(header->topic, TELEMETRY_TOPIC, sizeof(header->topic));
+    header->version = TELEMETRY_VERSION;
+    header->headerSize = sizeof(FrameHeader_t);
+    header->sequence = number;
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    header->timestamp = static_cast<uint64_t>(now.tv_sec)*1000000000 + now.tv_nsec;
+    header->loopPos = loopPos;
+    header->nbBPMx = std::min<int>(BPMx.n_elem, ADC_BUFFER_SIZE);
+    header->nbBPMy = std::min<int>(BPMy.n_elem, ADC_BUFFER_SIZE);
+    header->nbCMx = std::min<int>(CMx.n_elem, ADC_BUFFER_SIZE);
+    header->nbCMy = std::min<int>(CMy.n_elem, ADC_BUFFER_SIZE);
+    header->nbADC = std::min<int>(adcSize, ADC_BUFFER_SIZE);
+    header->typeCorr = typeCorr;
+    header->times = times;
+    header->counters = counters;
+
+    size_t offset = sizeof(FrameHeader_t);
+    offset = copyPayload(buffer, offset, BPMx.memptr(), header->nbBPMx*sizeof(double));
+    offset = copyPayload(buffer, offset, BPMy.memptr(), header->nbBPMy*sizeof(double));
+    offset = copyPayload(buffer, offset, CMx.memptr(), header->nbCMx*sizeof(double));
+    offset = copyPayload(buffer, offset, CMy.memptr(), header->nbCMy*sizeof(double));
+    offset = copyPayload(buffer, offset, adc, header->nbADC*sizeof(RFM2G_INT16));
+    header->frameSize = offset;
+
+    AsyncBackend::postFrame(buffer);
+}
+
+Logger::Aggregator::Aggregator(int cycles)
+    : m_cycles(cycles)
+    , m_sum(SIGNAL_NB*ADC_BUFFER_SIZE)
+    , m_sumSquares(SIGNAL_NB*ADC_BUFFER_SIZE)
+    , m_min(SIGNAL_NB*ADC_BUFFER_SIZE)
+    , m_max(SIGNAL_NB*ADC_BUFFER_SIZE)
+{
+    memset(&m_header, 0, sizeof(AggregateHeader_t));
+    snprintf(m_header.topic, sizeof(m_header.topic), "FOFB-AGG-%d", cycles);
+    m_header.version = AGGREGATE_VERSION;
+    m_header.headerSize = sizeof(AggregateHeader_t);
+    for (int signal = 0 ; signal < SIGNAL_NB ; signal++) {
+        m_sizes[signal] = 0;
+    }
+}
+
+void Logger::Aggregator::reset(const FrameHeader_t& header)
+{
+    m_sizes[BPMx] = header.nbBPMx;
+    m_sizes[BPMy] = header.nbBPMy;
+    m_sizes[CMx] = header.nbCMx;
+    m_sizes[CMy] = header.nbCMy;
+
+    m_header.cycles = 0;
+    m_header.firstSequence = header.sequence;
+    m_header.firstTimestamp = header.timestamp;
+    m_header.maxTimes = header.times;
+
+    m_sum.zeros();
+    m_sumSquares.zeros();
+    m_min.fill(std::numeric_limits<double>::infinity());
+    m_max.fill(-std::numeric_limits<double>::infinity());
+}
+
+void Logger::Aggregator::add(const unsigned char* frame)
+{
+    const FrameHeader_t* header = reinterpret_cast<const FrameHeader_t*>(frame);
+    if ((m_header.cycles == 0)
+            || (header->nbBPMx != m_sizes[BPMx]) || (header->nbBPMy != m_sizes[BPMy])
+            || (header->nbCMx != m_sizes[CMx]) || (header->nbCMy != m_sizes[CMy])) {
+        this->reset(*header);
+    }
+
+    const double* values = reinterpret_cast<const double*>(frame + header->headerSize);
+    double* sum = m_sum.memptr();
+    double* sumSquares = m_sumSquares.memptr();
+    double* min = m_min.memptr();
+    double* max = m_max.memptr();
+    for (int signal = 0 ; signal < SIGNAL_NB ; signal++) {
+        size_t first = signal*ADC_BUFFER_SIZE;
+        for (size_t i = first ; i < first + m_sizes[signal] ; i++) {
+            double value = *values++;
+            sum[i] += value;
+            sumSquares[i] += value*value;
+            min[i] = std::min(min[i], value);
+            max[i] = std::max(max[i], value);
+        }
+    }
+
+    m_header.cycles++;
+    m_header.lastSequence = header->sequence;
+    m_header.lastTimestamp = header->timestamp;
+    m_header.maxTimes.acquisition = std::max(m_header.maxTimes.acquisition, header->times.acquisition);
+    m_header.maxTimes.computation = std::max(m_header.maxTimes.computation, header->times.computation);
+    m_header.maxTimes.output = std::max(m_header.maxTimes.output, header->times.output);
+
+    if (m_header.cycles >= static_cast<uint32_t>(m_cycles)) {
+        this->publish();
+        m_header.cycles = 0;
+    }
+}
+
+void Logger::Aggregator::publish()
+{
+    m_header.nbBPMx = m_sizes[BPMx];
+    m_header.nbBPMy = m_sizes[BPMy];
+    m_header.nbCMx = m_sizes[CMx];
+    m_header.nbCMy = m_sizes[CMy];
+    size_t valueNb = m_sizes[BPMx] + m_sizes[BPMy] + m_sizes[CMx] + m_sizes[CMy];
+    m_header.frameSize = sizeof(AggregateHeader_t) + 4*valueNb*sizeof(double);
+
+    zmq::message_t message(m_header.frameSize);
+    unsigned char* data = static_cast<unsigned char*>(message.data());
+    memcpy(data, &m_header, sizeof(AggregateHeader_t));
+
+    double* output = reinterpret_cast<double*>(data + sizeof(AggregateHeader_t));
+    double cycles = m_header.cycles;
+    for (int signal = 0 ; signal < SIGNAL_NB ; signal++) {
+        const size_t first = signal*ADC_BUFFER_SIZE;
+        const size_t size = m_sizes[signal];
+        for (size_t i = 0 ; i < size ; i++) {
+            output[i] = m_sum(first + i)/cycles;
+            output[size + i] = m_min(first + i);
+            output[2*size + i] = m_max(first + i);
+            output[3*size + i] = std::sqrt(m_sumSquares(first + i)/cycles);
+        }
+        output += 4*size;
+    }
+    Logger::sendZmqMessage(message);
+}
@@ -0,0 +1,264 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <armadillo>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "define.h"
+#include "rfmdriver.h"
+#include "modules/perfcounters.h"
+
+namespace Logger {
+
+/**
+ * @brief Version of the telemetry frame layout, to be increased at each change.
+ */
+const uint16_t TELEMETRY_VERSION = 2;
+
+/**
+ * @brief Topic of the telemetry frames, at the beginning of each frame.
+ */
+const char TELEMETRY_TOPIC[] = "FOFB-FRAME";
+
+/**
+ * @brief Version of the aggregate layout, to be increased at each change.
+ */
+const uint16_t AGGREGATE_VERSION = 1;
+
+/**
+ * @brief Configuration of the telemetry streams (to be set before
+ * AsyncBackend::start()).
+ */
+struct TelemetryConfig_t {
+    bool rawFrames;                /**< @brief Publish the FOFB-FRAME of each cycle? */
+    std::vector<int> aggregations; /**< @brief Number of cycles of each FOFB-AGG-<N> stream */
+};
+
+/**
+ * @brief Access to the configuration of the telemetry streams.
+ */
+TelemetryConfig_t& telemetryConfig();
+
+/**
+ * @brief Duration of the stages of one cycle, in ns.
+ */
+struct StageTimes_t {
+    uint32_t acquisition; /**< @brief Reading and gathering of the ADC buffer */
+    uint32_t computation; /**< @brief Correction processor */
+    uint32_t output;      /**< @brief Scattering and writing of the correction */
+};
+
+/**
+ * @brief Counters of the stages of one cycle (see PerfCounters).
+ *
+ * Each array holds the PerfCounters::Counter values, in order, counted during
+ * the stage.
+ */
+struct StageCounters_t {
+    uint32_t available; /**< @brief Bit i set if the Counter i was counted (0: no counters) */
+    uint32_t reserved;  /**< @brief Padding, 0 */
+    uint64_t acquisition[PerfCounters::COUNTER_NB]; /**< @brief Reading and gathering of the ADC buffer */
+    uint64_t computation[PerfCounters::COUNTER_NB]; /**< @brief Correction processor */
+    uint64_t output[PerfCounters::COUNTER_NB];      /**< @brief Scattering and writing of the correction */
+};
+
+/**
+ * @brief Header of a telemetry frame.
+ *
+ * The frame is a single ZMQ message, in the byte order of the mBox (little
+ * endian): this header, then BPMx, BPMy, CMx, CMy (double) and the ADC buffer
+ * (short). Since the topic is the first field, subscribers subscribe to
+ * "FOFB-FRAME" as for any other message.
+ *
+ * Fields are only ever appended: a decoder knowing an older version reads the
+ * fields it knows and skips to `headerSize` for the payload.
+ */
+struct FrameHeader_t {
+    char topic[16];       /**< @brief TELEMETRY_TOPIC, padded with '\0' */
+    uint16_t version;     /**< @brief TELEMETRY_VERSION */
+    uint16_t headerSize;  /**< @brief sizeof(FrameHeader_t): offset of the payload */
+    uint32_t frameSize;   /**< @brief Size of the whole frame */
+    uint64_t sequence;    /**< @brief Number of the frame (gaps = dropped frames) */
+    uint64_t timestamp;   /**< @brief CLOCK_MONOTONIC, in ns */
+    int32_t loopPos;      /**< @brief Loop position */
+    uint16_t nbBPMx;      /**< @brief Number of BPMx values */
+    uint16_t nbBPMy;      /**< @brief Number of BPMy values */
+    uint16_t nbCMx;       /**< @brief Number of CMx values */
+    uint16_t nbCMy;       /**< @brief Number of CMy values */
+    uint16_t nbADC;       /**< @brief Number of ADC values */
+    uint16_t typeCorr;    /**< @brief Type of correction of the cycle */
+    StageTimes_t times;   /**< @brief Duration of the stages */
+    uint32_t reserved;    /**< @brief Padding, 0 */
+    StageCounters_t counters; /**< @brief Counters of the stages (version 2) */
+};
+
+static_assert(sizeof(FrameHeader_t) == 200, "The telemetry frame layout changed: increase TELEMETRY_VERSION");
+
+/**
+ * @brief Header of an aggregate, published every N cycles on FOFB-AGG-<N>.
+ *
+ * The aggregate is a single ZMQ message, in the byte order of the mBox:
+ * this header, then for BPMx, BPMy, CMx and CMy in this order, the mean,
+ * minimum, maximum and RMS (double) of each value over the N cycles.
+ *
+ * The topic is padded with '\0': subscribe to "FOFB-AGG-15\0" so that the
+ * FOFB-AGG-150 stream is not received as well.
+ */
+struct AggregateHeader_t {
+    char topic[16];          /**< @brief FOFB-AGG-<N>, padded with '\0' */
+    uint16_t version;        /**< @brief AGGREGATE_VERSION */
+    uint16_t headerSize;     /**< @brief sizeof(AggregateHeader_t): offset of the payload */
+    uint32_t frameSize;      /**< @brief Size of the whole aggregate */
+    uint64_t firstSequence;  /**< @brief Sequence number of the first frame */
+    uint64_t lastSequence;   /**< @brief Sequence number of the last frame */
+    uint64_t firstTimestamp; /**< @brief Timestamp of the first frame (ns) */
+    uint64_t lastTimestamp;  /**< @brief Timestamp of the last frame (ns) */
+    uint32_t cycles;         /**< @brief Number of frames aggregated */
+    uint16_t nbBPMx;         /**< @brief Number of BPMx values */
+    uint16_t nbBPMy;         /**< @brief Number of BPMy values */
+    uint16_t nbCMx;          /**< @brief Number of CMx values */
+    uint16_t nbCMy;          /**< @brief Number of CMy values */
+    StageTimes_t maxTimes;   /**< @brief Longest duration of each stage */
+};
+
+static_assert(sizeof(AggregateHeader_t) == 80, "The aggregate layout changed: increase AGGREGATE_VERSION");
+
+/**
+ * @brief Pool of preallocated buffers for the telemetry frames.
+ *
+ * A buffer is taken by the correction thread, sent by ZMQ without being
+ * copied, and given back by ZMQ (release()) once the message is sent, from
+ * its own thread. Nothing is allocated per cycle.
+ */
+class FramePool
+{
+public:
+    /**
+     * @brief Number of buffers.
+     */
+    static const size_t POOL_SIZE = 16;
+
+    /**
+     * @brief Size of a buffer: the largest possible frame.
+     */
+    static const size_t FRAME_SIZE = sizeof(FrameHeader_t)
+                                   + 4*ADC_BUFFER_SIZE*sizeof(double)
+                                   + ADC_BUFFER_SIZE*sizeof(RFM2G_INT16);
+
+    /**
+     * @brief Take a free buffer.
+     *
+     * @return nullptr if all buffers are in use.
+     */
+    static unsigned char* acquire();
+
+    /**
+     * @brief Give a buffer back. Has the signature of a ZMQ free function.
+     */
+    static void release(void* data, void* hint);
+
+private:
+    /**
+     * @brief A buffer and its state.
+     */
+    struct Slot_t {
+        alignas(64) unsigned char data[FRAME_SIZE]; /**< @brief Frame */
+        std::atomic<bool> used;                     /**< @brief Is it taken? */
+    };
+
+    static Slot_t s_slots[POOL_SIZE]; /**< @brief Buffers */
+    static std::atomic<unsigned> s_next; /**< @brief Where to start looking for a free buffer */
+};
+
+/**
+ * @brief Aggregation of the telemetry frames over N cycles.
+ *
+ * Mean, minimum, maximum and RMS of each BPM and CM value are computed
+ * incrementally, frame after frame, by the AsyncBackend thread. Every N
+ * frames they are published on FOFB-AGG-<N>; slow subscribers (10 Hz, 1 Hz)
+ * do not have to receive and reduce each cycle themselves.
+ *
+ * If the number of BPMs or CMs changes, the current window is restarted.
+ */
+class Aggregator
+{
+public:
+    /**
+     * @brief Constructor
+     *
+     * @param cycles Number of frames per aggregate
+     */
+    explicit Aggregator(int cycles);
+
+    /**
+     * @brief Add a telemetry frame, and publish the aggregate if it is
+     * complete.
+     */
+    void add(const unsigned char* frame);
+
+    /**
+     * @brief Number of frames per aggregate.
+     */
+    int cycles() const { return m_cycles; }
+
+private:
+    /**
+     * @brief Index of the first value of a signal in the accumulators.
+     */
+    enum Signal { BPMx = 0, BPMy = 1, CMx = 2, CMy = 3, SIGNAL_NB = 4 };
+
+    /**
+     * @brief Start a new window with the sizes of `header`.
+     */
+    void reset(const FrameHeader_t& header);
+
+    /**
+     * @brief Build and send the aggregate of the current window.
+     */
+    void publish();
+
+    int m_cycles; /**< @brief Number of frames per aggregate */
+    AggregateHeader_t m_header; /**< @brief Header of the current aggregate */
+    uint16_t m_sizes[SIGNAL_NB]; /**< @brief Number of values of each signal */
+    arma::vec m_sum;        /**< @brief Sum of the values (ADC_BUFFER_SIZE per signal) */
+    arma::vec m_sumSquares; /**< @brief Sum of the squared values */
+    arma::vec m_min;        /**< @brief Minimum of the values */
+    arma::vec m_max;        /**< @brief Maximum of the values */
+};
+
+/**
+ * @brief Build the telemetry frame of a cycle and publish it.
+ *
+ * The frame is written in a buffer of the FramePool. From the hot thread of
+ * the AsyncBackend, it is then handed over to the backend thread; if there is
+ * no running backend, it is sent directly. When no buffer is free, the frame
+ * is dropped (its sequence number is skipped).
+ */
+void frame(int loopPos, int typeCorr, const StageTimes_t& times, const StageCounters_t& counters,
+           const arma::vec& BPMx, const arma::vec& BPMy,
+           const arma::vec& CMx, const arma::vec& CMy,
+           const RFM2G_INT16* adc, int adcSize);
+
+}
+
+#endif // TELEMETRY_H
@@ -0,0 +1,173 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "rfmbenchmark.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "dma.h"
+#include "rfmdriver.h"
+#include "modules/timers.h"
+#include "modules/zmq/logger.h"
+
+namespace {
+    /**
+     * @brief Sizes of the timed reads (up to an ADC slot of the DMA buffer).
+     */
+    const RFM2G_UINT32 SIZES[] = { 4, 64, 512, DMA_ADC_SLOT_SIZE };
+
+    /**
+     * @brief Number of timed reads per size and way.
+     */
+    const int REPEAT = 1000;
+
+    /**
+     * @brief Smallest valid duration (< 0 are not available).
+     */
+    double fastest(double a, double b)
+    {
+        if (a < 0) {
+            return b;
+        }
+        return (b < 0) ? a : std::min(a, b);
+    }
+
+    /**
+     * @brief Format a duration for the report.
+     */
+    std::string format(double ns)
+    {
+        std::ostringstream text;
+        if (ns < 0) {
+            text << "n/a";
+        } else {
+            text << std::fixed << std::setprecision(0) << ns << " ns";
+        }
+        return text.str();
+    }
+}
+
+RFMBenchmark::RFMBenchmark(RFMDriver *driver, DMA *dma)
+    : m_driver(driver)
+    , m_dma(dma)
+{
+}
+
+double RFMBenchmark::timeDriver(RFM2G_UINT32 threshold, void* buffer, RFM2G_UINT32 size)
+{
+    // The window must not serve these reads
+    RFM2G_UINT32 limit = m_driver->window().limit();
+    m_driver->window().setLimit(0);
+    m_driver->setDMAThreshold(threshold);
+
+    double duration = -1;
+    uint64_t start = TimingModule::now();
+    int i = 0;
+    for ( ; i < REPEAT ; i++) {
+        if (m_driver->read(ADC_MEMPOS, buffer, size)) {
+            break;
+        }
+    }
+    if (i == REPEAT) {
+        duration = static_cast<double>(TimingModule::now() - start)/REPEAT;
+    }
+    m_driver->window().setLimit(limit);
+    return duration;
+}
+
+double RFMBenchmark::timeMapped(void* buffer, RFM2G_UINT32 size)
+{
+    RFMWindow& window = m_driver->window();
+    if (!window.isMapped()) {
+        return -1;
+    }
+    RFM2G_UINT32 limit = window.limit();
+    window.setLimit(size);
+    double duration = -1;
+    if (window.covers(ADC_MEMPOS, size)) {
+        uint64_t start = TimingModule::now();
+        for (int i = 0 ; i < REPEAT ; i++) {
+            window.read(ADC_MEMPOS, buffer, size);
+        }
+        duration = static_cast<double>(TimingModule::now() - start)/REPEAT;
+    }
+    window.setLimit(limit);
+    return duration;
+}
+
+void RFMBenchmark::run()
+{
+    RFM2G_UINT32 threshold = 0;
+    m_driver->getDMAThreshold(&threshold);
+
+    std::vector<char> buffer(DMA_ADC_SLOT_SIZE);
+    void* dmaBuffer = (void*) m_dma->adcSlot(0);
+
+    std::cout << "RFM read benchmark (mapped / driver PIO / driver DMA):\n";
+    Logger::Logger() << "RFM read benchmark (mapped / driver PIO / driver DMA):";
+    m_results.clear();
+    for (RFM2G_UINT32 size : SIZES) {
+        Result_t result;
+        result.size = size;
+        result.mapped = this->timeMapped(buffer.data(), size);
+        result.driverPIO = this->timeDriver(UINT32_MAX, buffer.data(), size);
+        result.driverDMA = (dmaBuffer == NULL) ? -1 : this->timeDriver(0, dmaBuffer, size);
+        m_results.push_back(result);
+
+        std::ostringstream line;
+        line << '\t' << std::setw(5) << size << " bytes: " << format(result.mapped)
+             << " / " << format(result.driverPIO) << " / " << format(result.driverDMA);
+        std::cout << line.str() << '\n';
+        Logger::Logger() << line.str();
+    }
+    m_driver->setDMAThreshold(threshold);
+}
+
+void RFMBenchmark::configure()
+{
+    if (m_results.empty()) {
+        return;
+    }
+
+    // Mapped reads for the small sizes, as long as they are the fastest
+    RFM2G_UINT32 limit = 0;
+    for (const Result_t& result : m_results) {
+        if ((result.mapped < 0) || (result.mapped > fastest(result.driverPIO, result.driverDMA))) {
+            break;
+        }
+        limit = result.size;
+    }
+
+    // DMA for the large sizes, from where it is always the fastest
+    RFM2G_UINT32 threshold = 2*m_results.back().size;
+    for (auto result = m_results.rbegin() ; result != m_results.rend() ; ++result) {
+        if ((result->driverDMA < 0) || (result->driverDMA >= fastest(result->driverPIO, result->mapped))) {
+            break;
+        }
+        threshold = result->size;
+    }
+
+    m_driver->window().setLimit(limit);
+    m_driver->setDMAThreshold(threshold);
+    std::ostringstream line;
+    line << "\tMapped PIO up to " << m_driver->window().limit() << " bytes, DMA from "
+         << threshold << " bytes";
+    std::cout << line.str() << '\n';
+    Logger::Logger() << line.str();
+}
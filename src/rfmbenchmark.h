@@ -0,0 +1,109 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef RFMBENCHMARK_H
+#define RFMBENCHMARK_H
+
+#include <vector>
+
+#include "define.h"
+
+class DMA;
+class RFMDriver;
+
+/**
+ * @brief Micro-benchmark, at startup, of the ways to read the RFM.
+ *
+ * For each size in SIZES, reads of the ADC area are timed:
+ *  * through the mapped PIO window (RFMWindow);
+ *  * through the driver, in PIO;
+ *  * through the driver, in DMA (into an ADC slot of the DMA buffer).
+ *
+ * configure() then gives each transfer size to the fastest way: the window
+ * limit is the largest size up to which the mapped reads are the fastest,
+ * the DMA threshold the smallest size from which DMA is the fastest. Only
+ * reads are timed, writes follow the same limit. This must be done before
+ * the ADC and DAC are created (they choose their transfer then).
+ *
+ * \code{.cpp}
+ * driver->window().map(dma->pioWindow(), dma->pioSize());
+ * RFMBenchmark benchmark(driver, dma);
+ * benchmark.run();
+ * benchmark.configure();
+ * \endcode
+ */
+class RFMBenchmark
+{
+public:
+    /**
+     * @brief Mean duration of a read of one size, in ns (< 0: not available).
+     */
+    struct Result_t {
+        RFM2G_UINT32 size; /**< @brief Size of the read (bytes) */
+        double mapped;     /**< @brief Through the mapped window */
+        double driverPIO;  /**< @brief Through the driver, in PIO */
+        double driverDMA;  /**< @brief Through the driver, in DMA */
+    };
+
+    /**
+     * @brief Constructor
+     *
+     * @param driver Pointer to a RFMDriver object, whose window is mapped if
+     * the mapped mode is wanted
+     * @param dma Pointer to an initialized DMA object
+     */
+    RFMBenchmark(RFMDriver *driver, DMA *dma);
+
+    /**
+     * @brief Time the reads of each size and print/log the results.
+     */
+    void run();
+
+    /**
+     * @brief Set the window limit and the DMA threshold of the driver from
+     * the results of run().
+     */
+    void configure();
+
+    /**
+     * @brief Results of run(), one per size.
+     */
+    const std::vector<Result_t>& results() const { return m_results; };
+
+private:
+    /**
+     * @brief Mean duration of a read through the driver.
+     *
+     * @param threshold DMA threshold to use during the measure
+     * @param buffer Destination of the reads
+     * @param size Size of the reads
+     * @return ns, or -1 if a read failed
+     */
+    double timeDriver(RFM2G_UINT32 threshold, void* buffer, RFM2G_UINT32 size);
+
+    /**
+     * @brief Mean duration of a read through the window.
+     *
+     * @return ns, or -1 if the window does not cover the area
+     */
+    double timeMapped(void* buffer, RFM2G_UINT32 size);
+
+    RFMDriver *m_driver; /**< @brief Pointer to a RFMDriver object */
+    DMA *m_dma;          /**< @brief Pointer to a DMA object */
+    std::vector<Result_t> m_results; /**< @brief Results of run() */
+};
+
+#endif // RFMBENCHMARK_H
@@ -19,6 +19,7 @@
 #define RFMDRIVER_H
 
 #include "rfmdriverinterface.h"
+#include "modules/trace.h"
 
 #if DUMMY_RFM_DRIVER
     #include "rfmdriver_dummy.h"
@@ -119,13 +120,28 @@ public:
 
     /**
      * Data Transferts
+     *
+     * The small transfers use the mapped window, if any (see RFMWindow).
+     * The transfers and the events are recorded in trace mode (see Trace).
      */
     virtual RFM2G_STATUS read(RFM2G_UINT32 offset, void* buffer, RFM2G_UINT32 length)
     {
+        if (m_window.covers(offset, length)) {
+            Trace::Scope scope("MappedRead");
+            m_window.read(offset, buffer, length);
+            return RFM2G_SUCCESS;
+        }
+        Trace::Scope scope("RFM2gRead");
         return RFM2gRead(m_handle, offset, buffer, length);
     };
     virtual RFM2G_STATUS write(RFM2G_UINT32 offset, void* buffer, RFM2G_UINT32 length)
     {
+        if (m_window.covers(offset, length)) {
+            Trace::Scope scope("MappedWrite");
+            m_window.write(offset, buffer, length);
+            return RFM2G_SUCCESS;
+        }
+        Trace::Scope scope("RFM2gWrite");
         return RFM2gWrite(m_handle, offset, buffer, length);
     };
     virtual RFM2G_STATUS peek8(RFM2G_UINT32 offset, RFM2G_UINT8 * value)
@@ -168,18 +184,22 @@ public:
      */
     virtual RFM2G_STATUS enableEvent(RFM2GEVENTTYPE eventType)
     {
+        Trace::Scope scope("RFM2gEnableEvent");
         return RFM2gEnableEvent(m_handle, eventType);
     };
     virtual RFM2G_STATUS disableEvent(RFM2GEVENTTYPE eventType)
     {
+        Trace::Scope scope("RFM2gDisableEvent");
         return RFM2gDisableEvent(m_handle, eventType);
     };
     virtual RFM2G_STATUS sendEvent(RFM2G_NODE toNode, RFM2GEVENTTYPE eventType, RFM2G_UINT32 extendedData)
     {
+        Trace::Scope scope("RFM2gSendEvent");
         return RFM2gSendEvent(m_handle, toNode, eventType, extendedData);
     };
     virtual RFM2G_STATUS waitForEvent(RFM2GEVENTINFO* eventInfo)
     {
+        Trace::Scope scope("RFM2gWaitForEvent");
         return RFM2gWaitForEvent(m_handle, eventInfo);
     };
     virtual RFM2G_STATUS enableEventCallback(RFM2GEVENTTYPE eventType, RFM2G_EVENT_FUNCPTR pEventFunc)
@@ -192,10 +212,12 @@ public:
     };
     virtual RFM2G_STATUS clearEvent(RFM2GEVENTTYPE eventType)
     {
+        Trace::Scope scope("RFM2gClearEvent");
         return RFM2gClearEvent(m_handle, eventType);
     };
     virtual RFM2G_STATUS cancelWaitForEvent(RFM2GEVENTTYPE eventType)
     {
+        Trace::Scope scope("RFM2gCancelWaitForEvent");
         return RFM2gCancelWaitForEvent(m_handle, eventType);
     };
     virtual RFM2G_STATUS clearEventCount(RFM2GEVENTTYPE eventType)
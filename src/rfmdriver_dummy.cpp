@@ -22,6 +22,7 @@
 #include <cstring>
 #include <chrono>
 #include "define.h"
+#include "modules/trace.h"
 
 const int INT_POS = -1; /**< @brief Position of the register for interruptions */
 const int INT_ENABLE = -2; /**< @brief Position of the register for enabled interruptions */
@@ -40,6 +41,7 @@ RFM2G_STATUS RFMDriver::open(char* devicePath)
 
 RFM2G_STATUS RFMDriver::read(RFM2G_UINT32 offset, void* buffer, RFM2G_UINT32 length)
 {
+    Trace::Scope scope("RFM2gRead");
     std::ifstream file;
     file.open(dummyFile, std::ios::in | std::ios::binary);
 
@@ -61,6 +63,7 @@ RFM2G_STATUS RFMDriver::read(RFM2G_UINT32 offset, void* buffer, RFM2G_UINT32 len
 
 RFM2G_STATUS RFMDriver::write(RFM2G_UINT32 offset, void* buffer, RFM2G_UINT32 length)
 {
+    Trace::Scope scope("RFM2gWrite");
     std::ofstream file;
     file.open(dummyFile, std::ios::in | std::ios::out | std::ios::binary);
 
@@ -94,6 +97,7 @@ RFM2G_STATUS RFMDriver::setDMAThreshold(RFM2G_UINT32 threshold)
 
 RFM2G_STATUS RFMDriver::waitForEvent(RFM2GEVENTINFO* eventInfo)
 {
+    Trace::Scope scope("RFM2gWaitForEvent");
     using namespace std::chrono;
     steady_clock::time_point start = steady_clock::now();
     char pos = 0;
@@ -133,6 +137,7 @@ RFM2G_STATUS RFMDriver::waitForEvent(RFM2GEVENTINFO* eventInfo)
 }
 
 RFM2G_STATUS RFMDriver::enableEvent(RFM2GEVENTTYPE eventType) {
+    Trace::Scope scope("RFM2gEnableEvent");
     unsigned char pos = 0;
     if (eventType == ADC_EVENT) {
         pos = ADC_INT_VAL;
@@ -157,6 +162,7 @@ RFM2G_STATUS RFMDriver::enableEvent(RFM2GEVENTTYPE eventType) {
 }
 
 RFM2G_STATUS RFMDriver::disableEvent(RFM2GEVENTTYPE eventType) {
+    Trace::Scope scope("RFM2gDisableEvent");
     unsigned char pos = 0;
     if (eventType == ADC_EVENT) {
         pos = ADC_INT_VAL;
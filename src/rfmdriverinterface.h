@@ -25,6 +25,8 @@
 #include <rfm2g_api.h>
 #endif
 
+#include "rfmwindow.h"
+
 class RFMDriverInterface
 {
 public:
@@ -111,8 +113,15 @@ public:
 
     RFM2GHANDLE handle() const { return m_handle; };
 
+    /**
+     * @brief Mapped PIO window, used by read() and write() for the small
+     * transfers once it is mapped (not by the dummy driver).
+     */
+    RFMWindow& window() { return m_window; };
+
 protected:
     RFM2GHANDLE m_handle;
+    RFMWindow m_window;
 };
 
 #endif // RFMDRIVER_H
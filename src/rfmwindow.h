@@ -0,0 +1,137 @@
+/*
+    Copyright (C) 2016 Olivier Churlaud <olivier@churlaud.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef RFMWINDOW_H
+#define RFMWINDOW_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#include "config.h"
+#if DUMMY_RFM_DRIVER
+#include "rfm2g_dummy/rfm2g_api.h"
+#else
+#include <rfm2g_api.h>
+#endif
+
+/**
+ * @brief PIO window of the RFM card, mapped in the address space of the
+ * process (see DMA::init()).
+ *
+ * Small transfers are then plain volatile loads and stores on the card
+ * memory, instead of an ioctl of the driver each. Only the transfers up to
+ * limit() bytes use the window (see RFMBenchmark), the others still go
+ * through the driver.
+ *
+ * The PIO byte swapping of the driver is not applied: mBox::init() only
+ * maps the window when RFMDriver::getPIOByteSwap() says it is disabled.
+ */
+class RFMWindow
+{
+public:
+    /**
+     * @brief Constructor. Nothing is mapped: no transfer uses the window.
+     */
+    RFMWindow() : m_base(NULL), m_size(0), m_limit(0) {};
+
+    /**
+     * @brief Set the mapped window.
+     *
+     * @param base Address of the offset 0 of the RFM
+     * @param size Size of the window (bytes)
+     */
+    void map(volatile char* base, RFM2G_UINT32 size) { m_base = base; m_size = size; };
+
+    /**
+     * @brief Whether a window is mapped.
+     */
+    bool isMapped() const { return m_base != NULL; };
+
+    /**
+     * @brief Use the window for the transfers up to `limit` bytes (0: never).
+     */
+    void setLimit(RFM2G_UINT32 limit) { m_limit = isMapped() ? limit : 0; };
+
+    /**
+     * @brief Largest transfer that uses the window.
+     */
+    RFM2G_UINT32 limit() const { return m_limit; };
+
+    /**
+     * @brief Whether a transfer should use the window.
+     */
+    bool covers(RFM2G_UINT32 offset, RFM2G_UINT32 length) const {
+        return (length <= m_limit) && (offset <= m_size) && (length <= m_size - offset);
+    };
+
+    /**
+     * @brief Read the RFM through the window.
+     *
+     * The stores issued before (e.g. the previous write) are completed
+     * first, and nothing issued after is done before the loads.
+     */
+    void read(RFM2G_UINT32 offset, void* buffer, RFM2G_UINT32 length) const {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        volatile const char* src = m_base + offset;
+        char* dst = static_cast<char*>(buffer);
+        // Bytes until the card address is aligned, then 32 bit words
+        while (length && (reinterpret_cast<uintptr_t>(src) & 3)) {
+            *dst++ = *src++;
+            length--;
+        }
+        for ( ; length >= 4 ; length -= 4, src += 4, dst += 4) {
+            uint32_t word = *reinterpret_cast<volatile const uint32_t*>(src);
+            memcpy(dst, &word, 4);
+        }
+        while (length--) {
+            *dst++ = *src++;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+    };
+
+    /**
+     * @brief Write the RFM through the window.
+     *
+     * The stores are completed (write-combining buffers flushed) before
+     * returning, so that an event sent next is not received before the data.
+     */
+    void write(RFM2G_UINT32 offset, const void* buffer, RFM2G_UINT32 length) const {
+        std::atomic_thread_fence(std::memory_order_release);
+        volatile char* dst = m_base + offset;
+        const char* src = static_cast<const char*>(buffer);
+        while (length && (reinterpret_cast<uintptr_t>(dst) & 3)) {
+            *dst++ = *src++;
+            length--;
+        }
+        for ( ; length >= 4 ; length -= 4, src += 4, dst += 4) {
+            uint32_t word;
+            memcpy(&word, src, 4);
+            *reinterpret_cast<volatile uint32_t*>(dst) = word;
+        }
+        while (length--) {
+            *dst++ = *src++;
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    };
+
+private:
+    volatile char* m_base; /**< @brief Address of the offset 0 of the RFM */
+    RFM2G_UINT32 m_size;   /**< @brief Size of the window */
+    RFM2G_UINT32 m_limit;  /**< @brief Largest transfer using the window */
+};
+
+#endif // RFMWINDOW_H